@@ -0,0 +1,52 @@
+// Uniform blocks shared by every program, streamed through the per-frame ring buffer.
+// Layouts must match FrameData, ObjectData and SpotLightData in renderqueue.h.
+struct Material {
+    vec3 specular;
+    float shininess;
+};
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    // Seconds of simulation time, for procedural animation
+    float time;
+    // Without the projection's jitter, and the frame before's, for motion vectors
+    mat4 currentViewProjection;
+    mat4 previousViewProjection;
+    float previousTime;
+};
+
+layout (std140) uniform ObjectData {
+    mat4 model;
+    mat4 previousModel;
+    Material material;
+    // World-space pivot in xyz, tilt amplitude in radians in w
+    vec4 vibration;
+    // Scale in xy and offset in zw into the lightmap atlas, zero for objects that are not baked
+    vec4 lightmapRect;
+    uint vibrationSeed;
+};
+
+#define MAX_SPOT_LIGHTS 64
+
+struct SpotLight {
+    vec3 position;
+    float cutOff;
+    vec3 direction;
+    float outerCutOff;
+    vec3 ambient;
+    float constant;
+    vec3 diffuse;
+    float linear;
+    vec3 specular;
+    float quadratic;
+    // Light space to the light's tile of the shadow atlas, and the tile's corners; see shadowatlas.h
+    mat4 shadowMatrix;
+    vec4 shadowRect;
+};
+
+layout (std140) uniform SpotLightData {
+    SpotLight spotLights[MAX_SPOT_LIGHTS];
+    int spotLightCount;
+};
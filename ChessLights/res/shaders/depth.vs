@@ -0,0 +1,11 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// Must match the main pass exactly, which tests against this depth with GL_LEQUAL
+invariant gl_Position;
+
+void main()
+{
+    vec3 fragPos = vibrate(vec3(model * vec4(aPos, 1.0)), vibrationRotation());
+    gl_Position = projection * view * vec4(fragPos, 1.0);
+}
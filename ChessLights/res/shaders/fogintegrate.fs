@@ -0,0 +1,34 @@
+#version 330 core
+layout (location = 0) out vec4 Integrated;
+layout (location = 1) out vec4 Accumulated;
+
+in vec2 FroxelCoords;
+
+uniform int slice;
+uniform vec2 froxelTanHalfFov;
+uniform sampler3D fogScatter;
+// Light gathered in rgb and transmittance in a up to the near end of this slice
+uniform sampler2D fogAccumulation;
+
+float froxelDepth(float slice);
+
+void main()
+{
+    ivec2 column = ivec2(gl_FragCoord.xy);
+    vec4 before = slice == 0 ? vec4(0.0, 0.0, 0.0, 1.0) : texelFetch(fogAccumulation, column, 0);
+    vec4 froxel = texelFetch(fogScatter, ivec3(column, slice), 0);
+
+    // Length of the view ray through the slice, longer towards the corners of the screen
+    vec2 ndc = FroxelCoords * 2.0 - 1.0;
+    float stretch = length(vec3(ndc * froxelTanHalfFov, 1.0));
+    float near = slice == 0 ? 0.0 : froxelDepth(float(slice));
+    float thickness = (froxelDepth(float(slice + 1)) - near) * stretch;
+
+    // Scattered light integrated over the slice under its own extinction
+    float extinction = max(froxel.a, 1e-5);
+    float transmittance = exp(-extinction * thickness);
+    vec3 scattered = froxel.rgb / extinction * (1.0 - transmittance);
+    vec4 after = vec4(before.rgb + scattered * before.a, before.a * transmittance);
+    Integrated = after;
+    Accumulated = after;
+}
@@ -0,0 +1,39 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 FroxelCoords;
+
+uniform int slice;
+// Where in its slice this frame samples, 0 to 1
+uniform float sliceJitter;
+uniform mat4 froxelInverseView;
+uniform vec2 froxelTanHalfFov;
+uniform mat4 historyViewProjection;
+uniform sampler3D fogHistory;
+uniform float historyWeight;
+
+vec4 calcFroxel(vec3 position, vec3 viewDir);
+float froxelDepth(float slice);
+float froxelSlice(float depth);
+
+void main()
+{
+    // View depth and world position of the sample
+    float depth = froxelDepth(float(slice) + sliceJitter);
+    vec2 ndc = FroxelCoords * 2.0 - 1.0;
+    vec3 viewPosition = vec3(ndc * froxelTanHalfFov, -1.0) * depth;
+    vec3 position = vec3(froxelInverseView * vec4(viewPosition, 1.0));
+    vec3 cameraPosition = vec3(froxelInverseView[3]);
+
+    vec4 result = calcFroxel(position, normalize(position - cameraPosition));
+
+    // The same point in last frame's grid; no history where it was off screen
+    vec4 previous = historyViewProjection * vec4(position, 1.0);
+    if (historyWeight > 0.0 && previous.w > 0.0)
+    {
+        vec3 coords = vec3(previous.xy / previous.w * 0.5 + 0.5, froxelSlice(previous.w) / float(textureSize(fogHistory, 0).z));
+        if (all(greaterThanEqual(coords, vec3(0.0))) && all(lessThanEqual(coords, vec3(1.0))))
+            result = mix(result, texture(fogHistory, coords), historyWeight);
+    }
+    FragColor = result;
+}
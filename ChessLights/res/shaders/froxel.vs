@@ -0,0 +1,10 @@
+#version 330 core
+// Full-screen triangle over one slice of the froxel grid, see volumetricfog.h
+out vec2 FroxelCoords;
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    FroxelCoords = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
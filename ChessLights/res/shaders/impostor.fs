@@ -0,0 +1,54 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+// As in object.fs
+layout (location = 1) out vec2 Motion;
+
+in vec3 QuadPos;
+flat in vec3 FrameCenter;
+flat in float FrameRadius;
+flat in vec3 FrameRight;
+flat in vec3 FrameUp;
+flat in vec3 FrameDir;
+flat in vec2 FrameOrigin;
+flat in mat3 NormalMatrix;
+
+uniform sampler2D impostorNormalDepth;
+uniform int impostorFrames;
+uniform bool volumetricFog;
+
+vec4 sampleDiffuse(vec2 texCoord);
+vec3 calcColorWithLight(vec3 fragPos, vec3 normal, vec2 texCoord, vec3 viewPos, bool receiveShadows);
+vec3 addFog(vec3 color, float distanceFromCamera);
+vec3 addVolumetricFog(vec3 color, vec2 screenCoords, float viewDepth);
+
+void main()
+{
+    // Where the view ray crosses the plane the frame was rendered on
+    vec3 ray = QuadPos - viewPos;
+    float t = dot(FrameCenter - viewPos, FrameDir) / dot(ray, FrameDir);
+    vec3 onPlane = viewPos + ray * t;
+    vec2 frameCoords = vec2(dot(onPlane - FrameCenter, FrameRight), dot(onPlane - FrameCenter, FrameUp)) / (2.0 * FrameRadius) + 0.5;
+    if (any(lessThan(frameCoords, vec2(0.0))) || any(greaterThan(frameCoords, vec2(1.0))))
+        discard;
+    vec2 atlasCoords = FrameOrigin + frameCoords / float(impostorFrames);
+    if (sampleDiffuse(atlasCoords).a < 0.5)
+        discard;
+
+    // The surface lies the stored depth in front of or behind the plane
+    vec4 normalDepth = texture(impostorNormalDepth, atlasCoords);
+    vec3 fragPos = onPlane + FrameDir * FrameRadius * (1.0 - 2.0 * normalDepth.a);
+    vec3 normal = normalize(NormalMatrix * (normalDepth.xyz * 2.0 - 1.0));
+    vec4 clip = projection * view * vec4(fragPos, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    vec3 result = calcColorWithLight(fragPos, normal, atlasCoords, viewPos, true);
+    if (volumetricFog)
+        result = addVolumetricFog(result, gl_FragCoord.xy, -(view * vec4(fragPos, 1.0)).z);
+    else
+        result = addFog(result, length(fragPos - viewPos));
+    FragColor = vec4(result, 1.0);
+    // Impostors stand still; only the camera moves them on screen
+    vec4 previous = previousViewProjection * vec4(fragPos, 1.0);
+    vec4 current = currentViewProjection * vec4(fragPos, 1.0);
+    Motion = (current.xy / current.w - previous.xy / previous.w) * 0.5;
+}
@@ -0,0 +1,66 @@
+#version 330 core
+// Far piece as a quad facing the camera, one instance per piece; see ImpostorAtlas
+layout (location = 0) in mat4 aInstance;
+
+out vec3 QuadPos;
+flat out vec3 FrameCenter;
+flat out float FrameRadius;
+// World-space axes of the chosen frame; FrameDir points from the model towards the frame's viewer
+flat out vec3 FrameRight;
+flat out vec3 FrameUp;
+flat out vec3 FrameDir;
+// Lower left corner of the frame in the atlas
+flat out vec2 FrameOrigin;
+flat out mat3 NormalMatrix;
+
+uniform vec3 impostorCenter;
+uniform float impostorRadius;
+uniform mat3 impostorBasis;
+uniform int impostorFrames;
+
+// Same as ImpostorAtlas::frameDirection
+vec3 frameDirection(vec2 coords)
+{
+    vec2 p = vec2(coords.x + coords.y, coords.x - coords.y) * 0.5;
+    return normalize(vec3(p.x, p.y, 1.0 - abs(p.x) - abs(p.y)));
+}
+
+void main()
+{
+    mat3 modelToWorld = mat3(aInstance);
+    vec3 center = vec3(aInstance * vec4(impostorCenter, 1.0));
+    // Pieces are scaled evenly
+    float scale = length(modelToWorld[0]);
+    float radius = impostorRadius * scale;
+
+    // Direction to the camera on the hemisphere, folded onto the hemi-octahedral square.
+    // From below, the lowest frames are the closest there are.
+    vec3 local = transpose(impostorBasis) * (inverse(modelToWorld) * (viewPos - center));
+    local.z = max(local.z, 0.0);
+    local /= max(abs(local.x) + abs(local.y) + local.z, 1e-6);
+    vec2 square = vec2(local.x + local.y, local.x - local.y);
+    ivec2 cell = clamp(ivec2((square * 0.5 + 0.5) * float(impostorFrames)), ivec2(0), ivec2(impostorFrames - 1));
+    vec3 frameLocal = frameDirection((vec2(cell) + 0.5) / float(impostorFrames) * 2.0 - 1.0);
+
+    // The frame's axes as glm::lookAt built them in ImpostorAtlas::bake
+    vec3 direction = impostorBasis * frameLocal;
+    vec3 upHint = abs(frameLocal.z) < 0.999 ? impostorBasis[2] : impostorBasis[0];
+    vec3 right = normalize(cross(-direction, upHint));
+    vec3 up = cross(right, -direction);
+    FrameRight = normalize(modelToWorld * right);
+    FrameUp = normalize(modelToWorld * up);
+    FrameDir = normalize(modelToWorld * direction);
+    FrameCenter = center;
+    FrameRadius = radius;
+    FrameOrigin = vec2(cell) / float(impostorFrames);
+    NormalMatrix = transpose(inverse(modelToWorld));
+
+    // The quad covers the bounding sphere as the camera sees it, a little larger up close
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    vec3 cameraRight = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 cameraUp = vec3(view[0][1], view[1][1], view[2][1]);
+    float distance = length(viewPos - center);
+    float extent = radius * distance / sqrt(max(distance * distance - radius * radius, 1e-4));
+    QuadPos = center + (corner.x * cameraRight + corner.y * cameraUp) * extent;
+    gl_Position = projection * view * vec4(QuadPos, 1.0);
+}
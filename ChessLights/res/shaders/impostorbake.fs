@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) out vec4 Albedo;
+// Model-space normal in rgb, depth through the bounding sphere in a
+layout (location = 1) out vec4 NormalDepth;
+
+in vec3 Normal;
+in vec2 TexCoords;
+
+vec4 sampleDiffuse(vec2 texCoord);
+
+void main()
+{
+    Albedo = vec4(sampleDiffuse(TexCoords).rgb, 1.0);
+    NormalDepth = vec4(normalize(Normal) * 0.5 + 0.5, gl_FragCoord.z);
+}
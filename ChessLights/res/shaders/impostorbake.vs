@@ -0,0 +1,17 @@
+#version 330 core
+// One frame of an impostor atlas, in model space; see ImpostorAtlas
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+out vec3 Normal;
+out vec2 TexCoords;
+
+uniform mat4 bakeViewProjection;
+
+void main()
+{
+    Normal = aNormal;
+    TexCoords = aTexCoords;
+    gl_Position = bakeViewProjection * vec4(aPos, 1.0);
+}
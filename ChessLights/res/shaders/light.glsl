@@ -1,10 +1,6 @@
 #define NR_POINT_LIGHTS 2
-#define NR_SPOT_LIGHTS 1
-
-struct Material {
-    vec3 specular;
-    float shininess;
-}; 
+// Directional light, then the six cube faces of each point light; see shadow.h
+#define NR_SHADOW_LAYERS (1 + 6 * NR_POINT_LIGHTS)
 
 struct DirLight {
     vec3 direction;
@@ -26,47 +22,131 @@ struct PointLight {
     vec3 specular;
 };
 
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-  
-    float constant;
-    float linear;
-    float quadratic;
-  
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;       
-};
-
 uniform DirLight dirLight;
 uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLights[NR_SPOT_LIGHTS];
-uniform Material material;
 uniform sampler2D texture_diffuse1;
 uniform bool lightsOn;
 
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec2 texCoord);
-vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec2 texCoord);
-vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec2 texCoord);
+uniform sampler2DArrayShadow shadowMaps;
+uniform mat4 shadowMatrices[NR_SHADOW_LAYERS];
+uniform bool shadowsOn;
+// Spotlight shadows, one tile per light
+uniform sampler2DShadow spotShadowAtlas;
+
+// Baked sun and point lights of static objects, see lightbaker.h for the channels
+uniform sampler2D lightmap;
 
-vec3 calcColorWithLight(vec3 fragPos, vec3 normal, vec2 texCoord, vec3 viewPos)
+// Pushes the lookup off the surface, against acne on faces at grazing angles
+const float shadowNormalOffset = 0.03;
+
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec2 texCoord, float shadow);
+vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec2 texCoord, float shadow);
+vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec2 texCoord, float shadow);
+float calcShadow(int layer, vec3 fragPos, vec3 normal);
+float calcSpotShadow(int light, vec3 fragPos, vec3 normal);
+int cubeFace(vec3 direction);
+
+// fragPos and normal have to be in world space for shadows
+vec3 calcColorWithLight(vec3 fragPos, vec3 normal, vec2 texCoord, vec3 viewPos, bool receiveShadows)
 {
     vec3 norm = normalize(normal);
     vec3 viewDir = normalize(viewPos - fragPos);
-    vec3 result = calcDirLight(dirLight, norm, viewDir, texCoord);
+    bool shadowed = receiveShadows && shadowsOn;
+    vec3 result = calcDirLight(dirLight, norm, viewDir, texCoord, shadowed ? calcShadow(0, fragPos, norm) : 1.0);
     if (!lightsOn)
         return result;
     for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += calcPointLight(pointLights[i], norm, fragPos, viewDir, texCoord);    
-    for(int i = 0; i < NR_SPOT_LIGHTS; i++)
-        result += calcSpotLight(spotLights[i], norm, fragPos, viewDir, texCoord);
+    {
+        int layer = 1 + 6 * i + cubeFace(fragPos - pointLights[i].position);
+        result += calcPointLight(pointLights[i], norm, fragPos, viewDir, texCoord, shadowed ? calcShadow(layer, fragPos, norm) : 1.0);
+    }
+    for(int i = 0; i < spotLightCount; i++)
+        result += calcSpotLight(spotLights[i], norm, fragPos, viewDir, texCoord, shadowed ? calcSpotShadow(i, fragPos, norm) : 1.0);
     return result;
 }
 
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec2 texCoord)
+// Baked objects: the sun and the point lights are one lightmap fetch. Static occluders are in the
+// bake already, the sun's shadow map only adds the dynamic ones; spotlights move and stay live.
+vec3 calcBakedColor(vec3 fragPos, vec3 normal, vec2 texCoord, vec3 viewPos, vec2 lightmapCoord)
+{
+    vec4 baked = texture(lightmap, lightmapCoord);
+    vec3 albedo = vec3(texture(texture_diffuse1, texCoord));
+    vec3 norm = normalize(normal);
+    vec3 viewDir = normalize(viewPos - fragPos);
+    float sunShadow = shadowsOn ? calcShadow(0, fragPos, norm) : 1.0;
+
+    vec3 reflectDir = reflect(normalize(dirLight.direction), norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+    // No highlight where the bake found the sun blocked
+    float sunVisible = smoothstep(0.0, 0.05, baked.g) * sunShadow;
+    vec3 result = dirLight.ambient * albedo * baked.r;
+    result += dirLight.diffuse * albedo * (baked.g * sunShadow + baked.a);
+    result += dirLight.specular * spec * material.specular * sunVisible;
+    if (!lightsOn)
+        return result;
+
+    // Both point lights have the same colour, the bake holds half their sum
+    result += pointLights[0].diffuse * albedo * baked.b * 2.0;
+    for(int i = 0; i < spotLightCount; i++)
+        result += calcSpotLight(spotLights[i], norm, fragPos, viewDir, texCoord, shadowsOn ? calcSpotShadow(i, fragPos, norm) : 1.0);
+    return result;
+}
+
+// Fraction of the light reaching fragPos according to one layer, 1 outside of its view
+float calcShadow(int layer, vec3 fragPos, vec3 normal)
+{
+    vec4 clip = shadowMatrices[layer] * vec4(fragPos + normal * shadowNormalOffset, 1.0);
+    if (clip.w <= 0.0)
+        return 1.0;
+    vec3 coords = clip.xyz / clip.w * 0.5 + 0.5;
+    if (coords.z >= 1.0 || any(lessThan(coords.xy, vec2(0.0))) || any(greaterThan(coords.xy, vec2(1.0))))
+        return 1.0;
+
+    // Four filtered taps, each already a 2x2 comparison
+    vec2 texel = 1.0 / vec2(textureSize(shadowMaps, 0).xy);
+    float lit = 0.0;
+    lit += texture(shadowMaps, vec4(coords.xy + vec2(-0.5, -0.5) * texel, float(layer), coords.z));
+    lit += texture(shadowMaps, vec4(coords.xy + vec2(0.5, -0.5) * texel, float(layer), coords.z));
+    lit += texture(shadowMaps, vec4(coords.xy + vec2(-0.5, 0.5) * texel, float(layer), coords.z));
+    lit += texture(shadowMaps, vec4(coords.xy + vec2(0.5, 0.5) * texel, float(layer), coords.z));
+    return lit * 0.25;
+}
+
+// Same for a spotlight's tile of the atlas, 1 while the light has no tile drawn
+float calcSpotShadow(int light, vec3 fragPos, vec3 normal)
+{
+    vec4 rect = spotLights[light].shadowRect;
+    if (rect.z <= 0.0)
+        return 1.0;
+    vec4 clip = spotLights[light].shadowMatrix * vec4(fragPos + normal * shadowNormalOffset, 1.0);
+    if (clip.w <= 0.0)
+        return 1.0;
+    // The matrix maps straight into the tile, and the taps must not reach into the neighbours
+    vec3 coords = clip.xyz / clip.w;
+    vec2 texel = 1.0 / vec2(textureSize(spotShadowAtlas, 0));
+    if (coords.z >= 1.0 || any(lessThan(coords.xy, rect.xy + texel)) || any(greaterThan(coords.xy, rect.zw - texel)))
+        return 1.0;
+
+    float lit = 0.0;
+    lit += texture(spotShadowAtlas, vec3(coords.xy + vec2(-0.5, -0.5) * texel, coords.z));
+    lit += texture(spotShadowAtlas, vec3(coords.xy + vec2(0.5, -0.5) * texel, coords.z));
+    lit += texture(spotShadowAtlas, vec3(coords.xy + vec2(-0.5, 0.5) * texel, coords.z));
+    lit += texture(spotShadowAtlas, vec3(coords.xy + vec2(0.5, 0.5) * texel, coords.z));
+    return lit * 0.25;
+}
+
+// Cube face, in GL order, that a direction from a point light falls into
+int cubeFace(vec3 direction)
+{
+    vec3 size = abs(direction);
+    if (size.x >= size.y && size.x >= size.z)
+        return direction.x > 0.0 ? 0 : 1;
+    if (size.y >= size.z)
+        return direction.y > 0.0 ? 2 : 3;
+    return direction.z > 0.0 ? 4 : 5;
+}
+
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec2 texCoord, float shadow)
 {
     vec3 lightDir = normalize(-light.direction);
     float diff = max(dot(normal, lightDir), 0.0);
@@ -75,10 +155,10 @@ vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec2 texCoord)
     vec3 ambient = light.ambient * vec3(texture(texture_diffuse1, texCoord));
     vec3 diffuse = light.diffuse * diff * vec3(texture(texture_diffuse1, texCoord));
     vec3 specular = light.specular * spec * material.specular;
-    return (ambient + diffuse + specular);
+    return (ambient + (diffuse + specular) * shadow);
 }
 
-vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec2 texCoord)
+vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec2 texCoord, float shadow)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     float diff = max(dot(normal, lightDir), 0.0);
@@ -92,10 +172,10 @@ vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, v
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
-    return (ambient + diffuse + specular);
+    return (ambient + (diffuse + specular) * shadow);
 }
 
-vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec2 texCoord)
+vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec2 texCoord, float shadow)
 {
     vec3 lightDir = normalize(light.position - fragPos);
     float diff = max(dot(normal, lightDir), 0.0);
@@ -112,7 +192,13 @@ vec3 calcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
-    return (ambient + diffuse + specular);
+    return (ambient + (diffuse + specular) * shadow);
+}
+
+// The diffuse texture with its alpha, for shaders that read it outside the lighting
+vec4 sampleDiffuse(vec2 texCoord)
+{
+    return texture(texture_diffuse1, texCoord);
 }
 
 const float gradient = 1.5;
@@ -124,4 +210,74 @@ vec3 addFog(vec3 color, float distanceFromCamera)
 {
 	float visibility = clamp(exp(-pow((distanceFromCamera * fogDensity), gradient)), 0.0, 1.0);
 	return mix(skyColor, color, visibility);
-}
\ No newline at end of file
+}
+
+// Froxel grid of the volumetric fog, must match VolumetricFog
+const float froxelNear = 0.5;
+const float froxelFar = 64.0;
+const float froxelSlices = 64.0;
+// Henyey-Greenstein asymmetry, above 0 the fog glows more looking towards a light
+const float fogAnisotropy = 0.3;
+
+// Light gathered and transmittance from the camera to every slice, see volumetricfog.h
+uniform sampler3D fogVolume;
+uniform vec2 fogScreenSize;
+
+// View depth at a slice boundary; slices grow exponentially with depth
+float froxelDepth(float slice)
+{
+    return froxelNear * pow(froxelFar / froxelNear, slice / froxelSlices);
+}
+
+float froxelSlice(float depth)
+{
+    return log(max(depth, froxelNear) / froxelNear) / log(froxelFar / froxelNear) * froxelSlices;
+}
+
+// Relative to scattering evenly in all directions
+float fogPhase(float cosTheta)
+{
+    float g2 = fogAnisotropy * fogAnisotropy;
+    return (1.0 - g2) / pow(1.0 + g2 - 2.0 * fogAnisotropy * cosTheta, 1.5);
+}
+
+// Light one froxel scatters towards the camera in rgb, times the density, and the density in a
+vec4 calcFroxel(vec3 position, vec3 viewDir)
+{
+    // The sky lights the fog, a little less where the sun is blocked so its shafts show
+    float sun = shadowsOn ? calcShadow(0, position, vec3(0.0)) : 1.0;
+    vec3 light = skyColor * (0.7 + 0.3 * sun);
+    if (lightsOn)
+    {
+        for(int i = 0; i < NR_POINT_LIGHTS; i++)
+        {
+            vec3 toLight = pointLights[i].position - position;
+            float distance = length(toLight);
+            float attenuation = 1.0 / (pointLights[i].constant + pointLights[i].linear * distance + pointLights[i].quadratic * (distance * distance));
+            float shadow = shadowsOn ? calcShadow(1 + 6 * i + cubeFace(-toLight), position, vec3(0.0)) : 1.0;
+            light += pointLights[i].diffuse * attenuation * fogPhase(dot(viewDir, toLight / distance)) * shadow;
+        }
+        for(int i = 0; i < spotLightCount; i++)
+        {
+            vec3 toLight = spotLights[i].position - position;
+            float distance = length(toLight);
+            float theta = dot(toLight / distance, normalize(-spotLights[i].direction));
+            if (theta <= spotLights[i].outerCutOff)
+                continue;
+            float intensity = clamp((theta - spotLights[i].outerCutOff) / (spotLights[i].cutOff - spotLights[i].outerCutOff), 0.0, 1.0);
+            float attenuation = 1.0 / (spotLights[i].constant + spotLights[i].linear * distance + spotLights[i].quadratic * (distance * distance));
+            float shadow = shadowsOn ? calcSpotShadow(i, position, vec3(0.0)) : 1.0;
+            light += spotLights[i].diffuse * attenuation * intensity * fogPhase(dot(viewDir, toLight / distance)) * shadow;
+        }
+    }
+    return vec4(light * fogDensity, fogDensity);
+}
+
+// Fog between the camera and a fragment from the integrated froxels; screenCoords are in pixels
+vec3 addVolumetricFog(vec3 color, vec2 screenCoords, float viewDepth)
+{
+    // Each slice holds the fog up to its far end
+    float slice = froxelSlice(viewDepth) - 1.0;
+    vec4 fog = texture(fogVolume, vec3(screenCoords / fogScreenSize, (slice + 0.5) / froxelSlices));
+    return color * fog.a + fog.rgb;
+}
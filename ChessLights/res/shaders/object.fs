@@ -1,29 +1,45 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+// Motion since the frame before in texture coordinates, for the temporal resolve; see DynamicResolution
+layout (location = 1) out vec2 Motion;
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+in vec4 CurrentClip;
+in vec4 PreviousClip;
+in vec2 LightmapCoords;
 
 in vec3 GouradColor;
 flat in vec3 FlatGouradColor;
 
-uniform vec3 viewPos;
 uniform int shadeMode;
+// A lightmap is loaded; objects with a lightmapRect take their static lighting from it
+uniform bool bakedLighting;
+// The froxel grid is lit, see VolumetricFog; otherwise fog is a function of distance
+uniform bool volumetricFog;
 
-vec3 calcColorWithLight(vec3 fragPos, vec3 normal, vec2 texCoord, vec3 viewPos);
+vec3 calcColorWithLight(vec3 fragPos, vec3 normal, vec2 texCoord, vec3 viewPos, bool receiveShadows);
+vec3 calcBakedColor(vec3 fragPos, vec3 normal, vec2 texCoord, vec3 viewPos, vec2 lightmapCoord);
 vec3 addFog(vec3 color, float distanceFromCamera);
+vec3 addVolumetricFog(vec3 color, vec2 screenCoords, float viewDepth);
 
 void main()
 {
     vec3 result;
-    if (shadeMode == 0)
-        result = calcColorWithLight(FragPos, Normal, TexCoords, viewPos);
+    if (shadeMode == 0 && bakedLighting && lightmapRect.x > 0.0)
+        result = calcBakedColor(FragPos, Normal, TexCoords, viewPos, LightmapCoords);
+    else if (shadeMode == 0)
+        result = calcColorWithLight(FragPos, Normal, TexCoords, viewPos, true);
     else if (shadeMode == 1)
         result = GouradColor;
     else
         result = FlatGouradColor;
-    result = addFog(result, length(FragPos - viewPos));
+    if (volumetricFog)
+        result = addVolumetricFog(result, gl_FragCoord.xy, -(view * vec4(FragPos, 1.0)).z);
+    else
+        result = addFog(result, length(FragPos - viewPos));
     FragColor = vec4(result, 1.0f);
+    Motion = (CurrentClip.xy / CurrentClip.w - PreviousClip.xy / PreviousClip.w) * 0.5;
 }
 
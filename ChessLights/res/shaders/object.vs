@@ -2,29 +2,37 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+layout (location = 7) in vec2 aLightmapCoords;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+// Without jitter, now and the frame before, for the motion vectors
+out vec4 CurrentClip;
+out vec4 PreviousClip;
+out vec2 LightmapCoords;
 
 out vec3 GouradColor;
 flat out vec3 FlatGouradColor;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+invariant gl_Position;
 
-uniform vec3 viewPos;
-
-vec3 calcColorWithLight(vec3 fragPos, vec3 normal, vec2 texCoord, vec3 viewPos);
+vec3 calcColorWithLight(vec3 fragPos, vec3 normal, vec2 texCoord, vec3 viewPos, bool receiveShadows);
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    mat3 shake = vibrationRotation();
+    FragPos = vibrate(vec3(model * vec4(aPos, 1.0)), shake);
+    Normal = shake * mat3(transpose(inverse(model))) * aNormal;
     gl_Position = projection * view * vec4(FragPos, 1.0);
+    CurrentClip = currentViewProjection * vec4(FragPos, 1.0);
+    // The shaking pivot is this frame's; it barely moves between frames
+    vec3 previousPos = vibrate(vec3(previousModel * vec4(aPos, 1.0)), vibrationRotationAt(previousTime));
+    PreviousClip = previousViewProjection * vec4(previousPos, 1.0);
     TexCoords = aTexCoords;
+    LightmapCoords = aLightmapCoords * lightmapRect.xy + lightmapRect.zw;
 
-    GouradColor = calcColorWithLight(aPos, aNormal, aTexCoords, viewPos);
+    // Lit in model space, so it cannot look up the shadow maps
+    GouradColor = calcColorWithLight(aPos, aNormal, aTexCoords, viewPos, false);
     FlatGouradColor = GouradColor;
 }
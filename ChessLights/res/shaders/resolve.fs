@@ -0,0 +1,80 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// The jittered frame, its motion vectors and depth, and the resolved frame before
+uniform sampler2D sceneColor;
+uniform sampler2D sceneMotion;
+uniform sampler2D sceneDepth;
+uniform sampler2D history;
+// Fraction of the target the scene was rendered to, see DynamicResolution
+uniform vec2 renderScale;
+// This frame's projection offset, in texture coordinates of the rendered part
+uniform vec2 jitter;
+// Clip space of this frame to the one before, for the background, which writes no motion
+uniform mat4 reprojection;
+// 0 without history
+uniform float historyWeight;
+
+vec3 toYCoCg(vec3 color)
+{
+    return vec3(0.25 * color.r + 0.5 * color.g + 0.25 * color.b,
+        0.5 * color.r - 0.5 * color.b,
+        -0.25 * color.r + 0.5 * color.g - 0.25 * color.b);
+}
+
+vec3 fromYCoCg(vec3 color)
+{
+    return vec3(color.x + color.y - color.z, color.x + color.z, color.x - color.y - color.z);
+}
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(sceneColor, 0));
+    // The scene point under this pixel was drawn shifted by the jitter
+    vec2 coords = (TexCoords + jitter) * renderScale;
+    vec3 current = texture(sceneColor, clamp(coords, 0.5 * texel, renderScale - 0.5 * texel)).rgb;
+
+    // Colour range of the rendered neighbourhood and its nearest surface
+    ivec2 center = ivec2(coords / texel);
+    ivec2 last = ivec2(renderScale / texel) - 1;
+    vec3 minimum = vec3(1e9);
+    vec3 maximum = vec3(-1e9);
+    float closestDepth = 1.0;
+    ivec2 closest = clamp(center, ivec2(0), last);
+    for (int y = -1; y <= 1; y++)
+    {
+        for (int x = -1; x <= 1; x++)
+        {
+            ivec2 neighbour = clamp(center + ivec2(x, y), ivec2(0), last);
+            vec3 color = toYCoCg(texelFetch(sceneColor, neighbour, 0).rgb);
+            minimum = min(minimum, color);
+            maximum = max(maximum, color);
+            float depth = texelFetch(sceneDepth, neighbour, 0).r;
+            if (depth < closestDepth)
+            {
+                closestDepth = depth;
+                closest = neighbour;
+            }
+        }
+    }
+
+    // Edges move with the surface in front, so they do not leave a trail behind moving objects
+    vec2 motion;
+    if (closestDepth < 1.0)
+        motion = texelFetch(sceneMotion, closest, 0).xy;
+    else
+    {
+        vec4 previous = reprojection * vec4(TexCoords * 2.0 - 1.0, 1.0, 1.0);
+        motion = TexCoords - (previous.xy / previous.w * 0.5 + 0.5);
+    }
+
+    vec2 historyCoords = TexCoords - motion;
+    float weight = historyWeight;
+    if (any(lessThan(historyCoords, vec2(0.0))) || any(greaterThan(historyCoords, vec2(1.0))))
+        weight = 0.0;
+    // History this frame's neighbourhood cannot explain was disoccluded or has changed
+    vec3 previousColor = clamp(toYCoCg(texture(history, historyCoords).rgb), minimum, maximum);
+    FragColor = vec4(fromYCoCg(mix(toYCoCg(current), previousColor, weight)), 1.0);
+}
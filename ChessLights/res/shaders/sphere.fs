@@ -1,13 +1,19 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+// Motion since the frame before in texture coordinates, for the temporal resolve; see DynamicResolution
+layout (location = 1) out vec2 Motion;
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
+in vec4 CurrentClip;
+in vec4 PreviousClip;
 
-uniform vec3 viewPos;
 uniform bool sphereOn;
+// As in object.fs
+uniform bool volumetricFog;
 vec3 addFog(vec3 color, float distanceFromCamera);
+vec3 addVolumetricFog(vec3 color, vec2 screenCoords, float viewDepth);
 
 void main()
 {
@@ -16,7 +22,11 @@ void main()
         result = vec3(1.0f, 1.0f, 1.0f);
     else
         result = vec3(0.2f, 0.2f, 0.2f);
-    result = addFog(result, length(FragPos - viewPos));
+    if (volumetricFog)
+        result = addVolumetricFog(result, gl_FragCoord.xy, -(view * vec4(FragPos, 1.0)).z);
+    else
+        result = addFog(result, length(FragPos - viewPos));
     FragColor = vec4(result, 1.0f);
+    Motion = (CurrentClip.xy / CurrentClip.w - PreviousClip.xy / PreviousClip.w) * 0.5;
 } 
 
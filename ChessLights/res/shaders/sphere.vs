@@ -6,17 +6,21 @@ layout (location = 2) in vec2 aTexCoords;
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+// Without jitter, now and the frame before, for the motion vectors
+out vec4 CurrentClip;
+out vec4 PreviousClip;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-uniform vec3 viewPos;
+invariant gl_Position;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    mat3 shake = vibrationRotation();
+    FragPos = vibrate(vec3(model * vec4(aPos, 1.0)), shake);
+    Normal = shake * mat3(transpose(inverse(model))) * aNormal;
     gl_Position = projection * view * vec4(FragPos, 1.0);
+    CurrentClip = currentViewProjection * vec4(FragPos, 1.0);
+    // The shaking pivot is this frame's; it barely moves between frames
+    vec3 previousPos = vibrate(vec3(previousModel * vec4(aPos, 1.0)), vibrationRotationAt(previousTime));
+    PreviousClip = previousViewProjection * vec4(previousPos, 1.0);
     TexCoords = aTexCoords;
 }
@@ -0,0 +1,40 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D sceneColor;
+// Fraction of the target the scene was rendered to, see DynamicResolution
+uniform vec2 renderScale;
+uniform float sharpness;
+
+vec3 sampleScene(vec2 coords, vec2 texel)
+{
+    // Bilinear taps must not reach past the rendered corner
+    return texture(sceneColor, clamp(coords, 0.5 * texel, renderScale - 0.5 * texel)).rgb;
+}
+
+void main()
+{
+    vec2 texel = 1.0 / vec2(textureSize(sceneColor, 0));
+    vec2 coords = TexCoords * renderScale;
+    vec3 center = sampleScene(coords, texel);
+    if (sharpness <= 0.0)
+    {
+        FragColor = vec4(center, 1.0);
+        return;
+    }
+
+    // Contrast adaptive sharpening: a negative lobe from the four neighbours, weaker where the
+    // neighbourhood already spans most of the range, so edges do not ring
+    vec3 north = sampleScene(coords + vec2(0.0, texel.y), texel);
+    vec3 south = sampleScene(coords - vec2(0.0, texel.y), texel);
+    vec3 east = sampleScene(coords + vec2(texel.x, 0.0), texel);
+    vec3 west = sampleScene(coords - vec2(texel.x, 0.0), texel);
+    vec3 minimum = min(center, min(min(north, south), min(east, west)));
+    vec3 maximum = max(center, max(max(north, south), max(east, west)));
+    vec3 amount = sqrt(clamp(min(minimum, 1.0 - maximum) / max(maximum, vec3(1e-4)), 0.0, 1.0));
+    vec3 lobe = -amount * mix(0.125, 0.2, sharpness);
+    vec3 result = (center + (north + south + east + west) * lobe) / (1.0 + 4.0 * lobe);
+    FragColor = vec4(clamp(result, 0.0, 1.0), 1.0);
+}
@@ -0,0 +1,56 @@
+// Procedural shaking evaluated per vertex. Must stay in sync with the CPU reference
+// in noise.h, which uses the same hash and noise.
+const float vibrationFrequency = 30.0;
+
+uint hashUint(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+float hashSigned(uint x)
+{
+    return float(hashUint(x) >> 8) * (2.0 / 16777216.0) - 1.0;
+}
+
+float vibrationNoise(uint seed, float t)
+{
+    t *= vibrationFrequency;
+    float cell = floor(t);
+    float f = t - cell;
+    f = f * f * (3.0 - 2.0 * f);
+
+    uint i = uint(int(cell));
+    float a = hashSigned(seed ^ hashUint(i));
+    float b = hashSigned(seed ^ hashUint(i + 1U));
+    return a + (b - a) * f;
+}
+
+// Tilt of the current object around the world X and Z axes at time t
+mat3 vibrationRotationAt(float t)
+{
+    if (vibration.w == 0.0)
+        return mat3(1.0);
+
+    float angleX = vibration.w * vibrationNoise(hashUint(vibrationSeed * 2U), t);
+    float angleZ = vibration.w * vibrationNoise(hashUint(vibrationSeed * 2U + 1U), t);
+    float cx = cos(angleX), sx = sin(angleX);
+    float cz = cos(angleZ), sz = sin(angleZ);
+    mat3 rotationX = mat3(1.0, 0.0, 0.0, 0.0, cx, sx, 0.0, -sx, cx);
+    mat3 rotationZ = mat3(cz, sz, 0.0, -sz, cz, 0.0, 0.0, 0.0, 1.0);
+    return rotationX * rotationZ;
+}
+
+mat3 vibrationRotation()
+{
+    return vibrationRotationAt(time);
+}
+
+vec3 vibrate(vec3 worldPos, mat3 rotation)
+{
+    return vibration.xyz + rotation * (worldPos - vibration.xyz);
+}
@@ -0,0 +1,226 @@
+#include "batch.h"
+#include "scene.h"
+#include "pngencoder.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+// Frames waiting for the encoder before rendering pauses; each holds a full RGBA image
+const int maxEncodesPerThread = 2;
+
+BatchRenderer::BatchRenderer(JobSystem& jobs, const Options& options)
+    : jobs(jobs), defaultWidth(options.width), defaultHeight(options.height),
+    objectShader("res/shaders/object.vs", "res/shaders/object.fs"),
+    sphereShader("res/shaders/sphere.vs", "res/shaders/sphere.fs"),
+    boardModel("res/board/board.obj"),
+    kingModel("res/king/king.obj"),
+    knightModel("res/knight/knight.obj"),
+    pawnModel("res/pawn/pawn.obj"),
+    rookModel("res/rook/rook.obj"),
+    sphereModel("res/sphere/sphere.obj"),
+    board(objectShader, boardModel),
+    sphere1(sphereShader, sphereModel, spherePosition1),
+    sphere2(sphereShader, sphereModel, spherePosition2),
+    pieces(objectShader, boardRoot),
+    uniformRing(GL_UNIFORM_BUFFER, uniformRingRegionSize)
+{
+    pieces.setModel(KingPiece, &kingModel);
+    pieces.setModel(KnightPiece, &knightModel);
+    pieces.setModel(PawnPiece, &pawnModel);
+    pieces.setModel(RookPiece, &rookModel);
+}
+
+static bool parseTimeOfDay(const std::string& value, float& fraction)
+{
+    static const char* names[] = { "morning", "afternoon", "evening", "night" };
+    for (int i = 0; i < 4; i++)
+    {
+        if (value == names[i])
+        {
+            // Middle of the named part of the cycle
+            fraction = (float)i * 0.25f + 0.125f;
+            return true;
+        }
+    }
+
+    char* end = nullptr;
+    fraction = std::strtof(value.c_str(), &end);
+    return end != value.c_str() && *end == '\0' && fraction >= 0.0f && fraction <= 1.0f;
+}
+
+bool BatchRenderer::parseJob(const std::string& line, BatchJob& job)
+{
+    std::istringstream fields(line);
+    std::string field;
+    while (fields >> field)
+    {
+        size_t separator = field.find('=');
+        if (separator == std::string::npos)
+            return false;
+
+        std::string key = field.substr(0, separator);
+        std::string value = field.substr(separator + 1);
+        bool valid = true;
+
+        if (key == "fen")
+            job.placement = value;
+        else if (key == "out")
+            job.output = value;
+        else if (key == "camera")
+        {
+            if (value == "static") job.camera = StaticPreset;
+            else if (value == "tracking") job.camera = TrackingPreset;
+            else if (value == "pov") job.camera = POVPreset;
+            else valid = false;
+        }
+        else if (key == "time")
+            valid = parseTimeOfDay(value, job.timeOfDay);
+        else if (key == "size")
+            valid = parseSize(value.c_str(), job.width, job.height);
+        else if (key == "lights")
+        {
+            valid = value == "on" || value == "off";
+            job.lightsOn = value == "on";
+        }
+        else
+            valid = false;
+
+        if (!valid)
+            return false;
+    }
+
+    return !job.placement.empty() && !job.output.empty();
+}
+
+int BatchRenderer::run(std::istream& input)
+{
+    int jobCount = 0;
+    int failedJobs = 0;
+    double renderSeconds = 0.0;
+    auto start = std::chrono::steady_clock::now();
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(input, line))
+    {
+        lineNumber++;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+
+        BatchJob job;
+        job.width = defaultWidth;
+        job.height = defaultHeight;
+        if (!parseJob(line, job))
+        {
+            std::cout << "Batch line " << lineNumber << ": invalid job" << std::endl;
+            failedJobs++;
+            continue;
+        }
+
+        auto renderStart = std::chrono::steady_clock::now();
+        if (!render(job))
+        {
+            std::cout << "Batch line " << lineNumber << ": invalid piece placement" << std::endl;
+            failedJobs++;
+            continue;
+        }
+        renderSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+        jobCount++;
+
+        // Keep the encoders from falling too far behind; lend them this thread meanwhile
+        int maxInFlight = maxEncodesPerThread * (int)jobs.getThreadCount();
+        while (encodesInFlight.load() > maxInFlight)
+        {
+            capture.poll();
+            if (!jobs.help())
+                std::this_thread::yield();
+        }
+    }
+
+    capture.finish();
+    jobs.wait(pendingEncodes);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Batch: " << jobCount << " frames in " << seconds << " s ("
+        << (seconds > 0.0 ? jobCount / seconds : 0.0) << " fps, "
+        << (jobCount > 0 ? renderSeconds * 1000.0 / jobCount : 0.0) << " ms render per frame, "
+        << capture.stalls << " readback stalls)" << std::endl;
+
+    return failedJobs + failedEncodes.load();
+}
+
+void BatchRenderer::setCamera(CameraPreset preset, int width, int height)
+{
+    if (preset == TrackingPreset)
+        camera.setNewPosition(trackingCameraPos, trackingCameraBasePitch, trackingCameraBaseYaw);
+    else if (preset == POVPreset)
+        camera.setNewPosition(POVCameraPos, POVCameraPitch, POVCameraYaw);
+    else
+        camera.setNewPosition(staticCameraPos, staticCameraPitch, staticCameraYaw);
+    camera.setAspectRatio((float)width / (float)height);
+}
+
+bool BatchRenderer::render(const BatchJob& job)
+{
+    BoardState position;
+    if (!position.parseFen(job.placement))
+        return false;
+
+    pieces.setPosition(position);
+    // The set only has models for kings, knights, pawns and rooks
+    if (pieces.missingSquares() != 0)
+        std::cout << "Batch: queens and bishops are skipped in " << job.output << std::endl;
+
+    if (!target || target->getWidth() != job.width || target->getHeight() != job.height)
+        target.reset(new Framebuffer(job.width, job.height));
+    target->bind();
+    setCamera(job.camera, job.width, job.height);
+
+    ConditionsController controller;
+    controller.setTimeOfDay(job.timeOfDay);
+    controller.lightsOn = job.lightsOn;
+    Conditions conditions = controller.getConditions();
+
+    LightProperty lights;
+    configureLightProperty(lights);
+    lights.updateLight(controller, 0.0f);
+
+    uniformRing.beginFrame();
+    glClearColor(conditions.backgroundColor.r, conditions.backgroundColor.g, conditions.backgroundColor.b, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    renderQueue.clear();
+    board.submit(renderQueue, camera, conditions);
+    pieces.submit(renderQueue, camera, conditions);
+    sphere1.submit(renderQueue, camera, conditions);
+    sphere2.submit(renderQueue, camera, conditions);
+
+    renderQueue.sort(camera, jobs);
+    renderQueue.upload(uniformRing, camera, 0.0f, jobs);
+    uploadSpotLights(uniformRing, renderQueue, lights, nullptr);
+    uniformRing.flush();
+    renderQueue.draw([&](const Shader& shader)
+    {
+        IluminatedObject::configureFrame(shader, lights, conditions);
+    });
+    uniformRing.endFrame();
+
+    std::string output = job.output;
+    encodesInFlight++;
+    capture.capture(*target, [this, output](std::shared_ptr<CapturedFrame> frame)
+    {
+        jobs.run([this, output, frame]()
+        {
+            if (!writePng(output, frame->pixels.data(), frame->width, frame->height, true))
+                failedEncodes++;
+            encodesInFlight--;
+        }, &pendingEncodes);
+    });
+    capture.poll();
+    return true;
+}
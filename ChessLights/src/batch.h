@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shader.h"
+#include "model.h"
+#include "camera.h"
+#include "object.h"
+#include "pieceset.h"
+#include "renderqueue.h"
+#include "ringbuffer.h"
+#include "framebuffer.h"
+#include "capture.h"
+#include "jobsystem.h"
+#include "options.h"
+
+enum CameraPreset
+{
+    StaticPreset,
+    TrackingPreset,
+    POVPreset
+};
+
+// One image to render. Jobs are read one per line as space-separated key=value fields:
+//   fen=<placement> out=<file.png> [camera=static|tracking|pov] [time=<0-1>|morning|afternoon|evening|night]
+//   [size=<w>x<h>] [lights=on|off]
+// Empty lines and lines starting with # are skipped.
+struct BatchJob
+{
+    std::string placement;
+    std::string output;
+    CameraPreset camera = StaticPreset;
+    // Fraction of the day cycle, see ConditionsController::setTimeOfDay
+    float timeOfDay = 0.25f;
+    int width = 0;
+    int height = 0;
+    bool lightsOn = false;
+};
+
+// Renders a stream of positions back-to-back with one context and one set of loaded models.
+// The GPU readback of a frame overlaps the rendering of the next ones, and PNG encoding
+// runs on the job system's workers.
+class BatchRenderer
+{
+public:
+    BatchRenderer(JobSystem& jobs, const Options& options);
+
+    // Renders every job in the stream; returns the number of jobs that failed
+    int run(std::istream& input);
+
+    static bool parseJob(const std::string& line, BatchJob& job);
+
+private:
+    JobSystem& jobs;
+    int defaultWidth;
+    int defaultHeight;
+
+    Shader objectShader;
+    Shader sphereShader;
+    Model boardModel;
+    Model kingModel;
+    Model knightModel;
+    Model pawnModel;
+    Model rookModel;
+    Model sphereModel;
+
+    Board board;
+    Sphere sphere1;
+    Sphere sphere2;
+    Transform boardRoot;
+    // Consecutive jobs usually differ by a few moves, and only those squares are rebuilt
+    PieceSet pieces;
+
+    Camera camera;
+    RenderQueue renderQueue;
+    RingBuffer uniformRing;
+    FrameCapture capture;
+    std::unique_ptr<Framebuffer> target;
+
+    JobCounter pendingEncodes;
+    std::atomic<int> encodesInFlight{ 0 };
+    std::atomic<int> failedEncodes{ 0 };
+
+    void setCamera(CameraPreset preset, int width, int height);
+    bool render(const BatchJob& job);
+};
@@ -0,0 +1,201 @@
+#include "benchmark.h"
+#include "scene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+// Hand-picked spot for the Free view: low over the far corner of the board
+const glm::vec3 freeBenchmarkCameraPos = glm::vec3(-8.0f, 2.5f, -6.0f);
+const float freeBenchmarkCameraPitch = -12.0f;
+const float freeBenchmarkCameraYaw = 37.0f;
+
+static const BenchmarkScenario scenarios[] = {
+    // name, path, { shadeMode, fog, lightsOn, depthPrePass, timeOfDay }, pieces, frames, wall boards
+    { "tour", { Static, POV, Tracking, Free, Static }, { 0, false, false, false, 0.25f }, 4, 1200, 0 },
+    { "night", { Static, Tracking, POV, Free }, { 0, false, true, false, 0.85f }, 4, 1200, 0 },
+    { "fog", { Tracking, Free, Static }, { 0, true, true, false, 0.6f }, 4, 900, 0 },
+    { "gouraud", { Static, POV, Tracking, Free, Static }, { 1, false, true, false, 0.25f }, 4, 1200, 0 },
+    { "crowd", { Static, Free, Tracking, POV }, { 0, true, true, true, 0.6f }, 32, 1200, 0 },
+    // A night hall under 48 lamps, a quarter of them swaying, for the shadow atlas scheduler
+    { "hall", { Static, Free, Tracking, Static }, { 0, false, true, false, 0.85f, true, true, true, 48 }, 32, 1200, 0 },
+    // 500 boards in their starting positions, from the overview down to the nearest few and back
+    { "wall", { Static }, { 0, false, false, false, 0.25f }, 32, 900, 500 },
+};
+
+const BenchmarkScenario* findBenchmarkScenario(const std::string& name)
+{
+    for (const BenchmarkScenario& scenario : scenarios)
+    {
+        if (name == scenario.name)
+            return &scenario;
+    }
+    return nullptr;
+}
+
+std::string listBenchmarkScenarios()
+{
+    std::string names;
+    for (const BenchmarkScenario& scenario : scenarios)
+    {
+        if (!names.empty())
+            names += ", ";
+        names += scenario.name;
+    }
+    return names;
+}
+
+struct CameraKey
+{
+    glm::vec3 position;
+    float pitch;
+    float yaw;
+};
+
+static CameraKey viewKey(CameraMode mode)
+{
+    switch (mode)
+    {
+    case POV: return { POVCameraPos, POVCameraPitch, POVCameraYaw };
+    case Tracking: return { trackingCameraPos, trackingCameraBasePitch, trackingCameraBaseYaw };
+    case Free: return { freeBenchmarkCameraPos, freeBenchmarkCameraPitch, freeBenchmarkCameraYaw };
+    default: return { staticCameraPos, staticCameraPitch, staticCameraYaw };
+    }
+}
+
+template <typename T>
+static T catmullRom(const T& p0, const T& p1, const T& p2, const T& p3, float t)
+{
+    float t2 = t * t;
+    float t3 = t2 * t;
+    return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2
+        + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+}
+
+void benchmarkCamera(const BenchmarkScenario& scenario, float progress, glm::vec3& position, float& pitch, float& yaw)
+{
+    std::vector<CameraKey> keys;
+    for (CameraMode mode : scenario.path)
+    {
+        CameraKey key = viewKey(mode);
+        // Turn the short way round: keep each yaw within half a turn of the previous one
+        if (!keys.empty())
+        {
+            float previous = keys.back().yaw;
+            key.yaw = previous + std::remainder(key.yaw - previous, 360.0f);
+        }
+        keys.push_back(key);
+    }
+
+    int last = (int)keys.size() - 1;
+    if (last <= 0)
+    {
+        CameraKey key = keys.empty() ? viewKey(Static) : keys[0];
+        position = key.position;
+        pitch = key.pitch;
+        yaw = key.yaw;
+        return;
+    }
+
+    float segment = glm::clamp(progress, 0.0f, 1.0f) * (float)last;
+    int i = std::min((int)segment, last - 1);
+    float t = segment - (float)i;
+    const CameraKey& k0 = keys[std::max(i - 1, 0)];
+    const CameraKey& k1 = keys[i];
+    const CameraKey& k2 = keys[i + 1];
+    const CameraKey& k3 = keys[std::min(i + 2, last)];
+
+    position = catmullRom(k0.position, k1.position, k2.position, k3.position, t);
+    pitch = catmullRom(k0.pitch, k1.pitch, k2.pitch, k3.pitch, t);
+    yaw = catmullRom(k0.yaw, k1.yaw, k2.yaw, k3.yaw, t);
+}
+
+// Statistics of the samples after the warmup, as a JSON object
+static void writeStatistics(std::ostream& out, std::vector<float> samples)
+{
+    if ((int)samples.size() > BenchmarkRecorder::warmupFrames)
+        samples.erase(samples.begin(), samples.begin() + BenchmarkRecorder::warmupFrames);
+    if (samples.empty())
+    {
+        out << "null";
+        return;
+    }
+
+    double sum = 0.0;
+    for (float sample : samples)
+        sum += sample;
+    std::sort(samples.begin(), samples.end());
+
+    // Nearest-rank percentile
+    auto percentile = [&samples](double p)
+    {
+        size_t rank = (size_t)std::ceil(p * (double)samples.size());
+        return samples[std::min(std::max(rank, (size_t)1), samples.size()) - 1];
+    };
+
+    out << "{ \"samples\": " << samples.size()
+        << ", \"avg\": " << sum / (double)samples.size()
+        << ", \"min\": " << samples.front()
+        << ", \"p50\": " << percentile(0.50)
+        << ", \"p95\": " << percentile(0.95)
+        << ", \"p99\": " << percentile(0.99)
+        << ", \"max\": " << samples.back() << " }";
+}
+
+static std::string escapeJson(const char* text)
+{
+    std::string escaped;
+    for (const char* c = text; c && *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            escaped += '\\';
+        if ((unsigned char)*c >= 0x20)
+            escaped += *c;
+    }
+    return escaped;
+}
+
+bool BenchmarkRecorder::writeJson(const std::string& path, const BenchmarkScenario& scenario, int width, int height) const
+{
+    std::ofstream out(path);
+    if (!out.is_open())
+    {
+        std::cout << "ERROR::BENCHMARK::CANNOT_WRITE: " << path << std::endl;
+        return false;
+    }
+
+    // The GPU timers never drop a result, so the passes line up frame by frame
+    std::vector<float> gpuMilliseconds;
+    size_t gpuFrames = std::min(gpuDepthMilliseconds.size(), gpuShadingMilliseconds.size());
+    for (size_t i = 0; i < gpuFrames; i++)
+        gpuMilliseconds.push_back(gpuDepthMilliseconds[i] + gpuShadingMilliseconds[i]);
+
+    out << "{\n"
+        << "  \"scenario\": \"" << scenario.name << "\",\n"
+        << "  \"frames\": " << frameMilliseconds.size() << ",\n"
+        << "  \"warmup_frames\": " << warmupFrames << ",\n"
+        << "  \"width\": " << width << ",\n"
+        << "  \"height\": " << height << ",\n"
+        << "  \"pieces\": " << scenario.pieceCount << ",\n"
+        << "  \"wall_boards\": " << scenario.wallBoards << ",\n"
+        << "  \"shade_mode\": " << scenario.preset.shadeMode << ",\n"
+        << "  \"fog\": " << (scenario.preset.fog ? "true" : "false") << ",\n"
+        << "  \"lights\": " << (scenario.preset.lightsOn ? "true" : "false") << ",\n"
+        << "  \"depth_pre_pass\": " << (scenario.preset.depthPrePass ? "true" : "false") << ",\n"
+        << "  \"renderer\": \"" << escapeJson((const char*)glGetString(GL_RENDERER)) << "\",\n"
+        << "  \"gl_version\": \"" << escapeJson((const char*)glGetString(GL_VERSION)) << "\",\n"
+        << "  \"cpu_ms\": ";
+    writeStatistics(out, cpuMilliseconds);
+    out << ",\n  \"gpu_ms\": ";
+    writeStatistics(out, gpuMilliseconds);
+    out << ",\n  \"frame_ms\": ";
+    writeStatistics(out, frameMilliseconds);
+    if (!renderScales.empty())
+    {
+        out << ",\n  \"render_scale\": ";
+        writeStatistics(out, renderScales);
+    }
+    out << "\n}\n";
+    return true;
+}
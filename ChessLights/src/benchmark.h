@@ -0,0 +1,55 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "simulation.h"
+
+// A reproducible run: the camera follows a spline through a list of views while the
+// conditions stay as the preset sets them
+struct BenchmarkScenario
+{
+    const char* name;
+    // Views the camera passes through, evenly spaced over the run
+    std::vector<CameraMode> path;
+    SimulationPreset preset;
+    // Pieces on the board, including the four animated ones
+    int pieceCount;
+    int frames;
+    // Boards of a tournament wall in place of the single board, 0 for none; the camera then flies
+    // over the wall instead of following the path, see TournamentWall::benchmarkCamera
+    int wallBoards;
+};
+
+const BenchmarkScenario* findBenchmarkScenario(const std::string& name);
+// Names of the built-in scenarios, separated by commas
+std::string listBenchmarkScenarios();
+
+// Camera on the scenario's spline; progress runs from 0 at the first frame to 1 at the last
+void benchmarkCamera(const BenchmarkScenario& scenario, float progress, glm::vec3& position, float& pitch, float& yaw);
+
+// Collects per-frame timings of a benchmark run and writes their statistics as JSON
+class BenchmarkRecorder
+{
+public:
+    // Frames measured before this many are skipped, while caches and drivers settle
+    static const int warmupFrames = 30;
+
+    std::vector<float> cpuMilliseconds;
+    std::vector<float> frameMilliseconds;
+    // Filled by the GPU timers of the depth pre-pass and the shading pass
+    std::vector<float> gpuDepthMilliseconds;
+    std::vector<float> gpuShadingMilliseconds;
+    // Render scale of every frame, with --frame-budget
+    std::vector<float> renderScales;
+
+    void addFrame(float cpu, float frame)
+    {
+        cpuMilliseconds.push_back(cpu);
+        frameMilliseconds.push_back(frame);
+    }
+
+    bool writeJson(const std::string& path, const BenchmarkScenario& scenario, int width, int height) const;
+};
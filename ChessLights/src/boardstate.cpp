@@ -0,0 +1,126 @@
+#include "boardstate.h"
+#include "layout.h"
+
+#include <vector>
+
+static const char pieceLetters[PieceTypeCount + 1] = "pnbrqk";
+
+bool BoardState::pieceFromLetter(char letter, PieceColor& color, PieceType& type)
+{
+    char lower = letter >= 'A' && letter <= 'Z' ? (char)(letter - 'A' + 'a') : letter;
+    for (int i = 0; i < PieceTypeCount; i++)
+    {
+        if (pieceLetters[i] == lower)
+        {
+            color = lower == letter ? BlackPieces : WhitePieces;
+            type = (PieceType)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+char BoardState::letterOf(PieceColor color, PieceType type)
+{
+    char letter = pieceLetters[type];
+    return color == WhitePieces ? (char)(letter - 'a' + 'A') : letter;
+}
+
+bool BoardState::parseFen(const std::string& fen)
+{
+    std::vector<PiecePlacement> placements;
+    if (!parsePlacement(fen, placements))
+        return false;
+
+    BoardState parsed;
+    for (const PiecePlacement& placement : placements)
+        parsed.setPiece(squareIndex(placement.file, placement.rank), placement.piece);
+    *this = parsed;
+    return true;
+}
+
+std::string BoardState::toFen() const
+{
+    std::string fen;
+    for (int rank = 7; rank >= 0; rank--)
+    {
+        int empty = 0;
+        for (int file = 0; file < 8; file++)
+        {
+            char piece = pieceAt(squareIndex(file, rank));
+            if (piece == 0)
+            {
+                empty++;
+                continue;
+            }
+            if (empty > 0)
+                fen += (char)('0' + empty);
+            empty = 0;
+            fen += piece;
+        }
+        if (empty > 0)
+            fen += (char)('0' + empty);
+        if (rank > 0)
+            fen += '/';
+    }
+    return fen;
+}
+
+char BoardState::pieceAt(int square) const
+{
+    Bitboard bit = 1ull << square;
+    for (int color = 0; color < PieceColorCount; color++)
+    {
+        for (int type = 0; type < PieceTypeCount; type++)
+        {
+            if (boards[color][type] & bit)
+                return letterOf((PieceColor)color, (PieceType)type);
+        }
+    }
+    return 0;
+}
+
+void BoardState::setPiece(int square, char piece)
+{
+    Bitboard bit = 1ull << square;
+    for (int color = 0; color < PieceColorCount; color++)
+    {
+        for (int type = 0; type < PieceTypeCount; type++)
+            boards[color][type] &= ~bit;
+    }
+
+    PieceColor color;
+    PieceType type;
+    if (pieceFromLetter(piece, color, type))
+        boards[color][type] |= bit;
+}
+
+Bitboard BoardState::occupied() const
+{
+    Bitboard squares = 0;
+    for (int color = 0; color < PieceColorCount; color++)
+    {
+        for (int type = 0; type < PieceTypeCount; type++)
+            squares |= boards[color][type];
+    }
+    return squares;
+}
+
+Bitboard BoardState::occupied(PieceColor color) const
+{
+    Bitboard squares = 0;
+    for (int type = 0; type < PieceTypeCount; type++)
+        squares |= boards[color][type];
+    return squares;
+}
+
+Bitboard BoardState::changedSquares(const BoardState& other) const
+{
+    Bitboard changed = 0;
+    for (int color = 0; color < PieceColorCount; color++)
+    {
+        for (int type = 0; type < PieceTypeCount; type++)
+            changed |= boards[color][type] ^ other.boards[color][type];
+    }
+    return changed;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// One bit per square, a1 = bit 0, h1 = bit 7, a8 = bit 56
+typedef uint64_t Bitboard;
+
+enum PieceType
+{
+    PawnPiece,
+    KnightPiece,
+    BishopPiece,
+    RookPiece,
+    QueenPiece,
+    KingPiece,
+    PieceTypeCount
+};
+
+enum PieceColor
+{
+    WhitePieces,
+    BlackPieces,
+    PieceColorCount
+};
+
+inline int squareIndex(int file, int rank)
+{
+    return rank * 8 + file;
+}
+
+// Index of the lowest set square, which is cleared; the board must not be empty
+inline int popSquare(Bitboard& squares)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, squares);
+    int square = (int)index;
+#else
+    int square = __builtin_ctzll(squares);
+#endif
+    squares &= squares - 1;
+    return square;
+}
+
+// A position as one bitboard per colour and piece type. Comparing two positions is a handful of
+// XORs, so a change costs the squares it touches rather than the whole board.
+class BoardState
+{
+public:
+    // Parses the piece placement field of a FEN string; the rest is ignored. The state is only
+    // changed when the field is valid.
+    bool parseFen(const std::string& fen);
+    // The piece placement field of the position
+    std::string toFen() const;
+
+    // FEN letter of the piece on a square, 0 when it is empty
+    char pieceAt(int square) const;
+    // Puts a FEN letter on a square, 0 empties it
+    void setPiece(int square, char piece);
+
+    Bitboard pieces(PieceColor color, PieceType type) const
+    {
+        return boards[color][type];
+    }
+
+    Bitboard occupied() const;
+    Bitboard occupied(PieceColor color) const;
+    // Squares whose piece differs between the two positions
+    Bitboard changedSquares(const BoardState& other) const;
+
+    bool operator==(const BoardState& other) const
+    {
+        return changedSquares(other) == 0;
+    }
+
+    bool operator!=(const BoardState& other) const
+    {
+        return changedSquares(other) != 0;
+    }
+
+    // Colour and type of a FEN letter; false for anything else
+    static bool pieceFromLetter(char letter, PieceColor& color, PieceType& type);
+    static char letterOf(PieceColor color, PieceType type);
+
+private:
+    Bitboard boards[PieceColorCount][PieceTypeCount] = {};
+};
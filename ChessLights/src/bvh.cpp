@@ -0,0 +1,549 @@
+#include "bvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BVH_SSE
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // Hits closer than this to the origin are the surface the ray starts from
+    const float minDistance = 1e-5f;
+    const float parallelEpsilon = 1e-12f;
+    // Below this depth nodes are split at the median, which keeps the traversal stacks bounded
+    const unsigned int maxSahDepth = 40;
+    const unsigned int maxSahLeafSize = 16;
+
+#ifdef BVH_SSE
+    struct Mask4
+    {
+        __m128 v;
+    };
+
+    struct Float4
+    {
+        __m128 v;
+
+        static Float4 splat(float x)
+        {
+            return { _mm_set1_ps(x) };
+        }
+
+        static Float4 set(float a, float b, float c, float d)
+        {
+            return { _mm_setr_ps(a, b, c, d) };
+        }
+
+        void store(float* out) const
+        {
+            _mm_storeu_ps(out, v);
+        }
+    };
+
+    inline Float4 operator+(Float4 a, Float4 b) { return { _mm_add_ps(a.v, b.v) }; }
+    inline Float4 operator-(Float4 a, Float4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+    inline Float4 operator*(Float4 a, Float4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+    inline Float4 operator/(Float4 a, Float4 b) { return { _mm_div_ps(a.v, b.v) }; }
+    inline Float4 min4(Float4 a, Float4 b) { return { _mm_min_ps(a.v, b.v) }; }
+    inline Float4 max4(Float4 a, Float4 b) { return { _mm_max_ps(a.v, b.v) }; }
+    inline Float4 abs4(Float4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+    inline Mask4 operator<(Float4 a, Float4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+    inline Mask4 operator<=(Float4 a, Float4 b) { return { _mm_cmple_ps(a.v, b.v) }; }
+    inline Mask4 operator>(Float4 a, Float4 b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+    inline Mask4 operator>=(Float4 a, Float4 b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+    inline Mask4 operator&(Mask4 a, Mask4 b) { return { _mm_and_ps(a.v, b.v) }; }
+    // a without the lanes of b
+    inline Mask4 andNot(Mask4 a, Mask4 b) { return { _mm_andnot_ps(b.v, a.v) }; }
+    inline Float4 select(Mask4 mask, Float4 a, Float4 b) { return { _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)) }; }
+    inline int bits(Mask4 mask) { return _mm_movemask_ps(mask.v); }
+#else
+    struct Mask4
+    {
+        bool v[4];
+    };
+
+    struct Float4
+    {
+        float v[4];
+
+        static Float4 splat(float x)
+        {
+            return { { x, x, x, x } };
+        }
+
+        static Float4 set(float a, float b, float c, float d)
+        {
+            return { { a, b, c, d } };
+        }
+
+        void store(float* out) const
+        {
+            for (int i = 0; i < 4; i++)
+                out[i] = v[i];
+        }
+    };
+
+#define BVH_LANEWISE(op, type) \
+    inline type operator op(Float4 a, Float4 b) \
+    { \
+        return { { a.v[0] op b.v[0], a.v[1] op b.v[1], a.v[2] op b.v[2], a.v[3] op b.v[3] } }; \
+    }
+    BVH_LANEWISE(+, Float4)
+    BVH_LANEWISE(-, Float4)
+    BVH_LANEWISE(*, Float4)
+    BVH_LANEWISE(/, Float4)
+    BVH_LANEWISE(<, Mask4)
+    BVH_LANEWISE(<=, Mask4)
+    BVH_LANEWISE(>, Mask4)
+    BVH_LANEWISE(>=, Mask4)
+#undef BVH_LANEWISE
+
+    inline Float4 min4(Float4 a, Float4 b)
+    {
+        return { { std::min(a.v[0], b.v[0]), std::min(a.v[1], b.v[1]), std::min(a.v[2], b.v[2]), std::min(a.v[3], b.v[3]) } };
+    }
+
+    inline Float4 max4(Float4 a, Float4 b)
+    {
+        return { { std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3]) } };
+    }
+
+    inline Float4 abs4(Float4 a)
+    {
+        return { { std::abs(a.v[0]), std::abs(a.v[1]), std::abs(a.v[2]), std::abs(a.v[3]) } };
+    }
+
+    inline Mask4 operator&(Mask4 a, Mask4 b)
+    {
+        return { { a.v[0] && b.v[0], a.v[1] && b.v[1], a.v[2] && b.v[2], a.v[3] && b.v[3] } };
+    }
+
+    inline Mask4 andNot(Mask4 a, Mask4 b)
+    {
+        return { { a.v[0] && !b.v[0], a.v[1] && !b.v[1], a.v[2] && !b.v[2], a.v[3] && !b.v[3] } };
+    }
+
+    inline Float4 select(Mask4 mask, Float4 a, Float4 b)
+    {
+        return { { mask.v[0] ? a.v[0] : b.v[0], mask.v[1] ? a.v[1] : b.v[1], mask.v[2] ? a.v[2] : b.v[2], mask.v[3] ? a.v[3] : b.v[3] } };
+    }
+
+    inline int bits(Mask4 mask)
+    {
+        return (mask.v[0] ? 1 : 0) | (mask.v[1] ? 2 : 0) | (mask.v[2] ? 4 : 0) | (mask.v[3] ? 8 : 0);
+    }
+#endif
+
+    struct Vec3x4
+    {
+        Float4 x, y, z;
+
+        static Vec3x4 splat(const glm::vec3& v)
+        {
+            return { Float4::splat(v.x), Float4::splat(v.y), Float4::splat(v.z) };
+        }
+    };
+
+    inline Vec3x4 operator-(const Vec3x4& a, const Vec3x4& b)
+    {
+        return { a.x - b.x, a.y - b.y, a.z - b.z };
+    }
+
+    inline Float4 dot(const Vec3x4& a, const Vec3x4& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    inline Vec3x4 cross(const Vec3x4& a, const Vec3x4& b)
+    {
+        return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+    }
+
+    // Keeps 1 / direction finite, so axis-parallel rays still get usable slabs
+    inline float safeInverse(float x)
+    {
+        if (std::abs(x) < 1e-9f)
+            x = x < 0.0f ? -1e-9f : 1e-9f;
+        return 1.0f / x;
+    }
+
+    float surfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        glm::vec3 size = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
+    struct Bin
+    {
+        glm::vec3 boundsMin = glm::vec3(1e30f);
+        glm::vec3 boundsMax = glm::vec3(-1e30f);
+        uint32_t count = 0;
+
+        void grow(const BvhTriangle& triangle)
+        {
+            boundsMin = glm::min(boundsMin, glm::min(triangle.v0, glm::min(triangle.v1, triangle.v2)));
+            boundsMax = glm::max(boundsMax, glm::max(triangle.v0, glm::max(triangle.v1, triangle.v2)));
+            count++;
+        }
+
+        void grow(const Bin& other)
+        {
+            boundsMin = glm::min(boundsMin, other.boundsMin);
+            boundsMax = glm::max(boundsMax, other.boundsMax);
+            count += other.count;
+        }
+    };
+
+    struct BuildTask
+    {
+        uint32_t node;
+        uint32_t first;
+        uint32_t count;
+        unsigned int depth;
+    };
+}
+
+void Bvh::build(const std::vector<BvhTriangle>& source)
+{
+    nodes.clear();
+    triangles.clear();
+    ids.clear();
+    if (source.empty())
+        return;
+
+    std::vector<uint32_t> order(source.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::vector<glm::vec3> centroids(source.size());
+    for (size_t i = 0; i < source.size(); i++)
+        centroids[i] = (source[i].v0 + source[i].v1 + source[i].v2) / 3.0f;
+
+    nodes.reserve(source.size() * 2);
+    nodes.push_back(Node());
+
+    std::vector<BuildTask> tasks;
+    tasks.push_back({ 0, 0, (uint32_t)source.size(), 0 });
+    while (!tasks.empty())
+    {
+        BuildTask task = tasks.back();
+        tasks.pop_back();
+
+        Bin bounds;
+        Bin centroidBounds;
+        for (uint32_t i = task.first; i < task.first + task.count; i++)
+        {
+            bounds.grow(source[order[i]]);
+            centroidBounds.boundsMin = glm::min(centroidBounds.boundsMin, centroids[order[i]]);
+            centroidBounds.boundsMax = glm::max(centroidBounds.boundsMax, centroids[order[i]]);
+        }
+        nodes[task.node].boundsMin = bounds.boundsMin;
+        nodes[task.node].boundsMax = bounds.boundsMax;
+        nodes[task.node].leftFirst = task.first;
+        nodes[task.node].count = (uint16_t)task.count;
+        nodes[task.node].axis = 0;
+        if (task.count <= maxLeafSize)
+            continue;
+
+        glm::vec3 extent = centroidBounds.boundsMax - centroidBounds.boundsMin;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        uint32_t leftCount = 0;
+
+        if (extent[axis] > 0.0f && task.depth < maxSahDepth)
+        {
+            // Binned SAH: the cheapest of the bin boundaries on every axis
+            float bestCost = 1e30f;
+            int bestAxis = -1;
+            unsigned int bestSplit = 0;
+            for (int a = 0; a < 3; a++)
+            {
+                if (extent[a] <= 0.0f)
+                    continue;
+                Bin bins[binCount];
+                float scale = binCount / extent[a];
+                for (uint32_t i = task.first; i < task.first + task.count; i++)
+                {
+                    unsigned int bin = std::min(binCount - 1, (unsigned int)((centroids[order[i]][a] - centroidBounds.boundsMin[a]) * scale));
+                    bins[bin].grow(source[order[i]]);
+                }
+
+                float rightCosts[binCount];
+                Bin right;
+                for (unsigned int b = binCount - 1; b > 0; b--)
+                {
+                    right.grow(bins[b]);
+                    rightCosts[b] = right.count > 0 ? right.count * surfaceArea(right.boundsMin, right.boundsMax) : 0.0f;
+                }
+                Bin left;
+                for (unsigned int b = 0; b + 1 < binCount; b++)
+                {
+                    left.grow(bins[b]);
+                    if (left.count == 0 || left.count == task.count)
+                        continue;
+                    float cost = left.count * surfaceArea(left.boundsMin, left.boundsMax) + rightCosts[b + 1];
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = a;
+                        bestSplit = b + 1;
+                    }
+                }
+            }
+
+            float leafCost = task.count * surfaceArea(bounds.boundsMin, bounds.boundsMax);
+            if (bestAxis < 0 || (bestCost >= leafCost && task.count <= maxSahLeafSize))
+            {
+                if (task.count <= maxSahLeafSize)
+                    continue;
+            }
+            else
+            {
+                axis = bestAxis;
+                float scale = binCount / extent[axis];
+                auto middle = std::partition(order.begin() + task.first, order.begin() + task.first + task.count,
+                    [&](uint32_t triangle)
+                    {
+                        unsigned int bin = std::min(binCount - 1, (unsigned int)((centroids[triangle][axis] - centroidBounds.boundsMin[axis]) * scale));
+                        return bin < bestSplit;
+                    });
+                leftCount = (uint32_t)(middle - (order.begin() + task.first));
+            }
+        }
+
+        if (leftCount == 0 || leftCount == task.count)
+        {
+            // Deep or degenerate: halve at the median along the widest axis
+            leftCount = task.count / 2;
+            std::nth_element(order.begin() + task.first, order.begin() + task.first + leftCount,
+                order.begin() + task.first + task.count,
+                [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+        }
+
+        uint32_t left = (uint32_t)nodes.size();
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        nodes[task.node].leftFirst = left;
+        nodes[task.node].count = 0;
+        nodes[task.node].axis = (uint16_t)axis;
+        tasks.push_back({ left + 1, task.first + leftCount, task.count - leftCount, task.depth + 1 });
+        tasks.push_back({ left, task.first, leftCount, task.depth + 1 });
+    }
+
+    triangles.resize(source.size());
+    ids.resize(source.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const BvhTriangle& triangle = source[order[i]];
+        triangles[i] = { triangle.v0, triangle.v1 - triangle.v0, triangle.v2 - triangle.v0 };
+        ids[i] = triangle.id;
+    }
+}
+
+glm::vec3 Bvh::getNormal(uint32_t triangle) const
+{
+    glm::vec3 normal = glm::cross(triangles[triangle].edge1, triangles[triangle].edge2);
+    float length = glm::length(normal);
+    return length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+bool Bvh::intersect(const Ray& ray, RayHit& hit) const
+{
+    return trace(ray, hit, false);
+}
+
+bool Bvh::occluded(const Ray& ray) const
+{
+    RayHit hit;
+    return trace(ray, hit, true);
+}
+
+void Bvh::intersect4(const Ray rays[4], RayHit hits[4]) const
+{
+    trace4(rays, hits, false);
+}
+
+void Bvh::occluded4(const Ray rays[4], bool occluded[4]) const
+{
+    RayHit hits[4];
+    trace4(rays, hits, true);
+    for (int i = 0; i < 4; i++)
+        occluded[i] = hits[i].isHit();
+}
+
+bool Bvh::trace(const Ray& ray, RayHit& hit, bool anyHit) const
+{
+    hit = RayHit();
+    if (nodes.empty() || ray.tMax <= 0.0f)
+        return false;
+
+    hit.t = ray.tMax;
+    glm::vec3 inverse(safeInverse(ray.direction.x), safeInverse(ray.direction.y), safeInverse(ray.direction.z));
+
+    uint32_t stack[stackSize];
+    unsigned int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Node& node = nodes[stack[--top]];
+
+        glm::vec3 t1 = (node.boundsMin - ray.origin) * inverse;
+        glm::vec3 t2 = (node.boundsMax - ray.origin) * inverse;
+        glm::vec3 tNear = glm::min(t1, t2);
+        glm::vec3 tFar = glm::max(t1, t2);
+        float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+        if (enter > exit || enter >= hit.t)
+            continue;
+
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; i++)
+            {
+                const Triangle& triangle = triangles[i];
+                glm::vec3 p = glm::cross(ray.direction, triangle.edge2);
+                float determinant = glm::dot(triangle.edge1, p);
+                if (std::abs(determinant) < parallelEpsilon)
+                    continue;
+                float inverseDeterminant = 1.0f / determinant;
+                glm::vec3 s = ray.origin - triangle.v0;
+                float u = glm::dot(s, p) * inverseDeterminant;
+                if (u < 0.0f || u > 1.0f)
+                    continue;
+                glm::vec3 q = glm::cross(s, triangle.edge1);
+                float v = glm::dot(ray.direction, q) * inverseDeterminant;
+                if (v < 0.0f || u + v > 1.0f)
+                    continue;
+                float t = glm::dot(triangle.edge2, q) * inverseDeterminant;
+                if (t <= minDistance || t >= hit.t)
+                    continue;
+
+                hit.t = t;
+                hit.triangle = i;
+                hit.u = u;
+                hit.v = v;
+                if (anyHit)
+                    return true;
+            }
+        }
+        else
+        {
+            // The child on the side the ray comes from goes on top
+            bool flip = ray.direction[node.axis] < 0.0f;
+            stack[top++] = node.leftFirst + (flip ? 0 : 1);
+            stack[top++] = node.leftFirst + (flip ? 1 : 0);
+        }
+    }
+    return hit.isHit();
+}
+
+void Bvh::trace4(const Ray rays[4], RayHit hits[4], bool anyHit) const
+{
+    for (int i = 0; i < 4; i++)
+        hits[i] = RayHit();
+    if (nodes.empty())
+        return;
+
+    Vec3x4 origin = {
+        Float4::set(rays[0].origin.x, rays[1].origin.x, rays[2].origin.x, rays[3].origin.x),
+        Float4::set(rays[0].origin.y, rays[1].origin.y, rays[2].origin.y, rays[3].origin.y),
+        Float4::set(rays[0].origin.z, rays[1].origin.z, rays[2].origin.z, rays[3].origin.z) };
+    Vec3x4 direction = {
+        Float4::set(rays[0].direction.x, rays[1].direction.x, rays[2].direction.x, rays[3].direction.x),
+        Float4::set(rays[0].direction.y, rays[1].direction.y, rays[2].direction.y, rays[3].direction.y),
+        Float4::set(rays[0].direction.z, rays[1].direction.z, rays[2].direction.z, rays[3].direction.z) };
+    Vec3x4 inverse = {
+        Float4::set(safeInverse(rays[0].direction.x), safeInverse(rays[1].direction.x), safeInverse(rays[2].direction.x), safeInverse(rays[3].direction.x)),
+        Float4::set(safeInverse(rays[0].direction.y), safeInverse(rays[1].direction.y), safeInverse(rays[2].direction.y), safeInverse(rays[3].direction.y)),
+        Float4::set(safeInverse(rays[0].direction.z), safeInverse(rays[1].direction.z), safeInverse(rays[2].direction.z), safeInverse(rays[3].direction.z)) };
+    Float4 best = Float4::set(rays[0].tMax, rays[1].tMax, rays[2].tMax, rays[3].tMax);
+    Float4 bestU = Float4::splat(0.0f);
+    Float4 bestV = Float4::splat(0.0f);
+    Float4 zero = Float4::splat(0.0f);
+    Float4 one = Float4::splat(1.0f);
+    Float4 nearest = Float4::splat(minDistance);
+    Float4 epsilon = Float4::splat(parallelEpsilon);
+    Mask4 active = best > zero;
+    uint32_t triangleIndex[4] = { RayHit::noTriangle, RayHit::noTriangle, RayHit::noTriangle, RayHit::noTriangle };
+
+    uint32_t stack[stackSize];
+    unsigned int top = 0;
+    stack[top++] = 0;
+    while (top > 0 && bits(active) != 0)
+    {
+        const Node& node = nodes[stack[--top]];
+
+        Float4 t1x = (Float4::splat(node.boundsMin.x) - origin.x) * inverse.x;
+        Float4 t2x = (Float4::splat(node.boundsMax.x) - origin.x) * inverse.x;
+        Float4 t1y = (Float4::splat(node.boundsMin.y) - origin.y) * inverse.y;
+        Float4 t2y = (Float4::splat(node.boundsMax.y) - origin.y) * inverse.y;
+        Float4 t1z = (Float4::splat(node.boundsMin.z) - origin.z) * inverse.z;
+        Float4 t2z = (Float4::splat(node.boundsMax.z) - origin.z) * inverse.z;
+        Float4 enter = max4(max4(min4(t1x, t2x), min4(t1y, t2y)), max4(min4(t1z, t2z), zero));
+        Float4 exit = min4(min4(max4(t1x, t2x), max4(t1y, t2y)), max4(t1z, t2z));
+        Mask4 entered = active & (enter <= exit) & (enter < best);
+        int enteredLanes = bits(entered);
+        if (enteredLanes == 0)
+            continue;
+
+        if (node.count > 0)
+        {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; i++)
+            {
+                const Triangle& triangle = triangles[i];
+                Vec3x4 edge1 = Vec3x4::splat(triangle.edge1);
+                Vec3x4 edge2 = Vec3x4::splat(triangle.edge2);
+                Vec3x4 p = cross(direction, edge2);
+                Float4 determinant = dot(edge1, p);
+                Float4 inverseDeterminant = one / determinant;
+                Vec3x4 s = origin - Vec3x4::splat(triangle.v0);
+                Float4 u = dot(s, p) * inverseDeterminant;
+                Vec3x4 q = cross(s, edge1);
+                Float4 v = dot(direction, q) * inverseDeterminant;
+                Float4 t = dot(edge2, q) * inverseDeterminant;
+
+                Mask4 hit = active & (abs4(determinant) > epsilon) & (u >= zero) & (v >= zero) & (u + v <= one)
+                    & (t > nearest) & (t < best);
+                int hitLanes = bits(hit);
+                if (hitLanes == 0)
+                    continue;
+
+                best = select(hit, t, best);
+                bestU = select(hit, u, bestU);
+                bestV = select(hit, v, bestV);
+                for (int lane = 0; lane < 4; lane++)
+                {
+                    if (hitLanes & (1 << lane))
+                        triangleIndex[lane] = i;
+                }
+                // A shadow ray is done at its first hit
+                if (anyHit)
+                    active = andNot(active, hit);
+            }
+        }
+        else
+        {
+            int lane = 0;
+            while (!(enteredLanes & (1 << lane)))
+                lane++;
+            bool flip = rays[lane].direction[node.axis] < 0.0f;
+            stack[top++] = node.leftFirst + (flip ? 0 : 1);
+            stack[top++] = node.leftFirst + (flip ? 1 : 0);
+        }
+    }
+
+    float t[4], u[4], v[4];
+    best.store(t);
+    bestU.store(u);
+    bestV.store(v);
+    for (int i = 0; i < 4; i++)
+    {
+        if (triangleIndex[i] == RayHit::noTriangle)
+            continue;
+        hits[i].t = t[i];
+        hits[i].triangle = triangleIndex[i];
+        hits[i].u = u[i];
+        hits[i].v = v[i];
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct BvhTriangle
+{
+    glm::vec3 v0;
+    glm::vec3 v1;
+    glm::vec3 v2;
+    // Whatever the caller needs to find its way back, e.g. the object the triangle belongs to
+    uint32_t id = 0;
+};
+
+struct Ray
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+    // Hits further than this are ignored; lanes of a packet with tMax <= 0 are inactive
+    float tMax = 1e30f;
+};
+
+struct RayHit
+{
+    static const uint32_t noTriangle = 0xffffffffu;
+
+    float t = 1e30f;
+    // Index into the BVH's triangle order, noTriangle on a miss
+    uint32_t triangle = noTriangle;
+    // Barycentric coordinates of the hit on v1 and v2
+    float u = 0.0f;
+    float v = 0.0f;
+
+    bool isHit() const
+    {
+        return triangle != noTriangle;
+    }
+};
+
+// Bounding volume hierarchy over static triangles, built with a binned surface area heuristic.
+// Besides single rays it traces packets of four at once: every node and triangle test runs
+// on all four lanes with SSE (plain loops on targets without it), which pays off for rays
+// starting at the same point, like the hemisphere samples of a lightmap texel.
+class Bvh
+{
+public:
+    void build(const std::vector<BvhTriangle>& triangles);
+
+    // Closest hit along the ray
+    bool intersect(const Ray& ray, RayHit& hit) const;
+    // Any hit before tMax, for shadow rays
+    bool occluded(const Ray& ray) const;
+
+    void intersect4(const Ray rays[4], RayHit hits[4]) const;
+    void occluded4(const Ray rays[4], bool occluded[4]) const;
+
+    // Geometric normal of a triangle, by the winding of its vertices
+    glm::vec3 getNormal(uint32_t triangle) const;
+    uint32_t getId(uint32_t triangle) const
+    {
+        return ids[triangle];
+    }
+
+    size_t getTriangleCount() const
+    {
+        return triangles.size();
+    }
+
+    bool isEmpty() const
+    {
+        return nodes.empty();
+    }
+
+private:
+    struct Node
+    {
+        glm::vec3 boundsMin;
+        // First child of an inner node, the second follows it; first triangle of a leaf
+        uint32_t leftFirst;
+        glm::vec3 boundsMax;
+        // Triangles of a leaf, 0 for inner nodes
+        uint16_t count;
+        // Split axis of an inner node, to visit the nearer child first
+        uint16_t axis;
+    };
+
+    // Layout of the intersection test: one vertex and the two edges leaving it
+    struct Triangle
+    {
+        glm::vec3 v0;
+        glm::vec3 edge1;
+        glm::vec3 edge2;
+    };
+
+    static const unsigned int maxLeafSize = 4;
+    static const unsigned int binCount = 16;
+    static const unsigned int stackSize = 64;
+
+    std::vector<Node> nodes;
+    std::vector<Triangle> triangles;
+    std::vector<uint32_t> ids;
+
+    bool trace(const Ray& ray, RayHit& hit, bool anyHit) const;
+    void trace4(const Ray rays[4], RayHit hits[4], bool anyHit) const;
+};
@@ -22,8 +22,11 @@ const float PITCH = 0.0f;
 const float SPEED = 2.5f;
 const float SENSITIVITY = 0.1f;
 const float ZOOM = 45.0f;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
 
 // Class to process camera movement
+// View and projection matrices are cached; every method that changes the camera marks them dirty.
 class Camera
 {
 public:
@@ -40,6 +43,7 @@ public:
     float MovementSpeed;
     float MouseSensitivity;
     float Zoom;
+    float AspectRatio = (float)SCR_WIDTH / (float)SCR_HEIGHT;
 
     bool mouseFixed = true;
     bool positionFixed = true;
@@ -53,14 +57,36 @@ public:
         updateCameraVectors();
     }
 
-    glm::mat4 getViewMatrix() const
+    const glm::mat4& getViewMatrix() const
     {
-        return glm::lookAt(Position, Position + Front, Up);
+        if (viewDirty)
+        {
+            viewMatrix = glm::lookAt(Position, Position + Front, Up);
+            viewDirty = false;
+        }
+        return viewMatrix;
     }
 
-    glm::mat4 getProjectionMatrix() const
+    // Offset by the jitter of temporal upscaling, see setJitter
+    const glm::mat4& getProjectionMatrix() const
     {
-        return glm::perspective(glm::radians(Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        if (projectionDirty)
+        {
+            unjitteredProjectionMatrix = glm::perspective(glm::radians(Zoom), AspectRatio, NEAR_PLANE, FAR_PLANE);
+            // Clip w is -z in view space, so subtracting jitter * z shifts clip x and y by jitter * w:
+            // every depth moves by the same +jitter in normalized device coordinates
+            projectionMatrix = unjitteredProjectionMatrix;
+            projectionMatrix[2][0] -= jitter.x;
+            projectionMatrix[2][1] -= jitter.y;
+            projectionDirty = false;
+        }
+        return projectionMatrix;
+    }
+
+    const glm::mat4& getUnjitteredProjectionMatrix() const
+    {
+        getProjectionMatrix();
+        return unjitteredProjectionMatrix;
     }
 
     void processKeyboard(Camera_Movement direction, float deltaTime)
@@ -76,6 +102,7 @@ public:
             Position -= Right * velocity;
         if (direction == RIGHT)
             Position += Right * velocity;
+        viewDirty = true;
     }
 
     void processMouseMovement(float xoffset, float yoffset, GLboolean constrainPitch = true)
@@ -106,10 +133,37 @@ public:
             Zoom = 1.0f;
         if (Zoom > 45.0f)
             Zoom = 45.0f;
+        projectionDirty = true;
+    }
+
+    void setZoom(float zoom)
+    {
+        if (zoom == Zoom) return;
+        Zoom = zoom;
+        projectionDirty = true;
+    }
+
+    // Sub-pixel offset of the projection in normalized device coordinates, zero for none
+    void setJitter(const glm::vec2& offset)
+    {
+        if (offset == jitter) return;
+        jitter = offset;
+        projectionDirty = true;
+    }
+
+    void setAspectRatio(float aspectRatio)
+    {
+        if (aspectRatio == AspectRatio) return;
+        AspectRatio = aspectRatio;
+        projectionDirty = true;
     }
 
     void setNewPosition(glm::vec3 position, float pitch, float yaw)
     {
+        // Tracking cameras set their position every frame, mostly to the same value
+        if (position == Position && pitch == Pitch && yaw == Yaw)
+            return;
+
         Position = position;
         Pitch = pitch;
         Yaw = yaw;
@@ -117,6 +171,13 @@ public:
     }
 
 private:
+    mutable glm::mat4 viewMatrix;
+    mutable glm::mat4 projectionMatrix;
+    mutable glm::mat4 unjitteredProjectionMatrix;
+    glm::vec2 jitter = glm::vec2(0.0f);
+    mutable bool viewDirty = true;
+    mutable bool projectionDirty = true;
+
     void updateCameraVectors()
     {
         glm::vec3 front;
@@ -126,5 +187,6 @@ private:
         Front = glm::normalize(front);
         Right = glm::normalize(glm::cross(Front, WorldUp));
         Up = glm::normalize(glm::cross(Right, Front));
+        viewDirty = true;
     }
 };
\ No newline at end of file
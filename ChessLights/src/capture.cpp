@@ -0,0 +1,131 @@
+#include "capture.h"
+
+#include <cstring>
+#include <iostream>
+
+FrameCapture::FrameCapture(unsigned int slotCount) : slots(slotCount > 0 ? slotCount : 1)
+{
+    for (Slot& slot : slots)
+        glGenBuffers(1, &slot.buffer);
+}
+
+FrameCapture::~FrameCapture()
+{
+    for (Slot& slot : slots)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        glDeleteBuffers(1, &slot.buffer);
+    }
+}
+
+void FrameCapture::capture(const Framebuffer& source, FrameHandler handler, MappedFrameHandler mappedHandler)
+{
+    capture(source.ID, GL_COLOR_ATTACHMENT0, source.getWidth(), source.getHeight(),
+        std::move(handler), std::move(mappedHandler));
+}
+
+void FrameCapture::captureWindow(int width, int height, FrameHandler handler, MappedFrameHandler mappedHandler)
+{
+    capture(0, GL_BACK, width, height, std::move(handler), std::move(mappedHandler));
+}
+
+void FrameCapture::capture(GLuint framebuffer, GLenum readBuffer, int width, int height,
+    FrameHandler handler, MappedFrameHandler mappedHandler)
+{
+    // Every slot busy: the oldest copy has to be finished before its buffer can be reused
+    if (inFlight == slots.size())
+    {
+        stalls++;
+        complete(slots[oldest], true);
+    }
+
+    Slot& slot = slots[next];
+    slot.width = width;
+    slot.height = height;
+    slot.index = captureCount++;
+    slot.handler = std::move(handler);
+    slot.mappedHandler = std::move(mappedHandler);
+
+    GLsizeiptr size = (GLsizeiptr)slot.width * slot.height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    if (size > slot.capacity)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        slot.capacity = size;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadBuffer(readBuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, slot.width, slot.height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    next = (next + 1) % slots.size();
+    inFlight++;
+}
+
+void FrameCapture::poll()
+{
+    while (inFlight > 0 && complete(slots[oldest], false))
+        ;
+}
+
+void FrameCapture::finish()
+{
+    while (inFlight > 0)
+        complete(slots[oldest], true);
+}
+
+bool FrameCapture::complete(Slot& slot, bool wait)
+{
+    GLenum result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (result == GL_TIMEOUT_EXPIRED)
+    {
+        if (!wait)
+            return false;
+        do
+        {
+            result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        } while (result == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    FrameHandler handler = std::move(slot.handler);
+    MappedFrameHandler mappedHandler = std::move(slot.mappedHandler);
+    slot.handler = nullptr;
+    slot.mappedHandler = nullptr;
+
+    std::shared_ptr<CapturedFrame> frame;
+    size_t size = (size_t)slot.width * slot.height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (mapped)
+    {
+        if (mappedHandler)
+            mappedHandler((const uint8_t*)mapped, slot.width, slot.height, slot.index);
+        if (handler)
+        {
+            frame = std::make_shared<CapturedFrame>();
+            frame->width = slot.width;
+            frame->height = slot.height;
+            frame->index = slot.index;
+            frame->pixels.assign((const uint8_t*)mapped, (const uint8_t*)mapped + size);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    else
+    {
+        std::cout << "ERROR::FRAME_CAPTURE::MAP_FAILED" << std::endl;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    oldest = (oldest + 1) % slots.size();
+    inFlight--;
+
+    if (frame)
+        handler(frame);
+    return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "framebuffer.h"
+
+// Pixels of one captured frame: RGBA, rows bottom-up as OpenGL returns them
+struct CapturedFrame
+{
+    std::vector<uint8_t> pixels;
+    int width = 0;
+    int height = 0;
+    // Running number of the capture
+    uint64_t index = 0;
+};
+
+// Asynchronous framebuffer readback through a ring of pixel buffer objects.
+// capture() only queues the copy on the GPU; the pixels are mapped a few frames later,
+// once the fence behind the copy has signaled, so rendering never waits for the readback.
+class FrameCapture
+{
+public:
+    // Runs on the GL thread; heavy work (encoding, writing) belongs in a job
+    typedef std::function<void(std::shared_ptr<CapturedFrame>)> FrameHandler;
+    // Gets the pixels while the buffer is still mapped, for consumers that copy them straight
+    // into memory of their own; the pointer is only valid during the call
+    typedef std::function<void(const uint8_t* pixels, int width, int height, uint64_t index)> MappedFrameHandler;
+
+    explicit FrameCapture(unsigned int slotCount = defaultSlotCount);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Queues a read of the color attachment; the handlers get the pixels once they arrived.
+    // Either handler may be empty, the frame is only copied out for a FrameHandler.
+    void capture(const Framebuffer& source, FrameHandler handler, MappedFrameHandler mappedHandler = nullptr);
+    // Same for the back buffer of the window, before it is swapped
+    void captureWindow(int width, int height, FrameHandler handler, MappedFrameHandler mappedHandler = nullptr);
+    // Hands over every frame whose copy has finished, never waits
+    void poll();
+    // Waits for and hands over every frame still in flight
+    void finish();
+
+    // Captures that had to wait for the GPU because every slot was busy
+    unsigned int stalls = 0;
+
+private:
+    static const unsigned int defaultSlotCount = 3;
+
+    struct Slot
+    {
+        GLuint buffer = 0;
+        GLsizeiptr capacity = 0;
+        GLsync fence = nullptr;
+        int width = 0;
+        int height = 0;
+        uint64_t index = 0;
+        FrameHandler handler;
+        MappedFrameHandler mappedHandler;
+    };
+
+    std::vector<Slot> slots;
+    // Oldest slot in flight and the next one to fill
+    unsigned int oldest = 0;
+    unsigned int next = 0;
+    unsigned int inFlight = 0;
+    uint64_t captureCount = 0;
+
+    void capture(GLuint framebuffer, GLenum readBuffer, int width, int height,
+        FrameHandler handler, MappedFrameHandler mappedHandler);
+    bool complete(Slot& slot, bool wait);
+};
@@ -0,0 +1,285 @@
+#include "chessposition.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+static const int rookDirections[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+static const int bishopDirections[4][2] = { { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+
+struct AttackTables
+{
+    Bitboard knight[64];
+    Bitboard king[64];
+    // Squares a pawn of each colour on a square attacks
+    Bitboard pawn[PieceColorCount][64];
+
+    AttackTables()
+    {
+        static const int knightSteps[8][2] = { { 1, 2 }, { 2, 1 }, { 2, -1 }, { 1, -2 }, { -1, -2 }, { -2, -1 }, { -2, 1 }, { -1, 2 } };
+        static const int kingSteps[8][2] = { { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 } };
+        for (int square = 0; square < 64; square++)
+        {
+            int file = square % 8;
+            int rank = square / 8;
+            knight[square] = 0;
+            king[square] = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                knight[square] |= squareBit(file + knightSteps[i][0], rank + knightSteps[i][1]);
+                king[square] |= squareBit(file + kingSteps[i][0], rank + kingSteps[i][1]);
+            }
+            pawn[WhitePieces][square] = squareBit(file - 1, rank + 1) | squareBit(file + 1, rank + 1);
+            pawn[BlackPieces][square] = squareBit(file - 1, rank - 1) | squareBit(file + 1, rank - 1);
+        }
+    }
+
+    // 0 off the board
+    static Bitboard squareBit(int file, int rank)
+    {
+        if (file < 0 || file > 7 || rank < 0 || rank > 7)
+            return 0;
+        return 1ull << squareIndex(file, rank);
+    }
+};
+
+static const AttackTables& attackTables()
+{
+    static const AttackTables tables;
+    return tables;
+}
+
+// Squares a slider on a square reaches, up to and including the first occupied one in each direction
+static Bitboard slidingAttacks(int square, Bitboard occupied, const int directions[4][2])
+{
+    Bitboard attacks = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        int file = square % 8 + directions[i][0];
+        int rank = square / 8 + directions[i][1];
+        while (file >= 0 && file < 8 && rank >= 0 && rank < 8)
+        {
+            Bitboard bit = 1ull << squareIndex(file, rank);
+            attacks |= bit;
+            if (occupied & bit)
+                break;
+            file += directions[i][0];
+            rank += directions[i][1];
+        }
+    }
+    return attacks;
+}
+
+static PieceColor opponent(PieceColor color)
+{
+    return color == WhitePieces ? BlackPieces : WhitePieces;
+}
+
+ChessPosition ChessPosition::initial()
+{
+    ChessPosition position;
+    position.parseFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+    return position;
+}
+
+bool ChessPosition::parseFen(const std::string& fen)
+{
+    BoardState parsed;
+    if (!parsed.parseFen(fen))
+        return false;
+
+    std::istringstream fields(fen);
+    std::string placement, side, castling, enPassantField;
+    fields >> placement >> side >> castling >> enPassantField;
+    if (!side.empty() && side != "w" && side != "b")
+        return false;
+
+    board = parsed;
+    sideToMove = side == "b" ? BlackPieces : WhitePieces;
+    enPassant = -1;
+    if (enPassantField.size() == 2 && enPassantField[0] >= 'a' && enPassantField[0] <= 'h' &&
+        enPassantField[1] >= '1' && enPassantField[1] <= '8')
+        enPassant = squareIndex(enPassantField[0] - 'a', enPassantField[1] - '1');
+    return true;
+}
+
+Bitboard ChessPosition::movers(PieceType type, int target) const
+{
+    const AttackTables& tables = attackTables();
+    Bitboard own = board.pieces(sideToMove, type);
+    Bitboard occupied = board.occupied();
+    Bitboard targetBit = 1ull << target;
+    switch (type)
+    {
+    case KnightPiece:
+        return tables.knight[target] & own;
+    case KingPiece:
+        return tables.king[target] & own;
+    case BishopPiece:
+        return slidingAttacks(target, occupied, bishopDirections) & own;
+    case RookPiece:
+        return slidingAttacks(target, occupied, rookDirections) & own;
+    case QueenPiece:
+        return (slidingAttacks(target, occupied, bishopDirections) | slidingAttacks(target, occupied, rookDirections)) & own;
+    case PawnPiece:
+    default:
+    {
+        Bitboard result = 0;
+        if (board.occupied(opponent(sideToMove)) & targetBit || target == enPassant)
+        {
+            // A pawn attacks the target from where an opposing pawn on the target would attack
+            result |= tables.pawn[opponent(sideToMove)][target] & own;
+        }
+        else if (!(occupied & targetBit))
+        {
+            int step = sideToMove == WhitePieces ? -8 : 8;
+            int single = target + step;
+            if (single >= 0 && single < 64)
+            {
+                if (own & (1ull << single))
+                    result |= 1ull << single;
+                // Two squares from the starting rank, over an empty square
+                int doubleRank = sideToMove == WhitePieces ? 3 : 4;
+                int start = single + step;
+                if (target / 8 == doubleRank && !(occupied & (1ull << single)) && (own & (1ull << start)))
+                    result |= 1ull << start;
+            }
+        }
+        return result;
+    }
+    }
+}
+
+bool ChessPosition::parseSan(const std::string& text, ChessMove& move) const
+{
+    // Check marks and annotations carry nothing the move needs
+    std::string san = text;
+    while (!san.empty() && std::strchr("+#!?", san.back()))
+        san.pop_back();
+
+    if (san == "O-O" || san == "0-0" || san == "O-O-O" || san == "0-0-0")
+    {
+        Bitboard king = board.pieces(sideToMove, KingPiece);
+        if (king == 0)
+            return false;
+        int from = popSquare(king);
+        move = ChessMove();
+        move.from = from;
+        move.to = san.size() == 3 ? from + 2 : from - 2;
+        return move.to / 8 == from / 8;
+    }
+
+    // Piece letters are upper case, files lower case
+    PieceType type = PawnPiece;
+    PieceColor color;
+    size_t begin = 0;
+    if (!san.empty() && san[0] >= 'A' && san[0] <= 'Z' && BoardState::pieceFromLetter(san[0], color, type))
+        begin = 1;
+
+    // Promotion, "e8=Q" or "e8Q"
+    char promotion = 0;
+    size_t end = san.size();
+    if (end >= 2 && std::strchr("NBRQ", san[end - 1]))
+    {
+        promotion = san[end - 1];
+        end -= san[end - 2] == '=' ? 2 : 1;
+    }
+    if (end < begin + 2)
+        return false;
+
+    char targetFile = san[end - 2];
+    char targetRank = san[end - 1];
+    if (targetFile < 'a' || targetFile > 'h' || targetRank < '1' || targetRank > '8')
+        return false;
+    int target = squareIndex(targetFile - 'a', targetRank - '1');
+
+    // Whatever is left between the piece and the target tells movers apart
+    int fromFile = -1;
+    int fromRank = -1;
+    for (size_t i = begin; i < end - 2; i++)
+    {
+        char c = san[i];
+        if (c >= 'a' && c <= 'h')
+            fromFile = c - 'a';
+        else if (c >= '1' && c <= '8')
+            fromRank = c - '1';
+        else if (c != 'x' && c != ':' && c != '-')
+            return false;
+    }
+    // Pawns only change file when capturing, and captures name the file
+    if (type == PawnPiece && fromFile < 0)
+        fromFile = target % 8;
+
+    int found = 0;
+    Bitboard candidates = movers(type, target);
+    while (candidates)
+    {
+        ChessMove candidate;
+        candidate.from = popSquare(candidates);
+        candidate.to = target;
+        candidate.promotion = type == PawnPiece ? promotion : 0;
+        if ((fromFile >= 0 && candidate.from % 8 != fromFile) || (fromRank >= 0 && candidate.from / 8 != fromRank))
+            continue;
+        if (!leavesKingSafe(candidate))
+            continue;
+        move = candidate;
+        found++;
+    }
+    return found == 1;
+}
+
+void ChessPosition::apply(const ChessMove& move)
+{
+    char piece = board.pieceAt(move.from);
+    PieceColor color;
+    PieceType type;
+    if (!BoardState::pieceFromLetter(piece, color, type))
+        return;
+
+    if (type == PawnPiece && move.to == enPassant && move.from % 8 != move.to % 8)
+        board.setPiece(move.to + (color == WhitePieces ? -8 : 8), 0);
+    if (type == KingPiece && std::abs(move.to - move.from) == 2)
+    {
+        int rank = move.from / 8;
+        bool kingSide = move.to > move.from;
+        int rookFrom = squareIndex(kingSide ? 7 : 0, rank);
+        board.setPiece((move.from + move.to) / 2, board.pieceAt(rookFrom));
+        board.setPiece(rookFrom, 0);
+    }
+
+    char placed = piece;
+    if (move.promotion != 0)
+        placed = color == WhitePieces ? move.promotion : (char)(move.promotion - 'A' + 'a');
+    board.setPiece(move.from, 0);
+    board.setPiece(move.to, placed);
+
+    enPassant = type == PawnPiece && std::abs(move.to - move.from) == 16 ? (move.from + move.to) / 2 : -1;
+    sideToMove = opponent(sideToMove);
+}
+
+bool ChessPosition::isAttacked(int square, PieceColor by) const
+{
+    const AttackTables& tables = attackTables();
+    Bitboard occupied = board.occupied();
+    Bitboard queens = board.pieces(by, QueenPiece);
+    return (tables.knight[square] & board.pieces(by, KnightPiece)) ||
+        (tables.king[square] & board.pieces(by, KingPiece)) ||
+        (tables.pawn[opponent(by)][square] & board.pieces(by, PawnPiece)) ||
+        (slidingAttacks(square, occupied, bishopDirections) & (board.pieces(by, BishopPiece) | queens)) ||
+        (slidingAttacks(square, occupied, rookDirections) & (board.pieces(by, RookPiece) | queens));
+}
+
+bool ChessPosition::inCheck(PieceColor color) const
+{
+    Bitboard king = board.pieces(color, KingPiece);
+    if (king == 0)
+        return false;
+    return isAttacked(popSquare(king), opponent(color));
+}
+
+bool ChessPosition::leavesKingSafe(const ChessMove& move) const
+{
+    ChessPosition after = *this;
+    after.apply(move);
+    return !after.inCheck(sideToMove);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+
+#include "boardstate.h"
+
+// A move from one square to another; castling is the king's move, and the rook follows in apply()
+struct ChessMove
+{
+    int from = -1;
+    int to = -1;
+    // Upper case FEN letter of the piece a pawn turns into, 0 otherwise
+    char promotion = 0;
+
+    bool isValid() const
+    {
+        return from >= 0;
+    }
+};
+
+// A position with the side to move, enough to resolve the moves of a recorded game. Castling
+// rights are not tracked: a game's record is trusted to only castle when it may.
+class ChessPosition
+{
+public:
+    BoardState board;
+    PieceColor sideToMove = WhitePieces;
+    // Square a pawn can capture en passant on, -1 when there is none
+    int enPassant = -1;
+
+    static ChessPosition initial();
+
+    // Placement, side to move and en passant fields of a FEN string; the others are ignored
+    bool parseFen(const std::string& fen);
+
+    // Finds the legal move a move in standard algebraic notation ("e4", "Nbd7", "exd8=Q+", "O-O")
+    // stands for. Returns false when no legal move or more than one matches.
+    bool parseSan(const std::string& san, ChessMove& move) const;
+    // Plays a move without checking it
+    void apply(const ChessMove& move);
+
+    bool isAttacked(int square, PieceColor by) const;
+    bool inCheck(PieceColor color) const;
+
+private:
+    // Squares of the pieces of a type that could move to a square, before checking the king
+    Bitboard movers(PieceType type, int target) const;
+    bool leavesKingSafe(const ChessMove& move) const;
+};
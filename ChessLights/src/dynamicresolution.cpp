@@ -0,0 +1,221 @@
+#include "dynamicresolution.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Element index of the radical inverse sequence in a base, 0 to 1
+static float halton(int index, int base)
+{
+    float result = 0.0f;
+    float fraction = 1.0f;
+    while (index > 0)
+    {
+        fraction /= (float)base;
+        result += fraction * (float)(index % base);
+        index /= base;
+    }
+    return result;
+}
+
+static GLuint createTexture(GLint internalFormat, GLenum format, GLenum type, int width, int height, GLint filter)
+{
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+DynamicResolution::DynamicResolution(float budgetMilliseconds, bool temporal) :
+    upscaleShader("res/shaders/upscale.vs", "res/shaders/upscale.fs"),
+    resolveShader("res/shaders/upscale.vs", "res/shaders/resolve.fs"),
+    budget(budgetMilliseconds),
+    temporal(temporal)
+{
+    if (temporal && budget <= 0.0f)
+        scale = temporalScale;
+    glGenFramebuffers(1, &framebuffer);
+    glGenFramebuffers(1, &historyFramebuffer);
+    // The full-screen triangle comes from gl_VertexID, but core profiles still need a VAO bound
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+DynamicResolution::~DynamicResolution()
+{
+    glDeleteTextures(1, &colorTexture);
+    glDeleteTextures(1, &motionTexture);
+    glDeleteTextures(1, &depthTexture);
+    glDeleteTextures(2, historyTextures);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteFramebuffers(1, &historyFramebuffer);
+    glDeleteVertexArrays(1, &emptyVAO);
+}
+
+void DynamicResolution::resize(int newWidth, int newHeight)
+{
+    width = newWidth;
+    height = newHeight;
+
+    glDeleteTextures(1, &colorTexture);
+    glDeleteTextures(1, &motionTexture);
+    glDeleteTextures(1, &depthTexture);
+    glDeleteTextures(2, historyTextures);
+    colorTexture = createTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height, GL_LINEAR);
+    // The resolve reads depth to find the nearest surface around each pixel
+    depthTexture = createTexture(GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, width, height, GL_NEAREST);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    if (temporal)
+    {
+        motionTexture = createTexture(GL_RG16F, GL_RG, GL_HALF_FLOAT, width, height, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, motionTexture, 0);
+        const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+
+        historyTextures[0] = createTexture(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, width, height, GL_LINEAR);
+        historyTextures[1] = createTexture(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, width, height, GL_LINEAR);
+        historyValid = false;
+    }
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::DYNAMIC_RESOLUTION::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+}
+
+int DynamicResolution::scaledWidth() const
+{
+    return std::max(1, (int)std::lround(width * scale));
+}
+
+int DynamicResolution::scaledHeight() const
+{
+    return std::max(1, (int)std::lround(height * scale));
+}
+
+void DynamicResolution::begin(Camera& camera)
+{
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &outputFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, outputViewport);
+    // Minimized windows report a zero size; the target keeps the last one
+    if (outputViewport[2] > 0 && outputViewport[3] > 0 && (outputViewport[2] != width || outputViewport[3] != height))
+        resize(outputViewport[2], outputViewport[3]);
+
+    if (temporal)
+    {
+        // Halton starts at index 1; 0 would be the same corner in both bases
+        frameIndex++;
+        int phase = (int)(frameIndex % jitterPhases) + 1;
+        // Up to half a pixel of the scaled frame either way
+        jitter = glm::vec2((halton(phase, 2) - 0.5f) * 2.0f / (float)scaledWidth(),
+            (halton(phase, 3) - 0.5f) * 2.0f / (float)scaledHeight());
+        camera.setJitter(jitter);
+        viewProjection = camera.getUnjitteredProjectionMatrix() * camera.getViewMatrix();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, scaledWidth(), scaledHeight());
+}
+
+void DynamicResolution::end(float passMilliseconds)
+{
+    glDisable(GL_DEPTH_TEST);
+    if (temporal)
+        resolve();
+    {
+        PROFILE_GPU_SCOPE("Upscale");
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+        glViewport(outputViewport[0], outputViewport[1], outputViewport[2], outputViewport[3]);
+
+        // The resolved frame already has the output's size; it only gets sharpened
+        upscaleShader.use();
+        upscaleShader.setInt("sceneColor", 0);
+        if (temporal)
+            upscaleShader.setVec2("renderScale", 1.0f, 1.0f);
+        else
+            upscaleShader.setVec2("renderScale", (float)scaledWidth() / (float)width, (float)scaledHeight() / (float)height);
+        upscaleShader.setFloat("sharpness", temporal || scale < maxScale ? sharpness : 0.0f);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, temporal ? historyTextures[history] : colorTexture);
+        glBindVertexArray(emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glEnable(GL_DEPTH_TEST);
+    }
+    if (temporal)
+    {
+        previousViewProjection = viewProjection;
+        history ^= 1;
+        historyValid = true;
+    }
+
+    // Without a budget the scale stays where the constructor put it
+    if (budget <= 0.0f)
+        return;
+    if (framesSinceAdjust >= settleFrames)
+    {
+        measuredSum += passMilliseconds;
+        measuredFrames++;
+    }
+    if (++framesSinceAdjust >= adjustInterval)
+        adjust();
+}
+
+void DynamicResolution::resolve()
+{
+    PROFILE_GPU_SCOPE("Temporal resolve");
+    glBindFramebuffer(GL_FRAMEBUFFER, historyFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, historyTextures[history], 0);
+    glViewport(0, 0, width, height);
+
+    resolveShader.use();
+    resolveShader.setInt("sceneColor", 0);
+    resolveShader.setInt("sceneMotion", 1);
+    resolveShader.setInt("sceneDepth", 2);
+    resolveShader.setInt("history", 3);
+    resolveShader.setVec2("renderScale", (float)scaledWidth() / (float)width, (float)scaledHeight() / (float)height);
+    // In texture coordinates of the rendered part
+    resolveShader.setVec2("jitter", jitter * 0.5f);
+    resolveShader.setMat4("reprojection", previousViewProjection * glm::inverse(viewProjection));
+    resolveShader.setFloat("historyWeight", historyValid ? historyWeight : 0.0f);
+    const GLuint textures[4] = { colorTexture, motionTexture, depthTexture, historyTextures[history ^ 1] };
+    for (int i = 3; i >= 0; i--)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+    }
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    for (int i = 3; i >= 0; i--)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+}
+
+void DynamicResolution::adjust()
+{
+    if (measuredFrames == 0)
+        return;
+    milliseconds = measuredSum / (float)measuredFrames;
+    measuredSum = 0.0f;
+    measuredFrames = 0;
+    framesSinceAdjust = 0;
+
+    // The timed passes go with the pixel count, the square of the scale
+    float ratio = std::sqrt(budget * headroom / std::max(milliseconds, 0.01f));
+    ratio = glm::clamp(ratio, maxDrop, maxRise);
+    float next = glm::clamp(scale * ratio, minScale, maxScale);
+    // Small steps are noise; they would only make the image swim
+    if (std::abs(next - scale) >= 0.02f || next == minScale || next == maxScale)
+        scale = next;
+}
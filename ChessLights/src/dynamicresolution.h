@@ -0,0 +1,111 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "camera.h"
+
+// Renders the scene into a target of its own at a fraction of the output resolution and scales
+// it up to the output with a sharpening filter. Every adjustInterval frames a controller compares
+// the GPU time of the passes drawn at the render resolution with the budget and picks the next
+// scale, so heavy lighting costs resolution instead of frames.
+//
+// The target has the output's size and the scene only covers its lower left corner, so a new
+// scale is a new viewport and never a reallocation. The controller takes the times of the passes
+// themselves, from their GL_TIME_ELAPSED queries, rather than the span of the whole frame: that
+// span includes the time the GPU waits for the CPU to submit, and a frame held up by the CPU
+// would only lose resolution without getting any faster. The pass timers are read a few frames
+// late, so the frames right after a change of scale are left out.
+//
+// Temporal upscaling shifts the projection by a different fraction of a pixel every frame, and the
+// objects write how far each pixel moved since the frame before. A resolve pass at the output
+// resolution follows every pixel back into the history of earlier frames, clamps what it finds to
+// the colours around it in this frame, so disocclusions and changes do not ghost, and blends this
+// frame in. Over a few frames the history gathers more samples per pixel than one frame renders.
+class DynamicResolution
+{
+public:
+    static constexpr float minScale = 0.5f;
+    static constexpr float maxScale = 1.0f;
+    // Scale of temporal upscaling without a budget: half the pixels
+    static constexpr float temporalScale = 0.7071f;
+    static const int adjustInterval = 8;
+    // Frames after a change of scale whose pass times may still be of the old scale
+    static const int settleFrames = 4;
+    // Share of the budget the controller aims for, leaving room for spikes
+    static constexpr float headroom = 0.9f;
+    // Strongest change of the scale per adjustment; it drops faster than it recovers
+    static constexpr float maxDrop = 0.8f;
+    static constexpr float maxRise = 1.05f;
+    // Of the sharpening filter, 0 to 1; off at full scale without temporal upscaling
+    static constexpr float sharpness = 0.5f;
+    // Jitter positions cycled through, Halton (2, 3)
+    static const int jitterPhases = 16;
+    // Share of the resolved pixel taken from the history
+    static constexpr float historyWeight = 0.9f;
+
+    // A budget of 0 keeps the scale fixed, at full resolution or temporalScale
+    DynamicResolution(float budgetMilliseconds, bool temporal);
+    ~DynamicResolution();
+
+    DynamicResolution(const DynamicResolution&) = delete;
+    DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+    // Binds the scene target at the current scale and jitters the camera. The framebuffer and
+    // viewport bound now are the output.
+    void begin(Camera& camera);
+    // Resolves or scales the frame up into the output and binds the output again. passMilliseconds
+    // is the latest GPU time of the passes drawn at the render resolution, for the controller.
+    void end(float passMilliseconds);
+
+    float getScale() const
+    {
+        return scale;
+    }
+
+    // Average GPU time of the passes the last adjustment was based on
+    float getMilliseconds() const
+    {
+        return milliseconds;
+    }
+
+private:
+    Shader upscaleShader;
+    Shader resolveShader;
+    GLuint framebuffer = 0;
+    GLuint colorTexture = 0;
+    GLuint motionTexture = 0;
+    GLuint depthTexture = 0;
+    // Resolved frames at the output resolution, this one and the one before
+    GLuint historyFramebuffer = 0;
+    GLuint historyTextures[2] = {};
+    GLuint emptyVAO = 0;
+    // Size of the target, the output's
+    int width = 0;
+    int height = 0;
+    GLint outputFramebuffer = 0;
+    GLint outputViewport[4] = {};
+
+    float budget;
+    bool temporal;
+    float scale = maxScale;
+    float milliseconds = 0.0f;
+    float measuredSum = 0.0f;
+    int measuredFrames = 0;
+    int framesSinceAdjust = 0;
+
+    // This frame's jitter in normalized device coordinates, its camera without it, and the last frame's
+    glm::vec2 jitter = glm::vec2(0.0f);
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    glm::mat4 previousViewProjection = glm::mat4(1.0f);
+    unsigned int frameIndex = 0;
+    int history = 0;
+    bool historyValid = false;
+
+    void resize(int newWidth, int newHeight);
+    int scaledWidth() const;
+    int scaledHeight() const;
+    void resolve();
+    void adjust();
+};
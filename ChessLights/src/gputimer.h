@@ -0,0 +1,107 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// Measures GPU time of a section of the frame with GL_TIME_ELAPSED queries.
+// Queries are kept in a small ring and read a few frames later, once their
+// results are available. Only when the GPU falls a whole ring behind does
+// begin() wait for the oldest query, so that no result is lost.
+class GpuTimer
+{
+public:
+    GpuTimer()
+    {
+        glGenQueries(queryCount, queries);
+    }
+
+    ~GpuTimer()
+    {
+        glDeleteQueries(queryCount, queries);
+    }
+
+    GpuTimer(const GpuTimer&) = delete;
+    GpuTimer& operator=(const GpuTimer&) = delete;
+
+    void begin()
+    {
+        collect();
+        // The GPU is a whole ring behind; wait rather than lose the result
+        if (pending[current])
+            read(current);
+        glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+    }
+
+    void end()
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[current] = true;
+        current = (current + 1) % queryCount;
+    }
+
+    // Exponentially smoothed time of the section, in milliseconds
+    float getMilliseconds() const
+    {
+        return milliseconds;
+    }
+
+    // Time of the most recent frame whose result is available, in milliseconds
+    float getLastMilliseconds() const
+    {
+        return lastMilliseconds;
+    }
+
+    // Appends every result to samples from now on, in milliseconds
+    void recordTo(std::vector<float>* samples)
+    {
+        recorded = samples;
+    }
+
+    // Waits for the queries still in flight, e.g. at the end of a measured run
+    void finish()
+    {
+        for (int k = 0; k < queryCount; k++)
+        {
+            int i = (current + k) % queryCount;
+            if (pending[i])
+                read(i);
+        }
+    }
+
+private:
+    static const int queryCount = 3;
+    unsigned int queries[queryCount];
+    bool pending[queryCount] = {};
+    int current = 0;
+    float milliseconds = 0.0f;
+    float lastMilliseconds = 0.0f;
+    std::vector<float>* recorded = nullptr;
+
+    void read(int i)
+    {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+        pending[i] = false;
+        lastMilliseconds = (float)elapsed / 1000000.0f;
+        milliseconds = milliseconds * 0.9f + lastMilliseconds * 0.1f;
+        if (recorded)
+            recorded->push_back(lastMilliseconds);
+    }
+
+    void collect()
+    {
+        // Oldest query first, so the last result read is the newest one
+        for (int k = 0; k < queryCount; k++)
+        {
+            int i = (current + k) % queryCount;
+            if (!pending[i]) continue;
+
+            GLint available = 0;
+            glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+
+            read(i);
+        }
+    }
+};
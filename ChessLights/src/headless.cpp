@@ -0,0 +1,145 @@
+#include "headless.h"
+
+#include <GL/glew.h>
+
+#ifdef CHESSLIGHTS_EGL
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifdef CHESSLIGHTS_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+#include <cstring>
+#include <iostream>
+
+HeadlessContext::~HeadlessContext()
+{
+#ifdef CHESSLIGHTS_EGL
+    if (eglDisplay)
+    {
+        eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (eglContext)
+            eglDestroyContext(eglDisplay, eglContext);
+        eglTerminate(eglDisplay);
+    }
+#endif
+
+#ifdef CHESSLIGHTS_OSMESA
+    if (osmesaContext)
+        OSMesaDestroyContext(static_cast<OSMesaContext>(osmesaContext));
+#endif
+}
+
+bool HeadlessContext::create()
+{
+#ifdef CHESSLIGHTS_EGL
+    if (createEGL())
+    {
+        backendName = "EGL surfaceless";
+        return loadFunctions();
+    }
+    std::cout << "EGL surfaceless context not available" << std::endl;
+#endif
+
+#ifdef CHESSLIGHTS_OSMESA
+    if (createOSMesa())
+    {
+        backendName = "OSMesa";
+        return loadFunctions();
+    }
+    std::cout << "OSMesa context not available" << std::endl;
+#endif
+
+    std::cout << "ERROR::HEADLESS::NO_BACKEND: build with CHESSLIGHTS_EGL or CHESSLIGHTS_OSMESA" << std::endl;
+    return false;
+}
+
+bool HeadlessContext::loadFunctions()
+{
+    glewExperimental = GL_TRUE;
+    GLenum result = glewInit();
+    // GLEW built for GLX also tries to load GLX extensions, which fails without an X display
+    // even though every GL entry point has been loaded
+    if (result != GLEW_OK && result != GLEW_ERROR_NO_GLX_DISPLAY)
+    {
+        std::cout << "ERROR::HEADLESS::GLEW_INIT_FAILED: " << glewGetErrorString(result) << std::endl;
+        return false;
+    }
+
+    // glewInit may leave an error behind from querying extensions on a core context
+    glGetError();
+    std::cout << "Headless context: " << backendName << ", " << glGetString(GL_RENDERER) << std::endl;
+    return true;
+}
+
+#ifdef CHESSLIGHTS_EGL
+bool HeadlessContext::createEGL()
+{
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (clientExtensions == nullptr || std::strstr(clientExtensions, "EGL_MESA_platform_surfaceless") == nullptr)
+        return false;
+
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay == nullptr)
+        return false;
+
+    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+        return false;
+    eglDisplay = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+        return false;
+
+    const EGLint configAttributes[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0)
+        return false;
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT)
+        return false;
+    eglContext = context;
+
+    // Needs EGL_KHR_surfaceless_context, which the surfaceless platform always exposes
+    return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context) == EGL_TRUE;
+}
+#endif
+
+#ifdef CHESSLIGHTS_OSMESA
+// GLEW has to be built with GLEW_OSMESA, so glewInit() loads the functions through OSMesa
+bool HeadlessContext::createOSMesa()
+{
+    const int attributes[] = {
+        OSMESA_FORMAT, OSMESA_RGBA,
+        OSMESA_DEPTH_BITS, 0,
+        OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+        OSMESA_CONTEXT_MAJOR_VERSION, 3,
+        OSMESA_CONTEXT_MINOR_VERSION, 3,
+        0
+    };
+    OSMesaContext context = OSMesaCreateContextAttribs(attributes, NULL);
+    if (context == NULL)
+        return false;
+    osmesaContext = context;
+
+    // Rendering goes to a framebuffer object; the window-system buffer only has to exist
+    const int bufferSize = 16;
+    osmesaBuffer.resize(bufferSize * bufferSize * 4);
+    return OSMesaMakeCurrent(context, osmesaBuffer.data(), GL_UNSIGNED_BYTE, bufferSize, bufferSize) == GL_TRUE;
+}
+#endif
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+// OpenGL 3.3 core context without a window or display, for render nodes and CI.
+// Backends are compiled in with CHESSLIGHTS_EGL (EGL_MESA_platform_surfaceless) and
+// CHESSLIGHTS_OSMESA; when both are available EGL is tried first. Either one runs on
+// Mesa's llvmpipe without a GPU. The context has no default framebuffer, so all
+// drawing goes to a Framebuffer.
+class HeadlessContext
+{
+public:
+    HeadlessContext() = default;
+    ~HeadlessContext();
+
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    // Creates the context, makes it current and loads the GL functions
+    bool create();
+
+    const char* getBackendName() const
+    {
+        return backendName;
+    }
+
+private:
+    const char* backendName = "none";
+
+#ifdef CHESSLIGHTS_EGL
+    void* eglDisplay = nullptr;
+    void* eglContext = nullptr;
+    bool createEGL();
+#endif
+
+#ifdef CHESSLIGHTS_OSMESA
+    void* osmesaContext = nullptr;
+    // OSMesa needs a client-side color buffer to make the context current
+    std::vector<unsigned char> osmesaBuffer;
+    bool createOSMesa();
+#endif
+
+    bool loadFunctions();
+};
@@ -0,0 +1,138 @@
+#include "impostor.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+static GLuint createAtlasTexture(int size)
+{
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Deeper levels would blend neighbouring frames
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, ImpostorAtlas::mipLevels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+ImpostorAtlas::ImpostorAtlas(Model& model, const glm::vec3& up)
+{
+    glm::vec3 boundsMin(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+    for (const Mesh& mesh : model.meshes)
+    {
+        boundsMin = glm::min(boundsMin, mesh.boundsMin);
+        boundsMax = glm::max(boundsMax, mesh.boundsMax);
+    }
+    center = (boundsMin + boundsMax) * 0.5f;
+    radius = glm::length(boundsMax - boundsMin) * 0.5f;
+
+    glm::vec3 axis = glm::normalize(up);
+    glm::vec3 tangent = glm::normalize(glm::cross(std::abs(axis.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f), axis));
+    basis = glm::mat3(tangent, glm::cross(axis, tangent), axis);
+
+    bake(model);
+}
+
+ImpostorAtlas::~ImpostorAtlas()
+{
+    glDeleteTextures(1, &albedoTexture);
+    glDeleteTextures(1, &normalDepthTexture);
+}
+
+glm::vec3 ImpostorAtlas::frameDirection(const glm::vec2& coords)
+{
+    glm::vec2 p = glm::vec2(coords.x + coords.y, coords.x - coords.y) * 0.5f;
+    return glm::normalize(glm::vec3(p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y)));
+}
+
+void ImpostorAtlas::bake(Model& model)
+{
+    PROFILE_SCOPE("ImpostorAtlas::bake");
+    const int atlasSize = framesPerSide * frameSize;
+    albedoTexture = createAtlasTexture(atlasSize);
+    normalDepthTexture = createAtlasTexture(atlasSize);
+
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+    GLuint framebuffer = 0;
+    GLuint depthBuffer = 0;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedoTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalDepthTexture, 0);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasSize, atlasSize);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::IMPOSTOR::FRAMEBUFFER_NOT_COMPLETE" << std::endl;
+
+    // Uncovered texels: transparent, with a normal facing the viewer and the depth of the far end
+    const GLfloat clearAlbedo[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    const GLfloat clearNormalDepth[4] = { 0.5f, 0.5f, 1.0f, 1.0f };
+    glClearBufferfv(GL_COLOR, 0, clearAlbedo);
+    glClearBufferfv(GL_COLOR, 1, clearNormalDepth);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    Shader bakeShader("res/shaders/impostorbake.vs", "res/shaders/impostorbake.fs");
+    bakeShader.use();
+    // Depth runs from the front of the bounding sphere at 0 to its back at 1
+    glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, 3.0f * radius);
+    for (int j = 0; j < framesPerSide; j++)
+    {
+        for (int i = 0; i < framesPerSide; i++)
+        {
+            glm::vec2 coords = (glm::vec2(i, j) + 0.5f) / (float)framesPerSide * 2.0f - 1.0f;
+            glm::vec3 local = frameDirection(coords);
+            glm::vec3 direction = basis * local;
+            // The same up as impostor.vs picks for the frame
+            glm::vec3 upHint = std::abs(local.z) < 0.999f ? basis[2] : basis[0];
+            glm::mat4 view = glm::lookAt(center + direction * 2.0f * radius, center, upHint);
+
+            glViewport(i * frameSize, j * frameSize, frameSize, frameSize);
+            bakeShader.setMat4("bakeViewProjection", projection * view);
+            model.Draw(bakeShader);
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, albedoTexture);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, normalDepthTexture);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+}
+
+void ImpostorAtlas::bind(const Shader& shader) const
+{
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, albedoTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, normalDepthTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    // The lighting reads the albedo as the diffuse texture
+    shader.setInt("texture_diffuse1", 0);
+    shader.setInt("impostorNormalDepth", 1);
+    shader.setVec3("impostorCenter", center);
+    shader.setFloat("impostorRadius", radius);
+    shader.setMat3("impostorBasis", basis);
+    shader.setInt("impostorFrames", framesPerSide);
+}
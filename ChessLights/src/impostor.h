@@ -0,0 +1,54 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "model.h"
+
+// Pieces further from the camera than this are drawn as impostors
+const float impostorDistance = 24.0f;
+
+// A model seen from a hemisphere of directions, baked once at load time into an atlas of
+// framesPerSide x framesPerSide frames. Frame (i, j) looks at the model along the direction at
+// the centre of cell (i, j) of a hemi-octahedral map: the upper half of an octahedron unfolded
+// into a square, so the directions are spread about evenly over the hemisphere. Every frame is an
+// orthographic view of the model's bounding sphere and holds albedo with coverage in alpha, and
+// the model-space normal with the depth through the sphere in alpha.
+//
+// A far piece is then one quad facing the camera. impostor.vs picks the frame nearest the view
+// direction and impostor.fs intersects each pixel's view ray with that frame's plane, reads the
+// atlas there and lights the point at the stored depth like any other fragment. Whatever the
+// model's triangle count, a far piece costs two triangles and its pixels.
+class ImpostorAtlas
+{
+public:
+    static const int framesPerSide = 8;
+    static const int frameSize = 128;
+    // Coarsest mip level, frames of 8x8 texels
+    static const int mipLevels = 4;
+
+    // up is the model-space axis that points up when the model stands; the hemisphere is around it
+    ImpostorAtlas(Model& model, const glm::vec3& up);
+    ~ImpostorAtlas();
+
+    ImpostorAtlas(const ImpostorAtlas&) = delete;
+    ImpostorAtlas& operator=(const ImpostorAtlas&) = delete;
+
+    // Binds the atlas on units 0 and 1 and sets the model's bounds and frame layout
+    void bind(const Shader& shader) const;
+
+    // Direction of a frame in the hemisphere's space, z up; coords are the frame's cell centre in [-1, 1]
+    static glm::vec3 frameDirection(const glm::vec2& coords);
+
+private:
+    GLuint albedoTexture = 0;
+    GLuint normalDepthTexture = 0;
+    // Bounding sphere in model space
+    glm::vec3 center;
+    float radius = 0.0f;
+    // Model-space tangent, bitangent and up of the hemisphere
+    glm::mat3 basis;
+
+    void bake(Model& model);
+};
@@ -0,0 +1,95 @@
+#include "inputlog.h"
+
+#include <cstring>
+#include <iostream>
+
+const char logMagic[4] = { 'C', 'L', 'R', 'P' };
+const uint32_t logVersion = 2;
+
+// Fields are written one by one, so the format does not depend on struct padding
+const size_t recordSize = sizeof(float) + sizeof(uint32_t) + 3 * sizeof(float) + sizeof(uint8_t) + 2 * sizeof(float);
+
+bool InputRecorder::open(const std::string& path)
+{
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cout << "ERROR::INPUT_LOG::CANNOT_OPEN_FOR_WRITING: " << path << std::endl;
+        return false;
+    }
+
+    file.write(logMagic, sizeof(logMagic));
+    file.write(reinterpret_cast<const char*>(&logVersion), sizeof(logVersion));
+    return true;
+}
+
+void InputRecorder::write(const FrameRecord& frame)
+{
+    if (!file.is_open()) return;
+
+    char buffer[recordSize];
+    char* out = buffer;
+    std::memcpy(out, &frame.deltaTime, sizeof(float)); out += sizeof(float);
+    std::memcpy(out, &frame.keys, sizeof(uint32_t)); out += sizeof(uint32_t);
+    std::memcpy(out, &frame.mouseX, sizeof(float)); out += sizeof(float);
+    std::memcpy(out, &frame.mouseY, sizeof(float)); out += sizeof(float);
+    std::memcpy(out, &frame.scroll, sizeof(float)); out += sizeof(float);
+    uint8_t pick = frame.pick ? 1 : 0;
+    std::memcpy(out, &pick, sizeof(uint8_t)); out += sizeof(uint8_t);
+    std::memcpy(out, &frame.pickX, sizeof(float)); out += sizeof(float);
+    std::memcpy(out, &frame.pickY, sizeof(float));
+    file.write(buffer, recordSize);
+}
+
+void InputRecorder::close()
+{
+    if (file.is_open())
+        file.close();
+}
+
+bool InputPlayer::open(const std::string& path)
+{
+    file.open(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cout << "ERROR::INPUT_LOG::CANNOT_OPEN_FOR_READING: " << path << std::endl;
+        return false;
+    }
+
+    char magic[4] = {};
+    uint32_t version = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!file || std::memcmp(magic, logMagic, sizeof(magic)) != 0 || version != logVersion)
+    {
+        std::cout << "ERROR::INPUT_LOG::INVALID_FILE: " << path << std::endl;
+        file.close();
+        return false;
+    }
+
+    frame = 0;
+    return true;
+}
+
+bool InputPlayer::next(FrameRecord& record)
+{
+    if (!file.is_open()) return false;
+
+    char buffer[recordSize];
+    if (!file.read(buffer, recordSize))
+        return false;
+
+    const char* in = buffer;
+    std::memcpy(&record.deltaTime, in, sizeof(float)); in += sizeof(float);
+    std::memcpy(&record.keys, in, sizeof(uint32_t)); in += sizeof(uint32_t);
+    std::memcpy(&record.mouseX, in, sizeof(float)); in += sizeof(float);
+    std::memcpy(&record.mouseY, in, sizeof(float)); in += sizeof(float);
+    std::memcpy(&record.scroll, in, sizeof(float)); in += sizeof(float);
+    uint8_t pick = 0;
+    std::memcpy(&pick, in, sizeof(uint8_t)); in += sizeof(uint8_t);
+    record.pick = pick != 0;
+    std::memcpy(&record.pickX, in, sizeof(float)); in += sizeof(float);
+    std::memcpy(&record.pickY, in, sizeof(float));
+    frame++;
+    return true;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// Everything that drives one frame: the time it advances the simulation by and the input
+// sampled during it. Replaying the same sequence renders the same frames.
+struct FrameRecord
+{
+    float deltaTime = 0.0f;
+    uint32_t keys = 0;
+    float mouseX = 0.0f;
+    float mouseY = 0.0f;
+    float scroll = 0.0f;
+    // A left click this frame, at the cursor as a fraction of the window from its top left
+    bool pick = false;
+    float pickX = 0.5f;
+    float pickY = 0.5f;
+};
+
+// Binary log layout: "CLRP", uint32 version, then one packed FrameRecord per frame,
+// little-endian, until the end of the file.
+class InputRecorder
+{
+public:
+    bool open(const std::string& path);
+    void write(const FrameRecord& frame);
+    void close();
+
+    bool isOpen() const
+    {
+        return file.is_open();
+    }
+
+private:
+    std::ofstream file;
+};
+
+class InputPlayer
+{
+public:
+    bool open(const std::string& path);
+    // Returns false once the log is exhausted
+    bool next(FrameRecord& frame);
+
+    bool isOpen() const
+    {
+        return file.is_open();
+    }
+
+    uint64_t getFrame() const
+    {
+        return frame;
+    }
+
+private:
+    std::ifstream file;
+    uint64_t frame = 0;
+};
@@ -0,0 +1,223 @@
+#include "jobsystem.h"
+#include "profiler.h"
+
+#include <algorithm>
+
+// Queue owned by the current thread; threads the system does not know share queue 0
+struct WorkerIdentity
+{
+    const JobSystem* system;
+    unsigned int queue;
+};
+static thread_local WorkerIdentity workerIdentity = { nullptr, 0 };
+
+JobSystem::JobSystem(unsigned int workerCount)
+{
+    if (workerCount == 0)
+    {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    // Queue 0 belongs to the thread that owns the system, the rest to the workers
+    for (unsigned int i = 0; i <= workerCount; i++)
+        queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+
+    workerIdentity.system = this;
+    workerIdentity.queue = 0;
+
+    for (unsigned int i = 1; i <= workerCount; i++)
+        workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        running = false;
+    }
+    wakeUp.notify_all();
+
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+unsigned int JobSystem::currentQueue() const
+{
+    return workerIdentity.system == this ? workerIdentity.queue : 0;
+}
+
+void JobSystem::run(JobFunction job, JobCounter* counter)
+{
+    if (counter)
+        counter->value.fetch_add(1, std::memory_order_relaxed);
+
+    Job entry = { std::move(job), counter };
+    push(std::move(entry));
+}
+
+void JobSystem::runAfter(JobCounter& dependency, JobFunction job, JobCounter* counter)
+{
+    if (counter)
+        counter->value.fetch_add(1, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(dependency.mutex);
+        if (!dependency.isDone())
+        {
+            JobCounter::Continuation continuation = { std::move(job), counter };
+            dependency.continuations.push_back(std::move(continuation));
+            return;
+        }
+    }
+
+    Job entry = { std::move(job), counter };
+    push(std::move(entry));
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+    unsigned int queue = currentQueue();
+    while (!counter.isDone())
+    {
+        if (!runOne(queue))
+            std::this_thread::yield();
+    }
+
+    // Let the job that finished the counter leave it before the caller may destroy it
+    std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+bool JobSystem::help()
+{
+    return runOne(currentQueue());
+}
+
+void JobSystem::parallelFor(size_t begin, size_t end, size_t grainSize, const RangeFunction& body)
+{
+    if (end <= begin) return;
+
+    size_t count = end - begin;
+    grainSize = std::max<size_t>(grainSize, 1);
+    if (count <= grainSize || queues.size() == 1)
+    {
+        body(begin, end);
+        return;
+    }
+
+    // A few chunks per thread leaves room for stealing when chunks take uneven time
+    size_t maxChunks = queues.size() * 4;
+    size_t chunkSize = std::max(grainSize, (count + maxChunks - 1) / maxChunks);
+
+    JobCounter counter;
+    for (size_t chunkBegin = begin + chunkSize; chunkBegin < end; chunkBegin += chunkSize)
+    {
+        size_t chunkEnd = std::min(chunkBegin + chunkSize, end);
+        run([&body, chunkBegin, chunkEnd]() { body(chunkBegin, chunkEnd); }, &counter);
+    }
+
+    body(begin, std::min(begin + chunkSize, end));
+    wait(counter);
+}
+
+void JobSystem::push(Job job)
+{
+    WorkQueue& queue = *queues[currentQueue()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        queuedJobs.fetch_add(1, std::memory_order_release);
+    }
+    wakeUp.notify_one();
+}
+
+bool JobSystem::pop(unsigned int queue, Job& job)
+{
+    WorkQueue& own = *queues[queue];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (own.jobs.empty())
+        return false;
+
+    // Newest first: its data is most likely still in this core's cache
+    job = std::move(own.jobs.back());
+    own.jobs.pop_back();
+    queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool JobSystem::steal(unsigned int thief, Job& job)
+{
+    for (unsigned int i = 1; i < queues.size(); i++)
+    {
+        WorkQueue& victim = *queues[(thief + i) % queues.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.jobs.empty())
+            continue;
+
+        // Oldest first: it tends to be the biggest piece of remaining work
+        job = std::move(victim.jobs.front());
+        victim.jobs.pop_front();
+        queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+bool JobSystem::runOne(unsigned int queue)
+{
+    Job job;
+    if (!pop(queue, job) && !steal(queue, job))
+        return false;
+
+    execute(job);
+    return true;
+}
+
+void JobSystem::execute(Job& job)
+{
+    {
+        PROFILE_SCOPE("Job");
+        job.function();
+    }
+    finish(job.counter);
+}
+
+void JobSystem::finish(JobCounter* counter)
+{
+    if (!counter) return;
+
+    // The counter may be destroyed as soon as a waiter sees it at zero, so it is only
+    // touched under its mutex, which wait() takes once before returning
+    std::vector<JobCounter::Continuation> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        if (counter->value.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            ready.swap(counter->continuations);
+    }
+
+    for (JobCounter::Continuation& continuation : ready)
+    {
+        Job entry = { std::move(continuation.function), continuation.counter };
+        push(std::move(entry));
+    }
+}
+
+void JobSystem::workerLoop(unsigned int index)
+{
+    workerIdentity.system = this;
+    workerIdentity.queue = index;
+    PROFILE_THREAD("Job worker");
+
+    while (running)
+    {
+        if (runOne(index))
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this]() { return queuedJobs.load(std::memory_order_acquire) > 0 || !running; });
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+// Counts unfinished jobs of a group. Jobs can be made to depend on a counter;
+// they are only queued once the counter drops to zero.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool isDone() const
+    {
+        return value.load(std::memory_order_acquire) == 0;
+    }
+
+private:
+    friend class JobSystem;
+
+    struct Continuation
+    {
+        std::function<void()> function;
+        JobCounter* counter;
+    };
+
+    std::atomic<int> value{ 0 };
+    std::mutex mutex;
+    std::vector<Continuation> continuations;
+};
+
+// Work-stealing job system. Every worker, and the thread that created the system,
+// owns a deque: it pushes and pops its own jobs at the back while idle workers
+// steal from the front of the others.
+class JobSystem
+{
+public:
+    typedef std::function<void()> JobFunction;
+    typedef std::function<void(size_t begin, size_t end)> RangeFunction;
+
+    // workerCount of 0 uses one worker per hardware thread, besides the calling thread
+    explicit JobSystem(unsigned int workerCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Queues a job; counter, when given, is decremented once the job finished
+    void run(JobFunction job, JobCounter* counter = nullptr);
+    // Queues a job that only starts after every job counted by dependency has finished
+    void runAfter(JobCounter& dependency, JobFunction job, JobCounter* counter = nullptr);
+    // Runs other jobs on the calling thread until the counter reaches zero
+    void wait(JobCounter& counter);
+    // Runs one queued job on the calling thread; false when there was none
+    bool help();
+
+    // Splits [begin, end) into contiguous chunks of at least grainSize and runs them in parallel.
+    // Returns once the whole range is done.
+    void parallelFor(size_t begin, size_t end, size_t grainSize, const RangeFunction& body);
+
+    // Workers plus the owning thread
+    unsigned int getThreadCount() const
+    {
+        return (unsigned int)queues.size();
+    }
+
+private:
+    struct Job
+    {
+        JobFunction function;
+        JobCounter* counter;
+    };
+
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+
+    std::atomic<bool> running{ true };
+    std::atomic<int> queuedJobs{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+
+    unsigned int currentQueue() const;
+    void push(Job job);
+    bool pop(unsigned int queue, Job& job);
+    bool steal(unsigned int thief, Job& job);
+    bool runOne(unsigned int queue);
+    void execute(Job& job);
+    void finish(JobCounter* counter);
+    void workerLoop(unsigned int index);
+};
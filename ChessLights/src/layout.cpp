@@ -0,0 +1,58 @@
+#include "layout.h"
+
+#include <cmath>
+#include <cstring>
+
+bool parsePlacement(const std::string& fen, std::vector<PiecePlacement>& placements)
+{
+    placements.clear();
+
+    int rank = 7;
+    int file = 0;
+    for (char c : fen)
+    {
+        // Anything after the placement field (side to move, castling, ...) is ignored
+        if (c == ' ')
+            break;
+
+        if (c == '/')
+        {
+            if (file != 8 || rank == 0)
+                return false;
+            rank--;
+            file = 0;
+        }
+        else if (c >= '1' && c <= '8')
+        {
+            file += c - '0';
+            if (file > 8)
+                return false;
+        }
+        else if (c != '\0' && std::strchr("KQRBNPkqrbnp", c))
+        {
+            if (file >= 8)
+                return false;
+            PiecePlacement placement = { c, file, rank };
+            placements.push_back(placement);
+            file++;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return rank == 0 && file == 8;
+}
+
+glm::vec3 squarePosition(int file, int rank)
+{
+    return glm::vec3(((float)file - 3.5f) * boardSquareSize, 0.0f, (3.5f - (float)rank) * boardSquareSize);
+}
+
+bool squareAt(const glm::vec3& point, int& file, int& rank)
+{
+    file = (int)std::floor(point.x / boardSquareSize + 4.0f);
+    rank = (int)std::floor(4.0f - point.z / boardSquareSize);
+    return file >= 0 && file < 8 && rank >= 0 && rank < 8;
+}
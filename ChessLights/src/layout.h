@@ -0,0 +1,27 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// Board squares: 3.1962 model units at the board's 0.5 scale, the 8x8 field centered on the origin.
+// Files a-h run along +x and white's first rank is on the +z side; the playing surface is at y = 0.
+const float boardSquareSize = 1.5981f;
+
+struct PiecePlacement
+{
+    // FEN letter: upper case for white, lower case for black
+    char piece;
+    // 0-7 for files a-h and ranks 1-8
+    int file;
+    int rank;
+};
+
+// Parses the piece placement field of a FEN string, e.g. "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR".
+// Returns false if the field is malformed.
+bool parsePlacement(const std::string& fen, std::vector<PiecePlacement>& placements);
+
+glm::vec3 squarePosition(int file, int rank);
+// Square under a point of the board's space; false off the 8x8 field
+bool squareAt(const glm::vec3& point, int& file, int& rank);
@@ -0,0 +1,288 @@
+#include "lightbaker.h"
+#include "noise.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+namespace
+{
+    // Rays leave this far above the surface, against hitting the triangle they start on
+    const float rayBias = 0.005f;
+    // Texels the lightmap is grown by around each chart, so bilinear lookups at chart borders stay lit
+    const int dilationPasses = 2;
+    const int sampleGridSide = 8;
+    const float pi = 3.14159265f;
+
+    inline float edgeFunction(const glm::vec2& a, const glm::vec2& b, const glm::vec2& p)
+    {
+        return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+    }
+}
+
+void LightBaker::rasterize(const BakeInstance& instance, int width, std::vector<Texel>& texels, std::vector<uint8_t>& covered) const
+{
+    const float size = (float)instance.model->lightmapSize;
+    const glm::vec2 corner((float)instance.x, (float)instance.y);
+    glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(instance.world));
+
+    for (const Mesh& mesh : instance.model->meshes)
+    {
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            const Vertex* corners[3] = { &mesh.vertices[mesh.indices[i]], &mesh.vertices[mesh.indices[i + 1]], &mesh.vertices[mesh.indices[i + 2]] };
+            glm::vec2 uv[3];
+            glm::vec3 position[3];
+            glm::vec3 normal[3];
+            for (int c = 0; c < 3; c++)
+            {
+                uv[c] = corner + corners[c]->LightmapCoords * size;
+                position[c] = glm::vec3(instance.world * glm::vec4(corners[c]->Position, 1.0f));
+                normal[c] = normalMatrix * corners[c]->Normal;
+            }
+
+            float area = edgeFunction(uv[0], uv[1], uv[2]);
+            if (std::abs(area) < 1e-12f)
+                continue;
+            glm::vec3 faceNormal = glm::cross(position[1] - position[0], position[2] - position[0]);
+            if (glm::length(faceNormal) < 1e-12f)
+                continue;
+            faceNormal = glm::normalize(faceNormal);
+            if (glm::dot(faceNormal, normal[0] + normal[1] + normal[2]) < 0.0f)
+                faceNormal = -faceNormal;
+
+            glm::vec2 low = glm::min(uv[0], glm::min(uv[1], uv[2]));
+            glm::vec2 high = glm::max(uv[0], glm::max(uv[1], uv[2]));
+            int x0 = std::max(0, (int)std::floor(low.x));
+            int y0 = std::max(0, (int)std::floor(low.y));
+            int x1 = std::min(instance.x + instance.model->lightmapSize - 1, (int)std::ceil(high.x));
+            int y1 = std::min(instance.y + instance.model->lightmapSize - 1, (int)std::ceil(high.y));
+            for (int y = y0; y <= y1; y++)
+            {
+                for (int x = x0; x <= x1; x++)
+                {
+                    // Texels belong to the triangle covering their centre
+                    glm::vec2 center((float)x + 0.5f, (float)y + 0.5f);
+                    float w0 = edgeFunction(uv[1], uv[2], center) / area;
+                    float w1 = edgeFunction(uv[2], uv[0], center) / area;
+                    float w2 = 1.0f - w0 - w1;
+                    if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                        continue;
+                    uint32_t pixel = (uint32_t)(y * width + x);
+                    if (covered[pixel])
+                        continue;
+                    covered[pixel] = 1;
+
+                    Texel texel;
+                    texel.position = position[0] * w0 + position[1] * w1 + position[2] * w2;
+                    glm::vec3 interpolated = normal[0] * w0 + normal[1] * w1 + normal[2] * w2;
+                    texel.normal = glm::length(interpolated) > 1e-12f ? glm::normalize(interpolated) : faceNormal;
+                    texel.faceNormal = faceNormal;
+                    texel.pixel = pixel;
+                    texels.push_back(texel);
+                }
+            }
+        }
+    }
+}
+
+glm::vec4 LightBaker::shade(const Texel& texel, const LightProperty& lights, uint64_t& rays) const
+{
+    glm::vec3 origin = texel.position + texel.faceNormal * rayBias;
+    glm::vec3 normal = texel.normal;
+    glm::vec3 reference = std::abs(normal.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    glm::vec3 tangent = glm::normalize(glm::cross(reference, normal));
+    glm::vec3 bitangent = glm::cross(normal, tangent);
+    glm::vec3 toSun = glm::normalize(-lights.dirLight.direction);
+
+    // Hemisphere: cosine-weighted, jittered inside an 8x8 grid of strata. Four rays per packet
+    // for the samples, four more for the sun as seen from whatever they hit.
+    Random random(texel.pixel);
+    int unoccluded = 0;
+    float bounce = 0.0f;
+    for (int sample = 0; sample < samplesPerTexel; sample += 4)
+    {
+        Ray packet[4];
+        for (int lane = 0; lane < 4; lane++)
+        {
+            int index = sample + lane;
+            float u1 = ((float)(index / sampleGridSide) + random.nextFloat(0.0f, 1.0f)) / sampleGridSide;
+            float u2 = ((float)(index % sampleGridSide) + random.nextFloat(0.0f, 1.0f)) / sampleGridSide;
+            float radius = std::sqrt(u1);
+            float angle = 2.0f * pi * u2;
+            packet[lane].origin = origin;
+            packet[lane].direction = tangent * (radius * std::cos(angle)) + bitangent * (radius * std::sin(angle))
+                + normal * std::sqrt(std::max(0.0f, 1.0f - u1));
+        }
+        RayHit hits[4];
+        bvh.intersect4(packet, hits);
+
+        Ray sunRays[4];
+        float cosines[4] = {};
+        for (int lane = 0; lane < 4; lane++)
+        {
+            sunRays[lane].tMax = 0.0f;
+            if (!hits[lane].isHit() || hits[lane].t > aoRadius)
+                unoccluded++;
+            if (!hits[lane].isHit())
+                continue;
+
+            glm::vec3 hitNormal = bvh.getNormal(hits[lane].triangle);
+            if (glm::dot(hitNormal, packet[lane].direction) > 0.0f)
+                hitNormal = -hitNormal;
+            cosines[lane] = glm::dot(hitNormal, toSun);
+            if (cosines[lane] <= 0.0f)
+                continue;
+            sunRays[lane].origin = origin + packet[lane].direction * hits[lane].t + hitNormal * rayBias;
+            sunRays[lane].direction = toSun;
+            sunRays[lane].tMax = 1e30f;
+        }
+        bool blocked[4];
+        bvh.occluded4(sunRays, blocked);
+        for (int lane = 0; lane < 4; lane++)
+        {
+            if (sunRays[lane].tMax > 0.0f && !blocked[lane])
+                bounce += cosines[lane];
+        }
+        rays += 8;
+    }
+
+    // Direct light: the sun and every point light, four shadow rays at a time
+    std::vector<Ray> shadowRays(1 + lights.pointLights.size());
+    std::vector<float> weights(shadowRays.size(), 0.0f);
+    std::vector<float> ambient(shadowRays.size(), 0.0f);
+    shadowRays[0].origin = origin;
+    shadowRays[0].direction = toSun;
+    weights[0] = std::max(glm::dot(normal, toSun), 0.0f);
+    for (size_t i = 0; i < lights.pointLights.size(); i++)
+    {
+        const PointLight& light = lights.pointLights[i];
+        glm::vec3 toLight = light.position - origin;
+        float distance = glm::length(toLight);
+        float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+        // The shader scales the sum with the diffuse colour, so the ambient term goes in relative to it
+        float diffuseSum = light.diffuse.x + light.diffuse.y + light.diffuse.z;
+        float ambientShare = diffuseSum > 0.0f ? (light.ambient.x + light.ambient.y + light.ambient.z) / diffuseSum : 0.0f;
+
+        Ray& ray = shadowRays[i + 1];
+        ray.origin = origin;
+        ray.direction = distance > 0.0f ? toLight / distance : normal;
+        ray.tMax = distance;
+        weights[i + 1] = attenuation * std::max(glm::dot(normal, ray.direction), 0.0f);
+        ambient[i + 1] = attenuation * ambientShare;
+    }
+
+    float sun = 0.0f;
+    float points = 0.0f;
+    for (size_t first = 0; first < shadowRays.size(); first += 4)
+    {
+        Ray packet[4];
+        for (size_t lane = 0; lane < 4; lane++)
+        {
+            packet[lane].tMax = 0.0f;
+            if (first + lane < shadowRays.size() && weights[first + lane] > 0.0f)
+                packet[lane] = shadowRays[first + lane];
+        }
+        bool blocked[4];
+        bvh.occluded4(packet, blocked);
+        for (size_t lane = 0; lane < 4 && first + lane < shadowRays.size(); lane++)
+        {
+            size_t index = first + lane;
+            float lit = packet[lane].tMax > 0.0f && !blocked[lane] ? weights[index] : 0.0f;
+            if (index == 0)
+                sun = lit;
+            else
+                points += lit + ambient[index];
+        }
+        rays += 4;
+    }
+
+    float ao = (float)unoccluded / samplesPerTexel;
+    return glm::vec4(ao, sun, points * 0.5f, albedo * bounce / samplesPerTexel);
+}
+
+std::vector<uint8_t> LightBaker::bake(const std::vector<BakeInstance>& instances, int width, int height, const LightProperty& lights)
+{
+    PROFILE_SCOPE("LightBaker::bake");
+    std::vector<BvhTriangle> triangles;
+    for (size_t i = 0; i < instances.size(); i++)
+    {
+        for (const Mesh& mesh : instances[i].model->meshes)
+        {
+            for (size_t v = 0; v + 2 < mesh.indices.size(); v += 3)
+            {
+                BvhTriangle triangle;
+                triangle.v0 = glm::vec3(instances[i].world * glm::vec4(mesh.vertices[mesh.indices[v]].Position, 1.0f));
+                triangle.v1 = glm::vec3(instances[i].world * glm::vec4(mesh.vertices[mesh.indices[v + 1]].Position, 1.0f));
+                triangle.v2 = glm::vec3(instances[i].world * glm::vec4(mesh.vertices[mesh.indices[v + 2]].Position, 1.0f));
+                triangle.id = (uint32_t)i;
+                triangles.push_back(triangle);
+            }
+        }
+    }
+    bvh.build(triangles);
+
+    std::vector<uint8_t> covered((size_t)width * height, 0);
+    std::vector<Texel> texels;
+    for (const BakeInstance& instance : instances)
+        rasterize(instance, width, texels, covered);
+    texelCount = texels.size();
+
+    // Texels nothing covers keep full ambient light, in case a lookup still strays onto them
+    std::vector<glm::vec4> values((size_t)width * height, glm::vec4(1.0f, 0.0f, 0.0f, 0.0f));
+    std::atomic<uint64_t> rays{ 0 };
+    jobs.parallelFor(0, texels.size(), 64, [&](size_t begin, size_t end)
+    {
+        PROFILE_SCOPE("LightBaker::shade");
+        uint64_t traced = 0;
+        for (size_t i = begin; i < end; i++)
+            values[texels[i].pixel] = shade(texels[i], lights, traced);
+        rays += traced;
+    });
+    rayCount = rays;
+
+    // Grow every chart into its gutter with the average of its covered neighbours
+    for (int pass = 0; pass < dilationPasses; pass++)
+    {
+        std::vector<uint8_t> grown = covered;
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                size_t pixel = (size_t)y * width + x;
+                if (covered[pixel])
+                    continue;
+                glm::vec4 sum(0.0f);
+                int count = 0;
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    for (int dx = -1; dx <= 1; dx++)
+                    {
+                        int nx = x + dx;
+                        int ny = y + dy;
+                        if (nx < 0 || ny < 0 || nx >= width || ny >= height || !covered[(size_t)ny * width + nx])
+                            continue;
+                        sum += values[(size_t)ny * width + nx];
+                        count++;
+                    }
+                }
+                if (count == 0)
+                    continue;
+                values[pixel] = sum / (float)count;
+                grown[pixel] = 1;
+            }
+        }
+        covered.swap(grown);
+    }
+
+    std::vector<uint8_t> rgba((size_t)width * height * 4);
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        for (int c = 0; c < 4; c++)
+            rgba[i * 4 + c] = (uint8_t)(glm::clamp(values[i][c], 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+    return rgba;
+}
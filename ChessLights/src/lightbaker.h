@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "bvh.h"
+#include "jobsystem.h"
+#include "model.h"
+#include "object.h"
+
+// One object in the lightmap atlas
+struct BakeInstance
+{
+    const Model* model;
+    glm::mat4 world;
+    // Corner of the object's square in the atlas, in texels; the side is model->lightmapSize
+    int x = 0;
+    int y = 0;
+};
+
+// Ray traces the lighting of static geometry into an RGBA8 atlas, on every thread of the job system.
+// The instances are both what gets baked and what casts shadows and bounces light, so dynamic
+// objects must not be among them. Lights are taken as fixed in place; only their colours may
+// change later, which is why the channels hold factors the shader multiplies colours with:
+//   r  ambient occlusion within aoRadius
+//   g  sun, N.L times visibility
+//   b  point lights, attenuation times (N.L times visibility plus their ambient share), halved
+//   a  sun light bounced once off the scene
+class LightBaker
+{
+public:
+    static const int samplesPerTexel = 64;
+    static constexpr float aoRadius = 1.0f;
+    // Grey the bounced light is reflected with, the bake does not look at textures
+    static constexpr float albedo = 0.5f;
+
+    explicit LightBaker(JobSystem& jobs) : jobs(jobs)
+    {
+    }
+
+    std::vector<uint8_t> bake(const std::vector<BakeInstance>& instances, int width, int height, const LightProperty& lights);
+
+    size_t texelCount = 0;
+    uint64_t rayCount = 0;
+
+private:
+    struct Texel
+    {
+        glm::vec3 position;
+        glm::vec3 normal;
+        // Side of the surface the rays start from, by the triangle's winding
+        glm::vec3 faceNormal;
+        uint32_t pixel;
+    };
+
+    JobSystem& jobs;
+    Bvh bvh;
+
+    void rasterize(const BakeInstance& instance, int width, std::vector<Texel>& texels, std::vector<uint8_t>& covered) const;
+    glm::vec4 shade(const Texel& texel, const LightProperty& lights, uint64_t& rays) const;
+};
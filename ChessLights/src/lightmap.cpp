@@ -0,0 +1,204 @@
+#include "lightmap.h"
+#include "lightbaker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+const char lightmapMagic[4] = { 'C', 'L', 'L', 'M' };
+const uint32_t lightmapVersion = 1;
+const int maxAtlasSize = 8192;
+
+static uint32_t vertexCount(const Model& model)
+{
+    size_t count = 0;
+    for (const Mesh& mesh : model.meshes)
+        count += mesh.vertices.size();
+    return (uint32_t)count;
+}
+
+// Shelf packing of the objects' squares, largest first, into the narrowest power of two wide
+// atlas that is not taller than wide
+static bool placeInstances(const std::vector<IluminatedObject*>& objects, std::vector<BakeInstance>& instances,
+    int& width, int& height)
+{
+    instances.resize(objects.size());
+    std::vector<size_t> order;
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        instances[i].model = &objects[i]->model;
+        instances[i].world = objects[i]->transform.getWorld();
+        if (objects[i]->model.lightmapSize > 0)
+            order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        return objects[a]->model.lightmapSize > objects[b]->model.lightmapSize;
+    });
+
+    for (width = 256; width <= maxAtlasSize; width *= 2)
+    {
+        int x = 0;
+        int y = 0;
+        int shelfHeight = 0;
+        bool fits = true;
+        for (size_t index : order)
+        {
+            int size = objects[index]->model.lightmapSize;
+            if (size > width)
+            {
+                fits = false;
+                break;
+            }
+            if (x + size > width)
+            {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+            }
+            instances[index].x = x;
+            instances[index].y = y;
+            x += size;
+            shelfHeight = std::max(shelfHeight, size);
+        }
+        height = y + shelfHeight;
+        if (fits && height <= width)
+        {
+            height = std::max(4, (height + 3) & ~3);
+            return true;
+        }
+    }
+    return false;
+}
+
+Lightmap::~Lightmap()
+{
+    glDeleteTextures(1, &texture);
+}
+
+bool Lightmap::bake(JobSystem& jobs, const std::vector<IluminatedObject*>& objects, const LightProperty& lights,
+    const std::string& path)
+{
+    std::vector<BakeInstance> instances;
+    int width = 0;
+    int height = 0;
+    if (!placeInstances(objects, instances, width, height))
+    {
+        std::cout << "ERROR::LIGHTMAP::ATLAS_TOO_LARGE" << std::endl;
+        return false;
+    }
+
+    std::cout << "Baking a " << width << "x" << height << " lightmap for " << objects.size() << " objects on "
+        << jobs.getThreadCount() << " threads..." << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    LightBaker baker(jobs);
+    std::vector<uint8_t> pixels = baker.bake(instances, width, height, lights);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Lightmap baked: " << baker.texelCount << " texels, " << baker.rayCount / 1000000 << " million rays in "
+        << seconds << " s" << std::endl;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cout << "ERROR::LIGHTMAP::CANNOT_OPEN_FOR_WRITING: " << path << std::endl;
+        return false;
+    }
+
+    // Header, then x, y, size and vertex count of every object, then the RGBA rows
+    uint32_t header[3] = { (uint32_t)width, (uint32_t)height, (uint32_t)objects.size() };
+    file.write(lightmapMagic, sizeof(lightmapMagic));
+    file.write(reinterpret_cast<const char*>(&lightmapVersion), sizeof(lightmapVersion));
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        uint32_t record[4] = { (uint32_t)instances[i].x, (uint32_t)instances[i].y,
+            (uint32_t)objects[i]->model.lightmapSize, vertexCount(objects[i]->model) };
+        file.write(reinterpret_cast<const char*>(record), sizeof(record));
+    }
+    file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+    if (!file)
+    {
+        std::cout << "ERROR::LIGHTMAP::WRITE_FAILED: " << path << std::endl;
+        return false;
+    }
+
+    std::cout << "Lightmap written to " << path << std::endl;
+    return true;
+}
+
+bool Lightmap::load(const std::string& path, const std::vector<IluminatedObject*>& objects)
+{
+    // Without a bake the objects are simply lit per fragment, as before
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    char magic[4] = {};
+    uint32_t version = 0;
+    uint32_t header[3] = {};
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!file || std::memcmp(magic, lightmapMagic, sizeof(magic)) != 0 || version != lightmapVersion
+        || header[0] == 0 || header[1] == 0 || header[0] > (uint32_t)maxAtlasSize || header[1] > (uint32_t)maxAtlasSize)
+    {
+        std::cout << "ERROR::LIGHTMAP::INVALID_FILE: " << path << std::endl;
+        return false;
+    }
+
+    int width = (int)header[0];
+    int height = (int)header[1];
+    std::vector<glm::vec4> rects(objects.size());
+    bool matches = header[2] == objects.size();
+    for (size_t i = 0; matches && i < objects.size(); i++)
+    {
+        uint32_t record[4] = {};
+        file.read(reinterpret_cast<char*>(record), sizeof(record));
+        const Model& model = objects[i]->model;
+        // Same vertex count and layout size: the model, and so its lightmap coordinates, did not change
+        matches = file && record[2] == (uint32_t)model.lightmapSize && record[3] == vertexCount(model)
+            && record[0] + record[2] <= (uint32_t)width && record[1] + record[2] <= (uint32_t)height;
+        if (record[2] > 0)
+            rects[i] = glm::vec4((float)record[2] / width, (float)record[2] / height, (float)record[0] / width, (float)record[1] / height);
+    }
+    if (!matches)
+    {
+        std::cout << "ERROR::LIGHTMAP::STALE: " << path << " was baked for other objects, bake it again with --bake" << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> pixels((size_t)width * height * 4);
+    file.read(reinterpret_cast<char*>(pixels.data()), pixels.size());
+    if (!file)
+    {
+        std::cout << "ERROR::LIGHTMAP::INVALID_FILE: " << path << std::endl;
+        return false;
+    }
+
+    glDeleteTextures(1, &texture);
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    // No mipmaps: smaller levels would blend charts with their neighbours
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    for (size_t i = 0; i < objects.size(); i++)
+        objects[i]->lightmapRect = rects[i];
+    return true;
+}
+
+void Lightmap::configure(const Shader& shader) const
+{
+    glActiveTexture(GL_TEXTURE0 + lightmapTextureUnit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.setBool("bakedLighting", texture != 0);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+#include "jobsystem.h"
+#include "object.h"
+#include "shader.h"
+
+// Texture unit the lightmap is bound to, next to the shadow maps
+const int lightmapTextureUnit = 14;
+
+// Baked lighting of the static objects, one atlas for all of them. Each object gets a square of
+// its model's lightmap size; its lightmapRect tells the shader where. With the lightmap on, the
+// sun and the point lights of those objects are a texture fetch (see LightBaker for what the
+// channels hold) and only the spotlight, highlights and dynamic shadows are lit per fragment.
+class Lightmap
+{
+public:
+    Lightmap() = default;
+    ~Lightmap();
+
+    Lightmap(const Lightmap&) = delete;
+    Lightmap& operator=(const Lightmap&) = delete;
+
+    // Traces the atlas for the objects with every thread of the job system and saves it
+    static bool bake(JobSystem& jobs, const std::vector<IluminatedObject*>& objects, const LightProperty& lights,
+        const std::string& path);
+
+    // Loads an atlas baked for the same objects, in the same order, and points their lightmapRect into it.
+    // False, leaving the objects lit per fragment, when there is none or it was baked for other objects.
+    bool load(const std::string& path, const std::vector<IluminatedObject*>& objects);
+
+    // Binds the atlas and turns baked lighting on for a program
+    void configure(const Shader& shader) const;
+
+    bool isLoaded() const
+    {
+        return texture != 0;
+    }
+
+private:
+    GLuint texture = 0;
+};
@@ -0,0 +1,237 @@
+#include "lightmapuv.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <utility>
+
+namespace
+{
+    // Texels per model unit; the pieces and the board are drawn at half scale
+    const float texelsPerUnit = 16.0f;
+    // Empty texels around each chart, so bilinear lookups stay inside it
+    const int chartPadding = 2;
+    const int minLayoutSize = 16;
+    const int maxLayoutSize = 1024;
+    // cos(45 degrees)
+    const float chartCosine = 0.7071f;
+
+    struct Chart
+    {
+        size_t mesh;
+        glm::vec3 axisU;
+        glm::vec3 axisV;
+        glm::vec2 boundsMin = glm::vec2(1e30f);
+        glm::vec2 boundsMax = glm::vec2(-1e30f);
+        // Placement in texels, padding included
+        int x = 0;
+        int y = 0;
+        int width = 0;
+        int height = 0;
+    };
+
+    struct PositionHash
+    {
+        size_t operator()(const glm::vec3& position) const
+        {
+            uint32_t bits[3];
+            std::memcpy(bits, &position, sizeof(bits));
+            return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+        }
+    };
+
+    // Charts of one mesh; chartOf gets the chart index of every triangle
+    void findCharts(size_t meshIndex, const MeshData& mesh, std::vector<Chart>& charts, std::vector<uint32_t>& chartOf)
+    {
+        size_t triangleCount = mesh.indices.size() / 3;
+        chartOf.assign(triangleCount, UINT32_MAX);
+
+        // Triangles split at texture seams still share positions, so edges are matched by position
+        std::unordered_map<glm::vec3, uint32_t, PositionHash> welded;
+        std::vector<uint32_t> positionId(mesh.vertices.size());
+        for (size_t i = 0; i < mesh.vertices.size(); i++)
+            positionId[i] = welded.emplace(mesh.vertices[i].Position, (uint32_t)welded.size()).first->second;
+
+        std::vector<std::pair<uint64_t, uint32_t>> edges;
+        edges.reserve(triangleCount * 3);
+        std::vector<glm::vec3> normals(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const glm::vec3& a = mesh.vertices[mesh.indices[t * 3]].Position;
+            const glm::vec3& b = mesh.vertices[mesh.indices[t * 3 + 1]].Position;
+            const glm::vec3& c = mesh.vertices[mesh.indices[t * 3 + 2]].Position;
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float length = glm::length(normal);
+            // Degenerate triangles get no normal and join whichever chart reaches them
+            normals[t] = length > 1e-12f ? normal / length : glm::vec3(0.0f);
+
+            for (int corner = 0; corner < 3; corner++)
+            {
+                uint64_t from = positionId[mesh.indices[t * 3 + corner]];
+                uint64_t to = positionId[mesh.indices[t * 3 + (corner + 1) % 3]];
+                edges.push_back({ std::min(from, to) << 32 | std::max(from, to), (uint32_t)t });
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+
+        std::vector<std::vector<uint32_t>> neighbours(triangleCount);
+        for (size_t first = 0; first < edges.size();)
+        {
+            size_t last = first;
+            while (last < edges.size() && edges[last].first == edges[first].first)
+                last++;
+            for (size_t i = first; i < last; i++)
+            {
+                for (size_t j = first; j < last; j++)
+                {
+                    if (i != j)
+                        neighbours[edges[i].second].push_back(edges[j].second);
+                }
+            }
+            first = last;
+        }
+
+        std::vector<uint32_t> queue;
+        for (size_t seed = 0; seed < triangleCount; seed++)
+        {
+            if (chartOf[seed] != UINT32_MAX)
+                continue;
+
+            Chart chart;
+            chart.mesh = meshIndex;
+            glm::vec3 normal = normals[seed] == glm::vec3(0.0f) ? glm::vec3(0.0f, 0.0f, 1.0f) : normals[seed];
+            glm::vec3 reference = std::abs(normal.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+            chart.axisU = glm::normalize(glm::cross(reference, normal));
+            chart.axisV = glm::cross(normal, chart.axisU);
+
+            uint32_t chartIndex = (uint32_t)charts.size();
+            chartOf[seed] = chartIndex;
+            queue.assign(1, (uint32_t)seed);
+            // Every member faces within 45 degrees of the projection, so the chart cannot fold over
+            for (size_t next = 0; next < queue.size(); next++)
+            {
+                for (uint32_t neighbour : neighbours[queue[next]])
+                {
+                    if (chartOf[neighbour] != UINT32_MAX)
+                        continue;
+                    if (normals[neighbour] != glm::vec3(0.0f) && glm::dot(normals[neighbour], normal) < chartCosine)
+                        continue;
+                    chartOf[neighbour] = chartIndex;
+                    queue.push_back(neighbour);
+                }
+            }
+
+            for (uint32_t t : queue)
+            {
+                for (int corner = 0; corner < 3; corner++)
+                {
+                    const glm::vec3& position = mesh.vertices[mesh.indices[t * 3 + corner]].Position;
+                    glm::vec2 projected(glm::dot(position, chart.axisU), glm::dot(position, chart.axisV));
+                    chart.boundsMin = glm::min(chart.boundsMin, projected);
+                    chart.boundsMax = glm::max(chart.boundsMax, projected);
+                }
+            }
+            charts.push_back(chart);
+        }
+    }
+
+    // Shelf packing, tallest charts first; returns the side of the square that holds them
+    int packCharts(std::vector<Chart>& charts, float density)
+    {
+        long long area = 0;
+        int widest = 0;
+        for (Chart& chart : charts)
+        {
+            glm::vec2 size = (chart.boundsMax - chart.boundsMin) * density;
+            chart.width = std::max(1, (int)std::ceil(size.x)) + 2 * chartPadding;
+            chart.height = std::max(1, (int)std::ceil(size.y)) + 2 * chartPadding;
+            area += (long long)chart.width * chart.height;
+            widest = std::max(widest, chart.width);
+        }
+
+        std::vector<size_t> order(charts.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+        {
+            return charts[a].height != charts[b].height ? charts[a].height > charts[b].height : a < b;
+        });
+
+        // Shelves waste some space, a little more than the bare area makes them close to square
+        int rowWidth = std::max(widest, (int)std::ceil(std::sqrt((double)area) * 1.15));
+        int x = 0;
+        int y = 0;
+        int shelfHeight = 0;
+        for (size_t index : order)
+        {
+            Chart& chart = charts[index];
+            if (x + chart.width > rowWidth)
+            {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+            }
+            chart.x = x;
+            chart.y = y;
+            x += chart.width;
+            shelfHeight = std::max(shelfHeight, chart.height);
+        }
+
+        int size = std::max(std::max(rowWidth, y + shelfHeight), minLayoutSize);
+        return (size + 3) & ~3;
+    }
+}
+
+int generateLightmapCoords(std::vector<MeshData>& meshes)
+{
+    std::vector<Chart> charts;
+    std::vector<std::vector<uint32_t>> chartOf(meshes.size());
+    for (size_t m = 0; m < meshes.size(); m++)
+        findCharts(m, meshes[m], charts, chartOf[m]);
+    if (charts.empty())
+        return 0;
+
+    // Models too big for the largest layout get fewer texels per unit
+    float density = texelsPerUnit;
+    int size = packCharts(charts, density);
+    while (size > maxLayoutSize)
+    {
+        density *= (float)maxLayoutSize / size * 0.95f;
+        size = packCharts(charts, density);
+    }
+
+    for (size_t m = 0; m < meshes.size(); m++)
+    {
+        MeshData& mesh = meshes[m];
+        std::vector<Vertex> vertices;
+        vertices.reserve(mesh.vertices.size());
+        // (chart, original vertex) -> vertex carrying that chart's coordinates
+        std::unordered_map<uint64_t, unsigned int> split;
+        for (size_t i = 0; i < mesh.indices.size(); i++)
+        {
+            uint32_t chartIndex = chartOf[m][i / 3];
+            uint64_t key = (uint64_t)chartIndex << 32 | mesh.indices[i];
+            auto found = split.find(key);
+            if (found != split.end())
+            {
+                mesh.indices[i] = found->second;
+                continue;
+            }
+
+            const Chart& chart = charts[chartIndex];
+            Vertex vertex = mesh.vertices[mesh.indices[i]];
+            glm::vec2 projected(glm::dot(vertex.Position, chart.axisU), glm::dot(vertex.Position, chart.axisV));
+            glm::vec2 texel = (projected - chart.boundsMin) * density + glm::vec2((float)(chart.x + chartPadding), (float)(chart.y + chartPadding));
+            vertex.LightmapCoords = texel / (float)size;
+
+            unsigned int index = (unsigned int)vertices.size();
+            vertices.push_back(vertex);
+            split.emplace(key, index);
+            mesh.indices[i] = index;
+        }
+        mesh.vertices.swap(vertices);
+    }
+    return size;
+}
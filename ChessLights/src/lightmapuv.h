@@ -0,0 +1,14 @@
+#pragma once
+
+#include <vector>
+
+#include "mesh.h"
+
+// Lightmap coordinates for the meshes of one model, in a single square layout.
+// Connected triangles facing within 45 degrees of each other form a chart, projected flat
+// along the normal of its first triangle; the charts are then packed on shelves with a gutter
+// of a few texels at a fixed texel density. Vertices shared by two charts are split.
+//
+// The layout only depends on the geometry, so every load of a model gives the same coordinates
+// and a lightmap baked earlier still fits. Returns the texels along each side of the layout.
+int generateLightmapCoords(std::vector<MeshData>& meshes);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free triple buffer handing the latest value from one writer thread to one reader thread.
+// The writer fills back() and publishes it; the reader picks up the newest published value
+// with update() and reads it through front(). Neither side ever waits for the other,
+// and values the reader did not get to in time are simply skipped.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Writer side
+    T& back()
+    {
+        return buffers[backIndex];
+    }
+
+    void publish()
+    {
+        uint8_t previous = middle.exchange((uint8_t)(backIndex | freshBit), std::memory_order_acq_rel);
+        backIndex = previous & indexMask;
+    }
+
+    // Reader side, returns false when nothing new was published since the last call
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & freshBit))
+            return false;
+
+        uint8_t previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = previous & indexMask;
+        return true;
+    }
+
+    const T& front() const
+    {
+        return buffers[frontIndex];
+    }
+
+private:
+    static const uint8_t indexMask = 0x3;
+    static const uint8_t freshBit = 0x4;
+
+    T buffers[3];
+    uint8_t backIndex = 0;
+    std::atomic<uint8_t> middle{ 1 };
+    uint8_t frontIndex = 2;
+};
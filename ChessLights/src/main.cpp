@@ -1,8 +1,14 @@
 #include "scene.h"
 
-int main()
+int main(int argc, char* argv[])
 {
+    Options options;
+    if (!parseOptions(argc, argv, options))
+        return 1;
+
     Scene* scene = Scene::getInstance();
-    scene->run();
+    if (!scene->init(options))
+        return 1;
+    scene->run(options);
     return 0;
 }
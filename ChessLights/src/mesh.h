@@ -20,6 +20,8 @@ struct Vertex {
     glm::vec3 Bitangent;
     int m_BoneIDs[MAX_BONE_INFLUENCE];
     float m_Weights[MAX_BONE_INFLUENCE];
+    // Position in the model's lightmap layout, see lightmapuv.h
+    glm::vec2 LightmapCoords;
 };
 
 struct Texture {
@@ -28,6 +30,13 @@ struct Texture {
     string path;
 };
 
+// Geometry of a mesh as loaded, before it is uploaded
+struct MeshData {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    vector<Texture>      textures;
+};
+
 // Generic class to process most type of meshes
 class Mesh {
 public:
@@ -35,6 +44,10 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
     unsigned int VAO;
+    // Position-only stream, used by passes that need no shading attributes
+    unsigned int depthVAO;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
 
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
     {
@@ -46,6 +59,17 @@ public:
     }
 
     void Draw(Shader& shader)
+    {
+        bindTextures(shader);
+
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void bindTextures(const Shader& shader) const
     {
         unsigned int diffuseNr = 1;
         unsigned int specularNr = 1;
@@ -68,19 +92,34 @@ public:
             glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
+    }
 
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    // Texture used to group draws by material, 0 when the mesh is untextured
+    unsigned int materialTexture() const
+    {
+        return textures.empty() ? 0 : textures[0].id;
+    }
 
-        glActiveTexture(GL_TEXTURE0);
+    glm::vec3 boundsCenter() const
+    {
+        return (boundsMin + boundsMax) * 0.5f;
     }
 
 private:
-    unsigned int VBO, EBO;
+    unsigned int VBO, EBO, positionVBO;
 
     void setupMesh()
     {
+        boundsMin = glm::vec3(0.0f);
+        boundsMax = glm::vec3(0.0f);
+        if (!vertices.empty())
+            boundsMin = boundsMax = vertices[0].Position;
+        for (unsigned int i = 1; i < vertices.size(); i++)
+        {
+            boundsMin = glm::min(boundsMin, vertices[i].Position);
+            boundsMax = glm::max(boundsMax, vertices[i].Position);
+        }
+
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
@@ -108,6 +147,25 @@ private:
 
         glEnableVertexAttribArray(6);
         glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+        glEnableVertexAttribArray(7);
+        glVertexAttribPointer(7, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, LightmapCoords));
+        glBindVertexArray(0);
+
+        // tightly packed positions keep the depth-only pass light on vertex fetch
+        vector<glm::vec3> positions(vertices.size());
+        for (unsigned int i = 0; i < vertices.size(); i++)
+            positions[i] = vertices[i].Position;
+
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &positionVBO);
+
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
         glBindVertexArray(0);
     }
 };
\ No newline at end of file
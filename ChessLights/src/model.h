@@ -9,7 +9,9 @@
 #include <assimp/postprocess.h>
 
 #include "mesh.h"
+#include "lightmapuv.h"
 
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -28,6 +30,8 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    // Texels along each side of the lightmap of one instance
+    int lightmapSize = 0;
 
     Model(string const& path, bool gamma = false) : gammaCorrection(gamma)
     {
@@ -52,24 +56,30 @@ private:
         }
         directory = path.substr(0, path.find_last_of('/'));
 
-        processNode(scene->mRootNode, scene);
+        vector<MeshData> loaded;
+        processNode(scene->mRootNode, scene, loaded);
+
+        // Lightmap coordinates split vertices along chart borders, so they go in before the upload
+        lightmapSize = generateLightmapCoords(loaded);
+        for (unsigned int i = 0; i < loaded.size(); i++)
+            meshes.push_back(Mesh(loaded[i].vertices, loaded[i].indices, loaded[i].textures));
     }
 
-    void processNode(aiNode* node, const aiScene* scene)
+    void processNode(aiNode* node, const aiScene* scene, vector<MeshData>& loaded)
     {
         for (unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            loaded.push_back(processMesh(mesh, scene));
         }
         for (unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, loaded);
         }
 
     }
 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    MeshData processMesh(aiMesh* mesh, const aiScene* scene)
     {
         vector<Vertex> vertices;
         vector<unsigned int> indices;
@@ -137,8 +147,8 @@ private:
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data
+        return { vertices, indices, textures };
     }
 
     vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
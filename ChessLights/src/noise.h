@@ -0,0 +1,104 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <cstdint>
+
+// Integer hash shared with vibration.glsl; both sides must produce the same bits
+inline uint32_t hashUint(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Maps a hash to [-1, 1] using its top 24 bits, which a float holds exactly
+inline float hashSigned(uint32_t x)
+{
+    return (float)(hashUint(x) >> 8) * (2.0f / 16777216.0f) - 1.0f;
+}
+
+// Deterministic PRNG (PCG32). The same seed always gives the same sequence,
+// unlike std::random_device, and constructing one costs nothing.
+class Random
+{
+public:
+    explicit Random(uint64_t seed = 0x853c49e6748fea9bull)
+    {
+        state = 0;
+        nextUint();
+        state += seed;
+        nextUint();
+    }
+
+    uint32_t nextUint()
+    {
+        uint64_t old = state;
+        state = old * 6364136223846793005ull + increment;
+        uint32_t xorShifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+        uint32_t rotation = (uint32_t)(old >> 59u);
+        return (xorShifted >> rotation) | (xorShifted << ((32u - rotation) & 31u));
+    }
+
+    // Uniform in [min, max)
+    float nextFloat(float min, float max)
+    {
+        return min + (max - min) * (float)(nextUint() >> 8) * (1.0f / 16777216.0f);
+    }
+
+private:
+    static const uint64_t increment = 1442695040888963407ull;
+    uint64_t state;
+};
+
+// Procedural shaking. The vertex shaders evaluate it per vertex from the object's seed,
+// amplitude and the frame time, see vibration.glsl. The functions below are the
+// CPU reference of the same noise, for code that needs to know where a vibrating object is.
+struct Vibration
+{
+    // Changes of direction per second
+    static constexpr float frequency = 30.0f;
+
+    uint32_t seed = 0;
+    // Maximum tilt in degrees, 0 disables the effect
+    float amplitude = 0.0f;
+    // World-space point the object tilts around
+    glm::vec3 pivot = glm::vec3(0.0f);
+
+    // Smooth value noise in [-1, 1], continuous in time
+    static float noise(uint32_t seed, float time)
+    {
+        float t = time * frequency;
+        float cell = std::floor(t);
+        float f = t - cell;
+        f = f * f * (3.0f - 2.0f * f);
+
+        uint32_t i = (uint32_t)(int32_t)cell;
+        float a = hashSigned(seed ^ hashUint(i));
+        float b = hashSigned(seed ^ hashUint(i + 1u));
+        return a + (b - a) * f;
+    }
+
+    // Tilt around the world X and Z axes at the given time
+    glm::mat3 rotation(float time) const
+    {
+        if (amplitude == 0.0f)
+            return glm::mat3(1.0f);
+
+        float angleX = glm::radians(amplitude) * noise(hashUint(seed * 2u), time);
+        float angleZ = glm::radians(amplitude) * noise(hashUint(seed * 2u + 1u), time);
+        glm::mat4 tilt = glm::rotate(glm::mat4(1.0f), angleX, glm::vec3(1.0f, 0.0f, 0.0f));
+        tilt = glm::rotate(tilt, angleZ, glm::vec3(0.0f, 0.0f, 1.0f));
+        return glm::mat3(tilt);
+    }
+
+    glm::vec3 apply(const glm::vec3& worldPosition, float time) const
+    {
+        return pivot + rotation(time) * (worldPosition - pivot);
+    }
+};
@@ -1,13 +1,21 @@
 #include "object.h"
-#include "random"
+#include "profiler.h"
 #include "scene.h"
+#include "shadow.h"
+#include "shadowatlas.h"
+#include "lightmap.h"
+#include "volumetricfog.h"
+
+// Seeds only depend on construction order, so shaking looks the same on every run
+static Random vibrationSeeds;
 
 IluminatedObject::IluminatedObject(Shader& shader, Model& model) : shader(shader), model(model)
 {
+    vibration.seed = vibrationSeeds.nextUint();
 }
 
 
-void IluminatedObject::configureIlumination(const LightProperty& prop)
+void IluminatedObject::configureIlumination(const Shader& shader, const LightProperty& prop)
 {
     shader.setVec3("dirLight.direction", prop.dirLight.direction);
     shader.setVec3("dirLight.ambient", prop.dirLight.ambient);
@@ -24,83 +32,134 @@ void IluminatedObject::configureIlumination(const LightProperty& prop)
         shader.setFloat("pointLights[" + to_string(i) + "].linear", prop.pointLights[i].linear);
         shader.setFloat("pointLights[" + to_string(i) + "].quadratic", prop.pointLights[i].quadratic);
     }
+    // Spotlights are in the SpotLightData block, see uploadSpotLights
+}
+
+void IluminatedObject::configureFrame(const Shader& shader, const LightProperty& prop, const Conditions& conditions)
+{
+    configureIlumination(shader, prop);
+
+    shader.setVec3("skyColor", conditions.backgroundColor);
+    shader.setFloat("fogDensity", conditions.fogDensity);
+    shader.setBool("lightsOn", conditions.lightsOn);
+    shader.setBool("sphereOn", conditions.lightsOn);
+
+    shader.setInt("shadeMode", conditions.shadeMode);
+
+    // Off until ShadowMaps::configure turns them on; the sampler still needs a unit of its own
+    shader.setInt("shadowMaps", shadowTextureUnit);
+    shader.setInt("spotShadowAtlas", spotShadowTextureUnit);
+    shader.setBool("shadowsOn", false);
+    // Likewise until Lightmap::configure
+    shader.setInt("lightmap", lightmapTextureUnit);
+    shader.setBool("bakedLighting", false);
+    // And until VolumetricFog::configure
+    shader.setInt("fogVolume", fogTextureUnit);
+    shader.setBool("volumetricFog", false);
+}
+
+void IluminatedObject::submit(RenderQueue& queue, const Camera& camera, const Conditions& conditions)
+{
+    PROFILE_SCOPE("IluminatedObject::submit");
+    Vibration active = vibration;
+    if (conditions.objectShaking && vibration.amplitude != 0.0f)
+        active.pivot = getPivot();
+    else
+        active.amplitude = 0.0f;
+    // Shaking moves the object in the vertex shader, which the cached shadow layers never see
+    ShadowCaster activeCaster = caster == StaticCaster && active.amplitude != 0.0f ? DynamicCaster : caster;
 
-    for (int i = 0; i < prop.spotLights.size(); i++)
+    const glm::mat4& world = transform.getWorld();
+    const glm::mat4* previous = submitted ? &previousWorld : nullptr;
+    if (impostor && glm::distance(camera.Position, glm::vec3(world[3])) > impostorDistance)
     {
-        shader.setVec3("spotLights[" + to_string(i) + "].position", prop.spotLights[i].position);
-        shader.setVec3("spotLights[" + to_string(i) + "].direction", prop.spotLights[i].direction);
-        shader.setVec3("spotLights[" + to_string(i) + "].ambient", prop.spotLights[i].ambient);
-        shader.setVec3("spotLights[" + to_string(i) + "].diffuse", prop.spotLights[i].diffuse);
-        shader.setVec3("spotLights[" + to_string(i) + "].specular", prop.spotLights[i].specular);
-        shader.setFloat("spotLights[" + to_string(i) + "].constant", prop.spotLights[i].constant);
-        shader.setFloat("spotLights[" + to_string(i) + "].linear", prop.spotLights[i].linear);
-        shader.setFloat("spotLights[" + to_string(i) + "].quadratic", prop.spotLights[i].quadratic);
-        shader.setFloat("spotLights[" + to_string(i) + "].cutOff", prop.spotLights[i].cutOff);
-        shader.setFloat("spotLights[" + to_string(i) + "].outerCutOff", prop.spotLights[i].outerCutOff);
+        queue.submitImpostor(*impostor, world, material);
+        // The model still casts the shadow
+        queue.submit(ShadowPass, shader, this->model, world, material, active, activeCaster, lightmapRect, previous);
     }
+    else
+        queue.submit(OpaquePass, shader, this->model, world, material, active, activeCaster, lightmapRect, previous);
+    previousWorld = world;
+    submitted = true;
 }
 
-void IluminatedObject::draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController)
+bool IluminatedObject::submitImpostor(RenderQueue& queue)
 {
-    shader.use();
-    configureIlumination(prop);
-    shader.setMat4("projection", camera.getProjectionMatrix());
-    shader.setMat4("view", camera.getViewMatrix());
-    shader.setVec3("viewPos", camera.Position);
-
-    shader.setVec3("skyColor", conditionsController.getBackgroundColor());
-    shader.setFloat("fogDensity", conditionsController.getFogDensity());
-    shader.setBool("lightsOn", conditionsController.lightsOn);
+    if (!impostor)
+        return false;
+
+    const glm::mat4& world = transform.getWorld();
+    queue.submitImpostor(*impostor, world, material);
+    previousWorld = world;
+    submitted = true;
+    return true;
+}
 
-    shader.setInt("shadeMode", conditionsController.shadeMode);
+void IluminatedObject::attachTo(Transform& parent)
+{
+    transform.setParent(&parent);
+}
 
-    model.Draw(shader);
+glm::vec3 IluminatedObject::getPivot() const
+{
+    return glm::vec3(transform.getWorld()[3]);
 }
 
 WhiteKing::WhiteKing(Shader& shader, Model& model) : IluminatedObject(shader, model)
 {
-}
+    material.specular = { 0.54f, 0.54f, 0.54f };
+    material.shininess = 36.0f;
 
+    vibration.amplitude = 1.0f;
+    caster = DynamicCaster;
+    transform.setParent(&motion);
 
-float getRandomFloat() {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
-    return distribution(gen);
+    // first - set initial position
+    glm::mat4 pose = glm::mat4(1.0f);
+    pose = glm::rotate(pose, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    pose = glm::scale(pose, glm::vec3(0.5f, 0.5f, 0.5f));
+    transform.setLocal(pose);
+
+    updateMotion();
 }
 
-void WhiteKing::draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController)
+void WhiteKing::updateMotion()
 {
-    shader.use();
     glm::mat4 model = glm::mat4(1.0f);
 
     // third - move
     model = glm::translate(model, glm::vec3(0.0f, 0.0f, -offset));
 
     // second - translate to 0.0, rotate, and translate back
-    model = glm::translate(model, glm::vec3(1.0f, 0.0f, 8.0f));
+    model = glm::translate(model, pivot);
     model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    if (conditionsController.objectShaking)
-    {
-        model = glm::rotate(model, glm::radians(getRandomFloat()), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::rotate(model, glm::radians(getRandomFloat()), glm::vec3(0.0f, 0.0f, 1.0f));
-    }
+    model = glm::translate(model, -pivot);
 
-    model = glm::translate(model, glm::vec3(-1.0f, 0.0f, -8.0f));
+    motion.setLocal(model);
+}
 
-    // first - set initial position
-    model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
+void WhiteKing::attachTo(Transform& parent)
+{
+    motion.setParent(&parent);
+}
 
-    shader.setMat4("model", model);
+glm::vec3 WhiteKing::getPivot() const
+{
+    // The king tilts around the point it circles, as the shake used to
+    return glm::vec3(motion.getWorld() * glm::vec4(pivot, 1.0f));
+}
 
-    shader.setVec3("material.specular", 0.54f, 0.54f, 0.54f);
-    shader.setFloat("material.shininess", 36.0f);
+void WhiteKing::setMotion(float offset, float angle)
+{
+    if (offset == this->offset && angle == this->angle)
+        return;
 
-    IluminatedObject::draw(prop, camera, conditionsController);
+    this->offset = offset;
+    this->angle = angle;
+    updateMotion();
 }
 
-void WhiteKing::move(float deltaTime)
+void KingMotion::move(float deltaTime)
 {
     if (stop) return;
 
@@ -125,108 +184,82 @@ void WhiteKing::move(float deltaTime)
     }
 }
 
-float WhiteKing::getPosition()
+float KingMotion::getPosition() const
 {
     return offset / maxDeflection;
 }
 
-float WhiteKing::getOffset()
-{
-    return offset;
-}
-
 Board::Board(Shader& shader, Model& model) : IluminatedObject(shader, model)
 {
+    material.specular = { 0.0f, 0.0f, 0.0f };
+    material.shininess = 10.0f;
+
+    glm::mat4 local = glm::mat4(1.0f);
+    local = glm::scale(local, glm::vec3(0.5f, 0.5f, 0.5f));
+    local = glm::translate(local, glm::vec3(0.0f, -2.0f, 0.0f));
+    local = glm::rotate(local, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    transform.setLocal(local);
 }
 
-void Board::draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController)
+Knight::Knight(Shader& shader, Model& model) : IluminatedObject(shader, model)
 {
-    shader.use();
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-    model = glm::translate(model, glm::vec3(0.0f, -2.0f, 0.0f));
-    model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-
-    shader.setMat4("model", model);
-
-    shader.setVec3("material.specular", 0.0f, 0.0f, 0.0f);
-    shader.setFloat("material.shininess", 10.0f);
+    material.specular = { 0.54f, 0.54f, 0.54f };
+    material.shininess = 36.0f;
 
-    IluminatedObject::draw(prop, camera, conditionsController);
+    glm::mat4 local = glm::mat4(1.0f);
+    local = glm::scale(local, glm::vec3(0.5f, 0.5f, 0.5f));
+    local = glm::rotate(local, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    transform.setLocal(local);
 }
 
-Knight::Knight(Shader& shader, Model& model) : IluminatedObject(shader, model)
+Piece::Piece(Shader& shader, Model& model, glm::vec3 position, bool black) : IluminatedObject(shader, model)
 {
+    material.specular = { 0.54f, 0.54f, 0.54f };
+    material.shininess = 36.0f;
+    place(position, black);
 }
 
-void Knight::draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController)
+void Piece::place(glm::vec3 position, bool black)
 {
-    shader.use();
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-    model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    shader.setMat4("model", model);
-
-    shader.setVec3("material.specular", 0.54f, 0.54f, 0.54f);
-    shader.setFloat("material.shininess", 36.0f);
-
-    IluminatedObject::draw(prop, camera, conditionsController);
+    // Black pieces face the other side of the board
+    glm::mat4 local = glm::mat4(1.0f);
+    local = glm::translate(local, position);
+    local = glm::rotate(local, glm::radians(black ? 180.0f : 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    local = glm::scale(local, glm::vec3(0.5f, 0.5f, 0.5f));
+    local = glm::rotate(local, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    transform.setLocal(local);
 }
 
 Sphere::Sphere(Shader& shader, Model& model, glm::vec3 position) : IluminatedObject(shader, model), position(position)
 {
-}
-
-void Sphere::draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController)
-{
-    shader.use();
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, position);
-    model = glm::scale(model, glm::vec3(0.2f, 0.2f, 0.2f));
-
-    shader.setMat4("model", model);
-    shader.setBool("sphereOn", conditionsController.lightsOn);
-
-
-    IluminatedObject::draw(prop, camera, conditionsController);
+    // The bulbs hold the point lights, they would shadow everything around them
+    caster = NoCaster;
+    glm::mat4 local = glm::mat4(1.0f);
+    local = glm::translate(local, position);
+    local = glm::scale(local, glm::vec3(0.2f, 0.2f, 0.2f));
+    transform.setLocal(local);
 }
 
 Pawn::Pawn(Shader& shader, Model& model) : IluminatedObject(shader, model)
 {
-
-}
-
-void Pawn::draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController)
-{
-    shader.use();
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(2.0f, 0.0f, 0.0f));
-    model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-    model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    shader.setMat4("model", model);
-
-    shader.setVec3("material.specular", 0.54f, 0.54f, 0.54f);
-    shader.setFloat("material.shininess", 36.0f);
-
-    IluminatedObject::draw(prop, camera, conditionsController);
+    material.specular = { 0.54f, 0.54f, 0.54f };
+    material.shininess = 36.0f;
+
+    glm::mat4 local = glm::mat4(1.0f);
+    local = glm::translate(local, glm::vec3(2.0f, 0.0f, 0.0f));
+    local = glm::scale(local, glm::vec3(0.5f, 0.5f, 0.5f));
+    local = glm::rotate(local, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    transform.setLocal(local);
 }
 
 Rook::Rook(Shader& shader, Model& model) : IluminatedObject(shader, model)
 {
-
-}
-
-void Rook::draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController)
-{
-    shader.use();
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(-10.0f, 0.0f, 5.0f));
-    model = glm::scale(model, glm::vec3(0.5f, 0.5f, 0.5f));
-    model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    shader.setMat4("model", model);
-
-    shader.setVec3("material.specular", 0.54f, 0.54f, 0.54f);
-    shader.setFloat("material.shininess", 36.0f);
-
-    IluminatedObject::draw(prop, camera, conditionsController);
+    material.specular = { 0.54f, 0.54f, 0.54f };
+    material.shininess = 36.0f;
+
+    glm::mat4 local = glm::mat4(1.0f);
+    local = glm::translate(local, glm::vec3(-10.0f, 0.0f, 5.0f));
+    local = glm::scale(local, glm::vec3(0.5f, 0.5f, 0.5f));
+    local = glm::rotate(local, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    transform.setLocal(local);
 }
\ No newline at end of file
@@ -4,6 +4,11 @@
 #include "model.h"
 #include "camera.h"
 #include "weather.h"
+#include "renderqueue.h"
+#include "transform.h"
+#include "impostor.h"
+
+#include <glm/gtc/constants.hpp>
 
 enum Light_Movement {
     U,
@@ -33,6 +38,19 @@ struct SpotLight : PointLight
     glm::vec3 initialPosition = { -10.0f, -10.0f, 10.0f };
     float yaw = -45.0f;
     float pitch = -45.0f;
+    // Lamps hang where they were put: they neither follow the king nor turn with the arrow keys
+    bool fixed = false;
+    // Degrees a lamp swings to either side of its yaw, 0 for one that hangs still
+    float sway = 0.0f;
+
+    void aim(float yawDegrees, float pitchDegrees)
+    {
+        glm::vec3 newDir;
+        newDir.x = cos(glm::radians(yawDegrees)) * cos(glm::radians(pitchDegrees));
+        newDir.y = sin(glm::radians(pitchDegrees));
+        newDir.z = sin(glm::radians(yawDegrees)) * cos(glm::radians(pitchDegrees));
+        direction = glm::normalize(newDir);
+    }
 };
 
 struct LightProperty
@@ -41,21 +59,32 @@ struct LightProperty
     std::vector<PointLight> pointLights;
     std::vector<SpotLight> spotLights;
 
-    const float lightSpeed = 50.0f;
+    static constexpr float lightSpeed = 50.0f;
+    // Seconds a swaying lamp takes to swing there and back
+    static constexpr float swayPeriod = 3.0f;
 
-    void updateLight(const ConditionsController& controller, float offset)
+    // time is in seconds of simulation time and only moves swaying lamps
+    void updateLight(const ConditionsController& controller, float offset, float time = 0.0f)
     {
         dirLight.ambient = controller.getAmbient();
         dirLight.diffuse = controller.getDiffuse();
         dirLight.specular = controller.getSpecular();
 
         for (int i = 0; i < spotLights.size(); i++)
-            spotLights[i].position = spotLights[i].initialPosition - glm::vec3(0.0f, 0.0f, offset);
+        {
+            SpotLight& spot = spotLights[i];
+            if (!spot.fixed)
+                spot.position = spot.initialPosition - glm::vec3(0.0f, 0.0f, offset);
+            else if (spot.sway != 0.0f)
+                spot.aim(spot.yaw + spot.sway * sin(glm::two_pi<float>() * (time / swayPeriod + 0.37f * i)), spot.pitch);
+        }
     }
     void processMovement(Light_Movement dir, float deltaTime)
     {
         for (int i = 0; i < spotLights.size(); i++)
         {
+            if (spotLights[i].fixed)
+                continue;
              if(dir == U)
                 spotLights[i].pitch += deltaTime * lightSpeed;
             else if (dir == D)
@@ -74,85 +103,121 @@ struct LightProperty
             if (spotLights[i].pitch < -89.0f)
                 spotLights[i].pitch = -89.0f;
 
-            glm::vec3 newDir;
-            newDir.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
-            newDir.y = sin(glm::radians(pitch));
-            newDir.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-            newDir = glm::normalize(newDir);
-            spotLights[i].direction = newDir;
+            spotLights[i].aim(yaw, pitch);
         }
     }
 };
 
+// Back and forth movement of the king, advanced by the simulation
+struct KingMotion
+{
+    enum Direction
+    {
+        Forward,
+        Backward,
+    };
+    Direction direction = Forward;
+    static constexpr float speed = 2.0f;
+    static constexpr float maxDeflection = 10.0f;
+    static constexpr float angleSpeed = 15.0f;
+    float offset = 0.0f;
+    float angle = 0.0f;
+    bool stop = false;
+
+    void move(float deltaTime);
+    float getPosition() const;
+};
+
 class IluminatedObject
 {
 public:
 	Shader& shader;
 	Model& model;
+    Material material;
+    // Shaking applied in the vertex shader while objectShaking is on; amplitude 0 keeps the object still
+    Vibration vibration;
+    // Static objects set their local matrix once; only moving objects touch it per frame
+    Transform transform;
+    // Objects that move have their shadows redrawn every frame
+    ShadowCaster caster = StaticCaster;
+    // Where the object's lighting sits in the lightmap atlas, set by Lightmap::load; 0 keeps it lit per fragment
+    glm::vec4 lightmapRect = glm::vec4(0.0f);
+    // Drawn as this impostor beyond impostorDistance from the camera; null always draws the model
+    const ImpostorAtlas* impostor = nullptr;
 
 	IluminatedObject(Shader& shader, Model& model);
-	void configureIlumination(const LightProperty&);
-    virtual void draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController);
+    static void configureIlumination(const Shader& shader, const LightProperty& prop);
+    // Sets the uniforms shared by every draw of a shader in one frame; camera matrices come from the FrameData block
+    static void configureFrame(const Shader& shader, const LightProperty& prop, const Conditions& conditions);
+    virtual void submit(RenderQueue& queue, const Camera& camera, const Conditions& conditions);
+    // Submits the impostor whatever the distance, without a shadow; false when there is none
+    bool submitImpostor(RenderQueue& queue);
+    // Places the object under a parent node of the transform hierarchy
+    virtual void attachTo(Transform& parent);
+    // World-space point the object vibrates around
+    virtual glm::vec3 getPivot() const;
+
+private:
+    // World matrix of the last submit, for motion vectors
+    glm::mat4 previousWorld;
+    bool submitted = false;
 };
 
-class WhiteKing : IluminatedObject
+class WhiteKing : public IluminatedObject
 {
 private:
-    enum Direction
-    {
-        Forward,
-        Backward,
-    };
-    Direction direction = Forward;
-    float const speed = 2.0f;
-    float const maxDeflection = 10.0f;
-    float const angleSpeed = 15.0f;
     float offset = 0.0f;
     float angle = 0.0f;
+    const glm::vec3 pivot = glm::vec3(1.0f, 0.0f, 8.0f);
 
+    // motion -> transform: only the node that changes is rebuilt
+    Transform motion;
+    void updateMotion();
 
 public:
     WhiteKing(Shader& shader, Model& model);
-    void draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController) override;
-    void move(float deltaTime);
-    bool stop = false;
-    float getPosition();
-    float getOffset();
+    void attachTo(Transform& parent) override;
+    glm::vec3 getPivot() const override;
+    void setMotion(float offset, float angle);
 };
 
-class Board : IluminatedObject
+class Board : public IluminatedObject
 {
 public:
     Board(Shader& shader, Model& model);
-    void draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController) override;
 };
 
-class Knight : IluminatedObject
+class Knight : public IluminatedObject
 {
 public:
     Knight(Shader& shader, Model& model);
-    void draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController) override;
 };
 
-class Pawn : IluminatedObject
+class Pawn : public IluminatedObject
 {
 public:
     Pawn(Shader& shader, Model& model);
-    void draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController) override;
 };
 
-class Rook : IluminatedObject
+class Rook : public IluminatedObject
 {
 public:
     Rook(Shader& shader, Model& model);
-    void draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController) override;
 };
 
-class Sphere : IluminatedObject
+// Piece standing on a board square, for layouts built from a position
+class Piece : public IluminatedObject
+{
+public:
+    Piece(Shader& shader, Model& model, glm::vec3 position, bool black);
+    // Stands the piece on another square
+    void place(glm::vec3 position, bool black);
+};
+
+class Sphere : public IluminatedObject
 {
 private:
     glm::vec3 position;
 public:
     Sphere(Shader& shader, Model& model, glm::vec3 position);
-    void draw(const LightProperty& prop, const Camera& camera, const ConditionsController& conditionsController) override;
 };
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "options.h"
+#include "renderqueue.h"
+#include "wall.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Frames a headless run renders when neither --frames nor --replay says otherwise
+const int defaultHeadlessFrames = 600;
+
+static void printUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " [options]\n"
+        << "  --record <file>   record frame timing and input to <file>\n"
+        << "  --replay <file>   replay a recorded run from <file>\n"
+        << "  --headless        render offscreen, without a window\n"
+        << "  --size <w>x<h>    framebuffer size, " << SCR_WIDTH << "x" << SCR_HEIGHT << " by default\n"
+        << "  --frames <n>      stop after <n> frames\n"
+        << "  --batch <file>    render the position jobs in <file>, or stdin for -, to PNG images\n"
+        << "  --video <file>    stream the frames as Y4M (raw RGBA for .raw/.rgba) to <file>, or stdout for -\n"
+        << "  --share <socket>  publish the frames in shared memory to consumers connecting to <socket>\n"
+        << "  --benchmark <scenario>  run a scripted scenario with fixed time steps and vsync off\n"
+        << "  --benchmark-out <file>  where the benchmark writes its JSON, benchmark-<scenario>.json by default\n"
+        << "  --trace <file>    Chrome trace of a profiling build, written on F9 and at exit\n"
+        << "  --lightmap <file> baked lighting to load, res/scene.lightmap by default\n"
+        << "  --bake            ray trace the lightmap for the objects of this run before it starts\n"
+        << "  --lamps <n>       hang <n> more spotlights over the hall, up to " << maxSpotLights - 1 << "\n"
+        << "  --frame-budget <ms>  scale the render resolution to keep the GPU time of the scene's passes within <ms>\n"
+        << "  --temporal        temporal upscaling from jittered frames at half the pixels, or the budget's scale\n"
+        << "  --pgn <file>      play a game of a PGN database on the board\n"
+        << "  --pgn-game <n>    game of the database to play, 1 by default\n"
+        << "  --pgn-ply <n>     ply the playback starts at, 0 by default\n"
+        << "  --wall <n>        show <n> boards in a grid, up to " << wallMaxBoards << ", instead of the single board\n"
+        << "  --wall-feed <file>  lines of \"<board> <FEN or move>\" updating the wall, from <file> or stdin for -\n";
+}
+
+bool parseSize(const char* text, int& width, int& height)
+{
+    char* end = nullptr;
+    long w = std::strtol(text, &end, 10);
+    if (end == text || *end != 'x')
+        return false;
+
+    const char* heightText = end + 1;
+    long h = std::strtol(heightText, &end, 10);
+    if (end == heightText || *end != '\0' || w <= 0 || h <= 0 || w > 16384 || h > 16384)
+        return false;
+
+    width = (int)w;
+    height = (int)h;
+    return true;
+}
+
+bool parseOptions(int argc, char* argv[], Options& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (std::strcmp(argument, "--record") == 0 && hasValue)
+            options.recordPath = argv[++i];
+        else if (std::strcmp(argument, "--replay") == 0 && hasValue)
+            options.replayPath = argv[++i];
+        else if (std::strcmp(argument, "--batch") == 0 && hasValue)
+            options.batchPath = argv[++i];
+        else if (std::strcmp(argument, "--video") == 0 && hasValue)
+            options.videoPath = argv[++i];
+        else if (std::strcmp(argument, "--share") == 0 && hasValue)
+            options.sharePath = argv[++i];
+        else if (std::strcmp(argument, "--benchmark") == 0 && hasValue)
+            options.benchmark = argv[++i];
+        else if (std::strcmp(argument, "--benchmark-out") == 0 && hasValue)
+            options.benchmarkOutput = argv[++i];
+        else if (std::strcmp(argument, "--trace") == 0 && hasValue)
+            options.tracePath = argv[++i];
+        else if (std::strcmp(argument, "--pgn") == 0 && hasValue)
+            options.pgnPath = argv[++i];
+        else if (std::strcmp(argument, "--pgn-game") == 0 && hasValue && (options.pgnGame = std::atoi(argv[i + 1]) - 1) >= 0)
+            i++;
+        else if (std::strcmp(argument, "--pgn-ply") == 0 && hasValue && (options.pgnPly = std::atoi(argv[i + 1])) >= 0)
+            i++;
+        else if (std::strcmp(argument, "--wall") == 0 && hasValue && (options.wallBoards = std::atoi(argv[i + 1])) > 0
+            && options.wallBoards <= wallMaxBoards)
+            i++;
+        else if (std::strcmp(argument, "--wall-feed") == 0 && hasValue)
+            options.wallFeed = argv[++i];
+        else if (std::strcmp(argument, "--lightmap") == 0 && hasValue)
+            options.lightmapPath = argv[++i];
+        else if (std::strcmp(argument, "--bake") == 0)
+            options.bake = true;
+        else if (std::strcmp(argument, "--temporal") == 0)
+            options.temporalUpscale = true;
+        else if (std::strcmp(argument, "--headless") == 0)
+            options.headless = true;
+        else if (std::strcmp(argument, "--size") == 0 && hasValue && parseSize(argv[i + 1], options.width, options.height))
+            i++;
+        else if (std::strcmp(argument, "--lamps") == 0 && hasValue && (options.lamps = std::atoi(argv[i + 1])) > 0
+            && options.lamps < maxSpotLights)
+            i++;
+        else if (std::strcmp(argument, "--frame-budget") == 0 && hasValue
+            && (options.frameBudget = (float)std::atof(argv[i + 1])) > 0.0f)
+            i++;
+        else if (std::strcmp(argument, "--frames") == 0 && hasValue && (options.frames = std::atoi(argv[i + 1])) > 0)
+            i++;
+        else
+        {
+            std::cout << "Unknown or incomplete option: " << argument << std::endl;
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (!options.recordPath.empty() && !options.replayPath.empty())
+    {
+        std::cout << "--record and --replay cannot be combined" << std::endl;
+        printUsage(argv[0]);
+        return false;
+    }
+
+    if (options.capturesFrames() && !options.batchPath.empty())
+    {
+        std::cout << "--video and --share cannot be combined with --batch" << std::endl;
+        printUsage(argv[0]);
+        return false;
+    }
+
+    // The frames own stdout, so messages go to stderr
+    if (options.videoPath == "-")
+        std::cout.rdbuf(std::cerr.rdbuf());
+
+    if (!options.benchmark.empty() && (!options.replayPath.empty() || !options.batchPath.empty()))
+    {
+        std::cout << "--benchmark cannot be combined with --replay or --batch" << std::endl;
+        printUsage(argv[0]);
+        return false;
+    }
+    if (!options.wallFeed.empty() && options.wallBoards == 0)
+    {
+        std::cout << "--wall-feed needs --wall" << std::endl;
+        printUsage(argv[0]);
+        return false;
+    }
+    if (options.wallBoards > 0 && (!options.pgnPath.empty() || !options.batchPath.empty()))
+    {
+        std::cout << "--wall cannot be combined with --pgn or --batch" << std::endl;
+        printUsage(argv[0]);
+        return false;
+    }
+
+    if (!options.benchmark.empty() && options.benchmarkOutput.empty())
+        options.benchmarkOutput = "benchmark-" + options.benchmark + ".json";
+
+    // Benchmarks run for as many frames as their scenario asks for
+    if (options.headless && options.frames == 0 && options.replayPath.empty() && options.benchmark.empty())
+        options.frames = defaultHeadlessFrames;
+
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <string>
+
+#include "camera.h"
+
+// Command line settings of a run
+struct Options
+{
+    // Writes every frame's time step and input to this log
+    std::string recordPath;
+    // Drives the frames from a recorded log instead of the clock and keyboard
+    std::string replayPath;
+
+    // Renders into an offscreen framebuffer without a window or display
+    bool headless = false;
+    int width = SCR_WIDTH;
+    int height = SCR_HEIGHT;
+    // Stops after this many frames, 0 runs until the window is closed or the replay ends
+    int frames = 0;
+    // Renders the jobs listed in this file ("-" for stdin) to images instead of running the scene
+    std::string batchPath;
+    // Streams every rendered frame as Y4M, or raw RGBA for .raw/.rgba paths, to this file,
+    // named pipe or stdout ("-")
+    std::string videoPath;
+    // Publishes every rendered frame to local consumers through shared memory; they connect
+    // to the Unix socket at this path (Linux only)
+    std::string sharePath;
+    // Runs the named benchmark scenario and writes its frame time statistics to benchmarkOutput,
+    // benchmark-<scenario>.json by default
+    std::string benchmark;
+    std::string benchmarkOutput;
+    // Profiling builds write their Chrome trace here on F9 and when the run ends
+    std::string tracePath;
+    // Baked lighting of the static objects, loaded when it exists
+    std::string lightmapPath = "res/scene.lightmap";
+    // Ray traces lightmapPath anew before the scene starts
+    bool bake = false;
+    // Extra spotlights hung over the hall, each with a tile of the shadow atlas
+    int lamps = 0;
+    // GPU time per frame the resolution is scaled to hold, in milliseconds; 0 renders at full resolution
+    float frameBudget = 0.0f;
+    // Jitters the frames and resolves them over time at the output resolution; with no budget
+    // the scene renders at half the pixel count
+    bool temporalUpscale = false;
+    // Plays a game of this PGN file on the board instead of the animated pieces
+    std::string pgnPath;
+    // Game of the file, counted from 0, and the ply playback starts at
+    int pgnGame = 0;
+    int pgnPly = 0;
+    // Shows this many boards tiled in a grid instead of the single board, 0 for the single board
+    int wallBoards = 0;
+    // Position updates for the wall's boards, read from this file, named pipe or stdin ("-")
+    std::string wallFeed;
+
+    // Record, replay, headless and benchmark runs step the simulation in lockstep with the frames,
+    // so they are reproducible
+    bool isDeterministic() const
+    {
+        return !recordPath.empty() || !replayPath.empty() || headless || !benchmark.empty();
+    }
+
+    // Rendered frames are read back for a video or for shared memory consumers
+    bool capturesFrames() const
+    {
+        return !videoPath.empty() || !sharePath.empty();
+    }
+};
+
+// Parses "<width>x<height>"
+bool parseSize(const char* text, int& width, int& height);
+
+// Returns false and prints the usage when the arguments are invalid
+bool parseOptions(int argc, char* argv[], Options& options);
@@ -0,0 +1,380 @@
+#include "pgn.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+static bool isSpace(int c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' || c == '\f';
+}
+
+static bool isDigit(int c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static bool isLetter(int c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static bool isSymbolChar(int c)
+{
+    return isLetter(c) || isDigit(c) || c == '+' || c == '#' || c == '=' || c == '-' || c == '/' || c == ':' || c == '_' ||
+        c == '!' || c == '?';
+}
+
+bool PgnReader::open(const std::string& path)
+{
+    file.open(path, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::PGN::FILE_NOT_OPENED " << path << std::endl;
+        return false;
+    }
+    buffer.resize(bufferSize);
+    seek(0);
+    return true;
+}
+
+void PgnReader::seek(uint64_t target)
+{
+    file.clear();
+    file.seekg((std::streamoff)target);
+    bufferOffset = target;
+    position = 0;
+    filled = 0;
+    // Seeks only land on token boundaries, so only the file's start is the start of an escape line
+    previous = target == 0 ? '\n' : ' ';
+}
+
+int PgnReader::peek()
+{
+    if (position == filled)
+    {
+        bufferOffset += filled;
+        position = 0;
+        file.read(buffer.data(), (std::streamsize)buffer.size());
+        filled = (size_t)file.gcount();
+        if (filled == 0)
+            return EOF;
+    }
+    return (unsigned char)buffer[position];
+}
+
+int PgnReader::get()
+{
+    int c = peek();
+    if (c != EOF)
+    {
+        position++;
+        previous = c;
+    }
+    return c;
+}
+
+template <typename Predicate>
+void PgnReader::consume(Predicate matches, std::string* text)
+{
+    while (peek() != EOF)
+    {
+        const char* begin = buffer.data() + position;
+        const char* end = buffer.data() + filled;
+        const char* stop = begin;
+        while (stop != end && matches((unsigned char)*stop))
+            stop++;
+        if (text)
+            text->append(begin, stop);
+        if (stop != begin)
+            previous = (unsigned char)stop[-1];
+        position += stop - begin;
+        if (stop != end)
+            return;
+    }
+}
+
+void PgnReader::skipPast(char end)
+{
+    while (peek() != EOF)
+    {
+        const char* begin = buffer.data() + position;
+        const char* found = static_cast<const char*>(std::memchr(begin, end, filled - position));
+        if (found)
+        {
+            position += found - begin + 1;
+            previous = (unsigned char)end;
+            return;
+        }
+        previous = (unsigned char)buffer[filled - 1];
+        position = filled;
+    }
+}
+
+PgnToken PgnReader::next()
+{
+    PgnToken token;
+    while (true)
+    {
+        consume(isSpace);
+        bool lineStart = previous == '\n';
+        token.start = offset();
+        int c = get();
+        if (c == EOF)
+        {
+            token.type = PgnEndOfFile;
+            token.end = token.start;
+            return token;
+        }
+
+        if (c == '.' || c == ')')
+            continue;
+
+        if (c == '[')
+        {
+            consume(isSpace);
+            consume([](int name) { return !isSpace(name) && name != '"' && name != ']'; }, &token.text);
+            while (peek() != EOF && peek() != '"' && peek() != ']')
+                get();
+            if (peek() == '"')
+            {
+                get();
+                for (c = get(); c != EOF && c != '"'; c = get())
+                {
+                    if (c == '\\' && (peek() == '"' || peek() == '\\'))
+                        c = get();
+                    token.value += (char)c;
+                }
+            }
+            skipPast(']');
+            token.type = PgnTag;
+            token.end = offset();
+            return token;
+        }
+
+        if (c == '{')
+        {
+            skipPast('}');
+            continue;
+        }
+
+        if (c == ';' || (c == '%' && lineStart))
+        {
+            skipPast('\n');
+            continue;
+        }
+
+        if (c == '(')
+        {
+            // Variations nest, and their comments may hold parentheses
+            int depth = 1;
+            while (depth > 0 && (c = get()) != EOF)
+            {
+                if (c == '(')
+                    depth++;
+                else if (c == ')')
+                    depth--;
+                else if (c == '{')
+                    skipPast('}');
+                else if (c == ';')
+                    skipPast('\n');
+            }
+            continue;
+        }
+
+        if (c == '$')
+        {
+            consume(isDigit);
+            continue;
+        }
+
+        if (c == '*')
+        {
+            token.type = PgnResult;
+            token.text = "*";
+            token.end = offset();
+            return token;
+        }
+
+        if (!isSymbolChar(c))
+            continue;
+
+        token.text = (char)c;
+        consume(isSymbolChar, &token.text);
+        token.end = offset();
+
+        if (token.text == "1-0" || token.text == "0-1" || token.text == "1/2-1/2")
+        {
+            token.type = PgnResult;
+            return token;
+        }
+        // Move numbers
+        if (std::all_of(token.text.begin(), token.text.end(), [](char digit) { return isDigit(digit); }))
+            continue;
+        if (isLetter(token.text[0]) || token.text.compare(0, 3, "0-0") == 0)
+        {
+            token.type = PgnMove;
+            return token;
+        }
+        token.text.clear();
+    }
+}
+
+bool PgnDatabase::open(const std::string& path)
+{
+    gameOffsets.clear();
+    scannedAll = false;
+    inGame = false;
+    inMoves = false;
+    return reader.open(path);
+}
+
+bool PgnDatabase::findGame(size_t index, uint64_t& offset)
+{
+    PROFILE_SCOPE("PgnDatabase::findGame");
+    while (gameOffsets.size() <= index && !scannedAll)
+    {
+        PgnToken token = reader.next();
+        switch (token.type)
+        {
+        case PgnTag:
+            // A tag after moves starts the next game, even when the last one had no result
+            if (!inGame || inMoves)
+                gameOffsets.push_back(token.start);
+            inGame = true;
+            inMoves = false;
+            break;
+        case PgnMove:
+            if (!inGame)
+                gameOffsets.push_back(token.start);
+            inGame = true;
+            inMoves = true;
+            break;
+        case PgnResult:
+            inGame = false;
+            inMoves = false;
+            break;
+        case PgnEndOfFile:
+            scannedAll = true;
+            break;
+        }
+    }
+
+    if (index >= gameOffsets.size())
+        return false;
+    offset = gameOffsets[index];
+    return true;
+}
+
+bool PgnPlayer::open(const std::string& path)
+{
+    return database.open(path) && reader.open(path);
+}
+
+bool PgnPlayer::loadGame(size_t index)
+{
+    PROFILE_SCOPE("PgnPlayer::loadGame");
+    uint64_t offset = 0;
+    if (!database.findGame(index, offset))
+    {
+        std::cout << "ERROR::PGN::GAME_NOT_FOUND " << index + 1 << std::endl;
+        return false;
+    }
+
+    tags.clear();
+    keyframes.clear();
+    position = ChessPosition::initial();
+    lastMove = ChessMove();
+    ply = 0;
+    plyCount = 0;
+    reader.seek(offset);
+
+    PgnToken token = reader.next();
+    for (; token.type == PgnTag; token = reader.next())
+    {
+        tags.push_back(std::make_pair(token.text, token.value));
+        if (token.text == "FEN" && !position.parseFen(token.value))
+            std::cout << "ERROR::PGN::INVALID_FEN " << token.value << std::endl;
+    }
+    Keyframe first = { 0, token.start, position, lastMove };
+    keyframes.push_back(first);
+
+    // The only full pass over the game's moves
+    reader.seek(token.start);
+    readerAtPly = true;
+    loading = true;
+    while (step())
+    {
+        if (ply % keyframeInterval == 0)
+        {
+            Keyframe keyframe = { ply, moveEnd, position, lastMove };
+            keyframes.push_back(keyframe);
+        }
+    }
+    loading = false;
+    plyCount = ply;
+    return seek(0);
+}
+
+bool PgnPlayer::step()
+{
+    PgnToken token = reader.next();
+    if (token.type != PgnMove)
+        return false;
+
+    ChessMove move;
+    if (!position.parseSan(token.text, move))
+    {
+        // The game ends at the first move that cannot be played
+        if (loading)
+            std::cout << "ERROR::PGN::ILLEGAL_MOVE " << token.text << " at ply " << ply + 1 << std::endl;
+        return false;
+    }
+    position.apply(move);
+    lastMove = move;
+    ply++;
+    moveEnd = token.end;
+    return true;
+}
+
+bool PgnPlayer::seek(int target)
+{
+    PROFILE_SCOPE("PgnPlayer::seek");
+    target = std::max(0, std::min(target, plyCount));
+    if (target == ply && readerAtPly)
+        return true;
+
+    // Close enough ahead to read on from here; otherwise start over from the nearest keyframe
+    if (!readerAtPly || target < ply || target - ply > keyframeInterval)
+    {
+        auto keyframe = std::upper_bound(keyframes.begin(), keyframes.end(), target,
+            [](int value, const Keyframe& frame) { return value < frame.ply; }) - 1;
+        position = keyframe->position;
+        lastMove = keyframe->lastMove;
+        ply = keyframe->ply;
+        reader.seek(keyframe->offset);
+        readerAtPly = true;
+    }
+
+    while (ply < target)
+    {
+        if (!step())
+        {
+            std::cout << "ERROR::PGN::READ_FAILED at ply " << ply + 1 << std::endl;
+            readerAtPly = false;
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string PgnPlayer::getTag(const std::string& name) const
+{
+    for (const auto& tag : tags)
+    {
+        if (tag.first == name)
+            return tag.second;
+    }
+    return std::string();
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "chessposition.h"
+
+enum PgnTokenType
+{
+    PgnTag,
+    PgnMove,
+    PgnResult,
+    PgnEndOfFile
+};
+
+struct PgnToken
+{
+    PgnTokenType type = PgnEndOfFile;
+    // Tag name, move in SAN or result
+    std::string text;
+    // Tag value, without quotes and escapes
+    std::string value;
+    // Byte offsets of the token's first character and of the one after it
+    uint64_t start = 0;
+    uint64_t end = 0;
+};
+
+// Tokens of PGN text, read from a file through a fixed buffer, so a database of any size streams
+// through the same few kilobytes. Comments, variations, move numbers and annotation glyphs are
+// skipped. Offsets are 64-bit; reading can continue from the start or end of any token returned.
+class PgnReader
+{
+public:
+    static const size_t bufferSize = 1 << 16;
+
+    bool open(const std::string& path);
+    void seek(uint64_t offset);
+    PgnToken next();
+
+private:
+    std::ifstream file;
+    std::vector<char> buffer;
+    size_t position = 0;
+    size_t filled = 0;
+    // File offset of the buffer's first byte
+    uint64_t bufferOffset = 0;
+    // Last character read, for escape lines that start with %
+    int previous = '\n';
+
+    int peek();
+    int get();
+    // Consumes characters while they match, appending them to text when given; a buffer at a time
+    template <typename Predicate>
+    void consume(Predicate matches, std::string* text = nullptr);
+    // Consumes everything up to and including a character
+    void skipPast(char end);
+    uint64_t offset() const
+    {
+        return bufferOffset + position;
+    }
+};
+
+// Where each game of a PGN file starts. The file is only scanned as far as the games asked for,
+// so opening a game near the start of a large database does not read the rest.
+class PgnDatabase
+{
+public:
+    bool open(const std::string& path);
+    // Offset of a game, counted from 0; false when the file has fewer games
+    bool findGame(size_t index, uint64_t& offset);
+
+private:
+    PgnReader reader;
+    std::vector<uint64_t> gameOffsets;
+    bool scannedAll = false;
+    // Between a game's first token and its result
+    bool inGame = false;
+    bool inMoves = false;
+};
+
+// Plays a game of a PGN database. Loading a game reads it once, resolving every move against the
+// position, and keeps a keyframe of the position and file offset every keyframeInterval plies; the
+// moves themselves are not kept. Seeking restores the keyframe before the ply, found by binary
+// search, and reads at most keyframeInterval moves from the file after it, so any ply of any game
+// is reached in O(log n + K).
+class PgnPlayer
+{
+public:
+    static const int keyframeInterval = 16;
+
+    bool open(const std::string& path);
+    // Loads a game, counted from 0, and stands at its first position; false when there is no such game
+    bool loadGame(size_t index);
+    // Stands at the position after a ply, clamped to the game; false when the file cannot be read
+    bool seek(int ply);
+
+    int getPly() const
+    {
+        return ply;
+    }
+
+    int getPlyCount() const
+    {
+        return plyCount;
+    }
+
+    const ChessPosition& getPosition() const
+    {
+        return position;
+    }
+
+    // Move that led to the current position; invalid at the start
+    const ChessMove& getLastMove() const
+    {
+        return lastMove;
+    }
+
+    // Value of a tag of the loaded game, empty when it has none
+    std::string getTag(const std::string& name) const;
+
+private:
+    struct Keyframe
+    {
+        int ply;
+        // Where the moves after the keyframe start
+        uint64_t offset;
+        ChessPosition position;
+        ChessMove lastMove;
+    };
+
+    PgnDatabase database;
+    PgnReader reader;
+    std::vector<std::pair<std::string, std::string>> tags;
+    std::vector<Keyframe> keyframes;
+    ChessPosition position;
+    ChessMove lastMove;
+    int ply = 0;
+    int plyCount = 0;
+    // The reader stands right after the move of the current ply
+    bool readerAtPly = false;
+    // Offset after the last move read
+    uint64_t moveEnd = 0;
+    // Reading the game for its keyframes
+    bool loading = false;
+
+    // Reads and plays the next move; false at the end of the game
+    bool step();
+};
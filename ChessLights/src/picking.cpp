@@ -0,0 +1,181 @@
+#include "picking.h"
+#include "boardstate.h"
+#include "layout.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// Keeps 1 / direction finite, as the BVH does, so axis-parallel rays still get usable slabs
+static float safeInverse(float x)
+{
+    if (std::abs(x) < 1e-9f)
+        x = x < 0.0f ? -1e-9f : 1e-9f;
+    return 1.0f / x;
+}
+
+// Whether a ray enters a box before maxDistance
+static bool hitsBox(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& boundsMin,
+    const glm::vec3& boundsMax, float maxDistance)
+{
+    glm::vec3 t1 = (boundsMin - origin) * inverseDirection;
+    glm::vec3 t2 = (boundsMax - origin) * inverseDirection;
+    glm::vec3 entering = glm::min(t1, t2);
+    glm::vec3 leaving = glm::max(t1, t2);
+    float enter = std::max(std::max(entering.x, entering.y), std::max(entering.z, 0.0f));
+    float exit = std::min(std::min(leaving.x, leaving.y), std::min(leaving.z, maxDistance));
+    return enter <= exit;
+}
+
+Ray Picker::cursorRay(const Camera& camera, float x, float y, float width, float height)
+{
+    // Without the jitter of temporal upscaling, which moves the image by less than a pixel
+    glm::mat4 inverseViewProjection = glm::inverse(camera.getUnjitteredProjectionMatrix() * camera.getViewMatrix());
+    glm::vec2 ndc(x / width * 2.0f - 1.0f, 1.0f - y / height * 2.0f);
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+
+    Ray ray;
+    ray.origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 toFar = glm::vec3(farPoint) / farPoint.w - ray.origin;
+    ray.tMax = glm::length(toFar);
+    ray.direction = toFar / ray.tMax;
+    return ray;
+}
+
+void Picker::clear()
+{
+    entries.clear();
+    groups.clear();
+}
+
+const Picker::Shape& Picker::shapeOf(const Model& model)
+{
+    std::unique_ptr<Shape>& shape = shapes[&model];
+    if (shape)
+        return *shape;
+
+    PROFILE_SCOPE("Picker::buildShape");
+    shape.reset(new Shape());
+    shape->boundsMin = glm::vec3(FLT_MAX);
+    shape->boundsMax = glm::vec3(-FLT_MAX);
+    std::vector<BvhTriangle> triangles;
+    for (const Mesh& mesh : model.meshes)
+    {
+        for (size_t v = 0; v + 2 < mesh.indices.size(); v += 3)
+        {
+            BvhTriangle triangle;
+            triangle.v0 = mesh.vertices[mesh.indices[v]].Position;
+            triangle.v1 = mesh.vertices[mesh.indices[v + 1]].Position;
+            triangle.v2 = mesh.vertices[mesh.indices[v + 2]].Position;
+            triangles.push_back(triangle);
+        }
+        shape->boundsMin = glm::min(shape->boundsMin, mesh.boundsMin);
+        shape->boundsMax = glm::max(shape->boundsMax, mesh.boundsMax);
+    }
+    shape->bvh.build(triangles);
+    return *shape;
+}
+
+void Picker::addEntry(const IluminatedObject& object, char letter)
+{
+    const Shape& shape = shapeOf(object.model);
+    const glm::mat4& world = object.transform.getWorld();
+
+    Entry entry;
+    entry.object = &object;
+    entry.shape = &shape;
+    entry.piece = letter;
+    entry.boundsMin = glm::vec3(FLT_MAX);
+    entry.boundsMax = glm::vec3(-FLT_MAX);
+    for (int corner = 0; corner < 8; corner++)
+    {
+        glm::vec3 local((corner & 1) ? shape.boundsMax.x : shape.boundsMin.x, (corner & 2) ? shape.boundsMax.y : shape.boundsMin.y,
+            (corner & 4) ? shape.boundsMax.z : shape.boundsMin.z);
+        glm::vec3 point = glm::vec3(world * glm::vec4(local, 1.0f));
+        entry.boundsMin = glm::min(entry.boundsMin, point);
+        entry.boundsMax = glm::max(entry.boundsMax, point);
+    }
+    entries.push_back(entry);
+
+    Group& group = groups.back();
+    group.count++;
+    group.boundsMin = glm::min(group.boundsMin, entry.boundsMin);
+    group.boundsMax = glm::max(group.boundsMax, entry.boundsMax);
+}
+
+void Picker::addBoard(const IluminatedObject& board, const Transform& root)
+{
+    Group group;
+    group.root = &root;
+    group.first = entries.size();
+    group.count = 0;
+    group.boundsMin = glm::vec3(FLT_MAX);
+    group.boundsMax = glm::vec3(-FLT_MAX);
+    groups.push_back(group);
+    addEntry(board, 0);
+}
+
+void Picker::addPiece(const IluminatedObject& piece, char letter)
+{
+    if (!groups.empty())
+        addEntry(piece, letter);
+}
+
+PickResult Picker::pick(const Ray& ray) const
+{
+    PROFILE_SCOPE("Picker::pick");
+    glm::vec3 inverseDirection(safeInverse(ray.direction.x), safeInverse(ray.direction.y), safeInverse(ray.direction.z));
+    float closest = ray.tMax;
+    const Entry* closestEntry = nullptr;
+    size_t closestGroup = 0;
+
+    for (size_t g = 0; g < groups.size(); g++)
+    {
+        const Group& group = groups[g];
+        if (!hitsBox(ray.origin, inverseDirection, group.boundsMin, group.boundsMax, closest))
+            continue;
+
+        for (size_t i = group.first; i < group.first + group.count; i++)
+        {
+            const Entry& entry = entries[i];
+            if (!hitsBox(ray.origin, inverseDirection, entry.boundsMin, entry.boundsMax, closest))
+                continue;
+
+            // Traced in model space; the direction keeps the world's scale, so t stays a world distance
+            glm::mat4 toModel = glm::inverse(entry.object->transform.getWorld());
+            Ray local;
+            local.origin = glm::vec3(toModel * glm::vec4(ray.origin, 1.0f));
+            local.direction = glm::vec3(toModel * glm::vec4(ray.direction, 0.0f));
+            local.tMax = closest;
+            RayHit hit;
+            if (entry.shape->bvh.intersect(local, hit) && hit.t < closest)
+            {
+                closest = hit.t;
+                closestEntry = &entry;
+                closestGroup = g;
+            }
+        }
+    }
+
+    PickResult result;
+    if (!closestEntry)
+        return result;
+
+    const Group& group = groups[closestGroup];
+    result.object = closestEntry->object;
+    result.isBoard = closestEntry == &entries[group.first];
+    result.board = (int)closestGroup;
+    result.piece = closestEntry->piece;
+    result.point = ray.origin + ray.direction * closest;
+    result.distance = closest;
+
+    // A piece is on the square it stands on, wherever on it the ray lands
+    glm::vec3 onBoard = result.isBoard ? result.point : glm::vec3(closestEntry->object->transform.getWorld()[3]);
+    glm::vec3 boardPoint = glm::vec3(glm::inverse(group.root->getWorld()) * glm::vec4(onBoard, 1.0f));
+    int file, rank;
+    if (squareAt(boardPoint, file, rank))
+        result.square = squareIndex(file, rank);
+    return result;
+}
@@ -0,0 +1,122 @@
+#include "pieceset.h"
+#include "layout.h"
+#include "picking.h"
+#include "profiler.h"
+
+#include <cmath>
+
+PieceSet::PieceSet(Shader& shader, Transform& parent) : shader(shader), parent(parent)
+{
+}
+
+void PieceSet::setModel(PieceType type, Model* model, const ImpostorAtlas* impostor)
+{
+    models[type] = model;
+    impostors[type] = impostor;
+}
+
+int PieceSet::setPosition(const BoardState& next)
+{
+    PROFILE_SCOPE("PieceSet::setPosition");
+    Bitboard changed = position.changedSquares(next);
+    int changedCount = 0;
+
+    // Pieces lifted off the changed squares are put down again below where the same kind arrives
+    Bitboard squaresLeft = changed;
+    while (squaresLeft)
+    {
+        int square = popSquare(squaresLeft);
+        changedCount++;
+        if (!squares[square])
+            continue;
+
+        PieceColor color;
+        PieceType type;
+        BoardState::pieceFromLetter(position.pieceAt(square), color, type);
+        lifted[color][type].push_back(std::move(squares[square]));
+        placed &= ~(1ull << square);
+    }
+
+    squaresLeft = changed;
+    while (squaresLeft)
+    {
+        int square = popSquare(squaresLeft);
+        PieceColor color;
+        PieceType type;
+        if (!BoardState::pieceFromLetter(next.pieceAt(square), color, type) || models[type] == nullptr)
+            continue;
+
+        glm::vec3 squareCenter = squarePosition(square % 8, square / 8);
+        bool black = color == BlackPieces;
+        std::vector<std::unique_ptr<Piece>>& spare = lifted[color][type];
+        if (!spare.empty())
+        {
+            squares[square] = std::move(spare.back());
+            spare.pop_back();
+            squares[square]->place(squareCenter, black);
+        }
+        else
+        {
+            squares[square].reset(new Piece(shader, *models[type], squareCenter, black));
+            squares[square]->impostor = impostors[type];
+            // Pieces move with the position, so their shadows cannot stay in the cached layers
+            squares[square]->caster = DynamicCaster;
+            squares[square]->attachTo(parent);
+        }
+        placed |= 1ull << square;
+    }
+
+    // Whatever was not reused has left the board
+    for (auto& colorPieces : lifted)
+    {
+        for (auto& spare : colorPieces)
+            spare.clear();
+    }
+    position = next;
+    return changedCount;
+}
+
+void PieceSet::slide(int square, int fromSquare, float t)
+{
+    if (!squares[square])
+        return;
+
+    glm::vec3 from = squarePosition(fromSquare % 8, fromSquare / 8);
+    glm::vec3 to = squarePosition(square % 8, square / 8);
+    PieceColor color;
+    PieceType type;
+    BoardState::pieceFromLetter(position.pieceAt(square), color, type);
+    // Eased, and lifted over the pieces in between on the way
+    float eased = t * t * (3.0f - 2.0f * t);
+    glm::vec3 lift(0.0f, std::sin(eased * glm::pi<float>()) * slideHeight, 0.0f);
+    squares[square]->place(glm::mix(from, to, eased) + lift, color == BlackPieces);
+}
+
+Bitboard PieceSet::missingSquares() const
+{
+    return position.occupied() & ~placed;
+}
+
+void PieceSet::submit(RenderQueue& queue, const Camera& camera, const Conditions& conditions)
+{
+    Bitboard squaresLeft = placed;
+    while (squaresLeft)
+        squares[popSquare(squaresLeft)]->submit(queue, camera, conditions);
+}
+
+void PieceSet::submitImpostors(RenderQueue& queue)
+{
+    Bitboard squaresLeft = placed;
+    while (squaresLeft)
+        squares[popSquare(squaresLeft)]->submitImpostor(queue);
+}
+
+void PieceSet::addTo(Picker& picker) const
+{
+    Bitboard squaresLeft = placed;
+    while (squaresLeft)
+    {
+        int square = popSquare(squaresLeft);
+        picker.addPiece(*squares[square], position.pieceAt(square));
+    }
+}
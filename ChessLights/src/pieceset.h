@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "boardstate.h"
+#include "object.h"
+
+class Picker;
+
+// The pieces of a position as objects standing on their squares, one slot per square. Moving to
+// another position only touches the slots of the squares that changed: pieces that left a square
+// are reused for the same kind of piece arriving elsewhere, the rest are created or dropped, and
+// every other slot keeps its object and transform as they were.
+class PieceSet
+{
+public:
+    // Highest a sliding piece is lifted, halfway
+    static constexpr float slideHeight = 0.8f;
+
+    PieceSet(Shader& shader, Transform& parent);
+
+    // Model and impostor drawn for a piece type; pieces without a model are left off the board
+    void setModel(PieceType type, Model* model, const ImpostorAtlas* impostor = nullptr);
+
+    // Returns the number of squares that changed
+    int setPosition(const BoardState& position);
+
+    const BoardState& getPosition() const
+    {
+        return position;
+    }
+
+    // Puts the piece on a square part of the way from another square, t from 0 there to 1 on its own
+    void slide(int square, int fromSquare, float t);
+
+    // Squares of the position whose pieces have no model
+    Bitboard missingSquares() const;
+
+    void submit(RenderQueue& queue, const Camera& camera, const Conditions& conditions);
+    // Every piece as its impostor, for a board seen from afar
+    void submitImpostors(RenderQueue& queue);
+    // Adds the pieces to the board last added to a picker
+    void addTo(Picker& picker) const;
+
+private:
+    Shader& shader;
+    Transform& parent;
+    Model* models[PieceTypeCount] = {};
+    const ImpostorAtlas* impostors[PieceTypeCount] = {};
+    BoardState position;
+    std::unique_ptr<Piece> squares[64];
+    // Squares with an object, the position's occupied squares that have a model
+    Bitboard placed = 0;
+    // Kept between calls so a move does not allocate
+    std::vector<std::unique_ptr<Piece>> lifted[PieceColorCount][PieceTypeCount];
+};
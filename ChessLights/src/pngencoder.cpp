@@ -0,0 +1,319 @@
+#include "pngencoder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+    const int windowSize = 32768;
+    const int minMatch = 3;
+    const int maxMatch = 258;
+    const int hashBits = 15;
+
+    const uint16_t lengthBase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint8_t lengthExtra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const uint16_t distanceBase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    const uint8_t distanceExtra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    class BitWriter
+    {
+    public:
+        std::vector<uint8_t>& out;
+
+        explicit BitWriter(std::vector<uint8_t>& out) : out(out)
+        {
+        }
+
+        // Extra bits and block headers go least significant bit first
+        void write(uint32_t value, int count)
+        {
+            buffer |= value << used;
+            used += count;
+            while (used >= 8)
+            {
+                out.push_back((uint8_t)buffer);
+                buffer >>= 8;
+                used -= 8;
+            }
+        }
+
+        // Huffman codes go most significant bit first
+        void writeCode(uint32_t code, int length)
+        {
+            uint32_t reversed = 0;
+            for (int i = 0; i < length; i++)
+                reversed |= ((code >> i) & 1u) << (length - 1 - i);
+            write(reversed, length);
+        }
+
+        void flush()
+        {
+            if (used > 0)
+                out.push_back((uint8_t)buffer);
+            buffer = 0;
+            used = 0;
+        }
+
+    private:
+        uint32_t buffer = 0;
+        int used = 0;
+    };
+
+    // Fixed literal/length code of RFC 1951, section 3.2.6
+    void writeLiteral(BitWriter& bits, int symbol)
+    {
+        if (symbol < 144)
+            bits.writeCode(0x30 + symbol, 8);
+        else if (symbol < 256)
+            bits.writeCode(0x190 + symbol - 144, 9);
+        else if (symbol < 280)
+            bits.writeCode(symbol - 256, 7);
+        else
+            bits.writeCode(0xC0 + symbol - 280, 8);
+    }
+
+    void writeMatch(BitWriter& bits, int length, int distance)
+    {
+        int code = 28;
+        while (lengthBase[code] > length)
+            code--;
+        writeLiteral(bits, 257 + code);
+        bits.write(length - lengthBase[code], lengthExtra[code]);
+
+        code = 29;
+        while (distanceBase[code] > distance)
+            code--;
+        bits.writeCode(code, 5);
+        bits.write(distance - distanceBase[code], distanceExtra[code]);
+    }
+
+    uint32_t adler32(const std::vector<uint8_t>& data)
+    {
+        uint32_t a = 1, b = 0;
+        size_t i = 0;
+        while (i < data.size())
+        {
+            // 5552 bytes is the most that can be summed before the 32-bit sums may overflow
+            size_t end = std::min(data.size(), i + 5552);
+            for (; i < end; i++)
+            {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    // zlib stream with a single fixed-Huffman deflate block and greedy LZ77 matching
+    std::vector<uint8_t> compress(const std::vector<uint8_t>& data)
+    {
+        std::vector<uint8_t> out;
+        out.reserve(data.size() / 4 + 64);
+        out.push_back(0x78);
+        out.push_back(0x01);
+
+        BitWriter bits(out);
+        bits.write(1, 1);
+        bits.write(1, 2);
+
+        std::vector<int32_t> head((size_t)1 << hashBits, -1);
+        const size_t size = data.size();
+        size_t position = 0;
+        while (position < size)
+        {
+            int bestLength = 0;
+            int bestDistance = 0;
+            if (position + minMatch <= size)
+            {
+                uint32_t hash = ((uint32_t)data[position] << 16 | (uint32_t)data[position + 1] << 8 | data[position + 2]) * 2654435761u;
+                hash >>= 32 - hashBits;
+                int32_t candidate = head[hash];
+                head[hash] = (int32_t)position;
+
+                if (candidate >= 0 && position - (size_t)candidate <= windowSize)
+                {
+                    size_t limit = std::min<size_t>(maxMatch, size - position);
+                    size_t length = 0;
+                    while (length < limit && data[candidate + length] == data[position + length])
+                        length++;
+                    if (length >= (size_t)minMatch)
+                    {
+                        bestLength = (int)length;
+                        bestDistance = (int)(position - candidate);
+                    }
+                }
+            }
+
+            if (bestLength > 0)
+            {
+                writeMatch(bits, bestLength, bestDistance);
+                position += bestLength;
+            }
+            else
+            {
+                writeLiteral(bits, data[position]);
+                position++;
+            }
+        }
+
+        writeLiteral(bits, 256);
+        bits.flush();
+
+        uint32_t checksum = adler32(data);
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back((uint8_t)(checksum >> shift));
+        return out;
+    }
+
+    struct CrcTable
+    {
+        uint32_t entries[256];
+
+        CrcTable()
+        {
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                entries[n] = c;
+            }
+        }
+    };
+
+    uint32_t crc32(const uint8_t* data, size_t size)
+    {
+        // Encoders run on several job threads; a function-local static is initialized once, safely
+        static const CrcTable table;
+
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; i++)
+            crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void writeUint32(std::vector<uint8_t>& out, uint32_t value)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out.push_back((uint8_t)(value >> shift));
+    }
+
+    void writeChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+    {
+        writeUint32(out, (uint32_t)data.size());
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        writeUint32(out, crc32(&out[start], out.size() - start));
+    }
+
+    uint8_t paeth(int a, int b, int c)
+    {
+        int p = a + b - c;
+        int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        if (pa <= pb && pa <= pc) return (uint8_t)a;
+        if (pb <= pc) return (uint8_t)b;
+        return (uint8_t)c;
+    }
+}
+
+std::vector<uint8_t> encodePng(const uint8_t* rgba, int width, int height, bool bottomUp)
+{
+    const int channels = 3;
+    const size_t rowSize = (size_t)width * channels;
+
+    // Filtered scanlines, each prefixed with its filter type
+    std::vector<uint8_t> scanlines((rowSize + 1) * height);
+    std::vector<uint8_t> previous(rowSize, 0), current(rowSize);
+    std::vector<uint8_t> candidates[5];
+    for (auto& candidate : candidates)
+        candidate.resize(rowSize);
+
+    for (int y = 0; y < height; y++)
+    {
+        int sourceRow = bottomUp ? height - 1 - y : y;
+        const uint8_t* source = rgba + (size_t)sourceRow * width * 4;
+        for (int x = 0; x < width; x++)
+        {
+            current[x * channels + 0] = source[x * 4 + 0];
+            current[x * channels + 1] = source[x * 4 + 1];
+            current[x * channels + 2] = source[x * 4 + 2];
+        }
+
+        // Try every filter and keep the one with the smallest sum of signed residuals
+        int bestFilter = 0;
+        uint64_t bestCost = UINT64_MAX;
+        for (int filter = 0; filter < 5; filter++)
+        {
+            uint64_t cost = 0;
+            for (size_t i = 0; i < rowSize; i++)
+            {
+                int left = i >= (size_t)channels ? current[i - channels] : 0;
+                int up = previous[i];
+                int upLeft = i >= (size_t)channels ? previous[i - channels] : 0;
+                int predicted = 0;
+                if (filter == 1) predicted = left;
+                else if (filter == 2) predicted = up;
+                else if (filter == 3) predicted = (left + up) / 2;
+                else if (filter == 4) predicted = paeth(left, up, upLeft);
+
+                uint8_t residual = (uint8_t)(current[i] - predicted);
+                candidates[filter][i] = residual;
+                cost += residual < 128 ? residual : 256 - residual;
+            }
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestFilter = filter;
+            }
+        }
+
+        uint8_t* target = &scanlines[(rowSize + 1) * y];
+        target[0] = (uint8_t)bestFilter;
+        std::memcpy(target + 1, candidates[bestFilter].data(), rowSize);
+        previous.swap(current);
+    }
+
+    std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    std::vector<uint8_t> header;
+    writeUint32(header, (uint32_t)width);
+    writeUint32(header, (uint32_t)height);
+    header.push_back(8);
+    header.push_back(2);
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+
+    writeChunk(png, "IHDR", header);
+    writeChunk(png, "IDAT", compress(scanlines));
+    writeChunk(png, "IEND", std::vector<uint8_t>());
+    return png;
+}
+
+bool writePng(const std::string& path, const uint8_t* rgba, int width, int height, bool bottomUp)
+{
+    std::vector<uint8_t> png = encodePng(rgba, width, height, bottomUp);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cout << "ERROR::PNG::CANNOT_OPEN: " << path << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(png.data()), png.size());
+    return (bool)file;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Minimal PNG writer for 8-bit RGB images, so frames can be saved without another dependency.
+// Rows get the cheapest of the standard filters and are compressed with LZ77 and the fixed
+// deflate Huffman codes, which is fast and works well on rendered images.
+
+// Encodes RGBA pixels (alpha is dropped). bottomUp is for rows as glReadPixels returns them.
+std::vector<uint8_t> encodePng(const uint8_t* rgba, int width, int height, bool bottomUp);
+
+bool writePng(const std::string& path, const uint8_t* rgba, int width, int height, bool bottomUp);
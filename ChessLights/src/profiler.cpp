@@ -0,0 +1,252 @@
+#include "profiler.h"
+
+#ifdef CHESSLIGHTS_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+    struct ZoneEvent
+    {
+        const char* name;
+        uint64_t start;
+        uint64_t end;
+    };
+
+    // Ring of the newest zones of one thread. Only the owning thread writes; count is
+    // published with release, so a dump sees complete events below it.
+    struct ThreadBuffer
+    {
+        static const uint64_t capacity = 1 << 15;
+
+        std::string name;
+        unsigned int id = 0;
+        std::vector<ZoneEvent> events = std::vector<ZoneEvent>(capacity);
+        std::atomic<uint64_t> count{ 0 };
+
+        void push(const char* zoneName, uint64_t start, uint64_t end)
+        {
+            uint64_t index = count.load(std::memory_order_relaxed);
+            events[index & (capacity - 1)] = { zoneName, start, end };
+            count.store(index + 1, std::memory_order_release);
+        }
+    };
+
+    // Buffers live until the process exits, so zones of finished threads can still be dumped
+    std::mutex registryMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> registry;
+    thread_local ThreadBuffer* threadBuffer = nullptr;
+
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    ThreadBuffer& currentBuffer()
+    {
+        if (!threadBuffer)
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            registry.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+            threadBuffer = registry.back().get();
+            threadBuffer->id = (unsigned int)registry.size();
+            threadBuffer->name = "Thread " + std::to_string(threadBuffer->id);
+        }
+        return *threadBuffer;
+    }
+
+    struct GpuZone
+    {
+        const char* name;
+        unsigned int beginQuery;
+        unsigned int endQuery;
+    };
+
+    // GL_TIMESTAMP queries of one frame. There are two, so a frame's results are read back
+    // while the next frame is recorded, by which time the GPU has normally finished them.
+    struct GpuFrame
+    {
+        std::vector<GLuint> queries;
+        unsigned int usedQueries = 0;
+        std::vector<GpuZone> zones;
+        // GPU time minus profiler time when the frame was recorded
+        int64_t clockOffset = 0;
+    };
+
+    const unsigned int gpuFrameCount = 2;
+    // Frames between two measurements of the GPU clock against the CPU clock
+    const unsigned int clockCalibrationInterval = 120;
+
+    GpuFrame gpuFrames[gpuFrameCount];
+    uint64_t gpuFrameIndex = 0;
+    std::vector<unsigned int> openGpuZones;
+    int64_t gpuClockOffset = 0;
+    // GPU zones share one buffer shown as a thread of its own
+    ThreadBuffer* gpuBuffer = nullptr;
+    unsigned int droppedGpuFrames = 0;
+
+    GLuint takeQuery(GpuFrame& frame)
+    {
+        if (frame.usedQueries == frame.queries.size())
+        {
+            GLuint query = 0;
+            glGenQueries(1, &query);
+            frame.queries.push_back(query);
+        }
+        return frame.queries[frame.usedQueries++];
+    }
+
+    void collectGpuFrame(GpuFrame& frame)
+    {
+        if (frame.zones.empty())
+            return;
+
+        // Results become available in order, so the last query stands for all of them
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+        {
+            droppedGpuFrames++;
+            return;
+        }
+
+        for (const GpuZone& zone : frame.zones)
+        {
+            GLuint64 begin = 0;
+            GLuint64 end = 0;
+            glGetQueryObjectui64v(frame.queries[zone.beginQuery], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frame.queries[zone.endQuery], GL_QUERY_RESULT, &end);
+            gpuBuffer->push(zone.name, (uint64_t)((int64_t)begin - frame.clockOffset),
+                (uint64_t)((int64_t)end - frame.clockOffset));
+        }
+    }
+
+    void writeEscaped(std::ostream& out, const std::string& text)
+    {
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out << '\\';
+            out << c;
+        }
+    }
+}
+
+uint64_t Profiler::now()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::record(const char* name, uint64_t start, uint64_t end)
+{
+    currentBuffer().push(name, start, end);
+}
+
+void Profiler::setThreadName(const char* name)
+{
+    ThreadBuffer& buffer = currentBuffer();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    buffer.name = name;
+}
+
+void Profiler::beginFrame()
+{
+    if (!gpuBuffer)
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+        gpuBuffer = registry.back().get();
+        gpuBuffer->id = (unsigned int)registry.size();
+        gpuBuffer->name = "GPU";
+    }
+
+    if (gpuFrameIndex % clockCalibrationInterval == 0)
+    {
+        GLint64 gpuTime = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+        gpuClockOffset = (int64_t)gpuTime - (int64_t)now();
+    }
+
+    gpuFrameIndex++;
+    GpuFrame& frame = gpuFrames[gpuFrameIndex % gpuFrameCount];
+    collectGpuFrame(frame);
+    frame.usedQueries = 0;
+    frame.zones.clear();
+    frame.clockOffset = gpuClockOffset;
+    openGpuZones.clear();
+}
+
+void Profiler::beginGpuZone(const char* name)
+{
+    GpuFrame& frame = gpuFrames[gpuFrameIndex % gpuFrameCount];
+    GpuZone zone = { name, 0, 0 };
+    GLuint query = takeQuery(frame);
+    zone.beginQuery = frame.usedQueries - 1;
+    glQueryCounter(query, GL_TIMESTAMP);
+    openGpuZones.push_back((unsigned int)frame.zones.size());
+    frame.zones.push_back(zone);
+}
+
+void Profiler::endGpuZone()
+{
+    if (openGpuZones.empty())
+        return;
+
+    GpuFrame& frame = gpuFrames[gpuFrameIndex % gpuFrameCount];
+    GLuint query = takeQuery(frame);
+    frame.zones[openGpuZones.back()].endQuery = frame.usedQueries - 1;
+    openGpuZones.pop_back();
+    glQueryCounter(query, GL_TIMESTAMP);
+}
+
+bool Profiler::writeTrace(const std::string& path)
+{
+    std::ofstream out(path);
+    if (!out.is_open())
+    {
+        std::cout << "ERROR::PROFILER::CANNOT_WRITE: " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    size_t eventCount = 0;
+    bool first = true;
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+    for (const auto& buffer : registry)
+    {
+        if (!first)
+            out << ",\n";
+        first = false;
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id << ",\"args\":{\"name\":\"";
+        writeEscaped(out, buffer->name);
+        out << "\"}}";
+
+        // The oldest events may be overwritten while we read; leave them a margin
+        uint64_t count = buffer->count.load(std::memory_order_acquire);
+        uint64_t margin = ThreadBuffer::capacity / 16;
+        uint64_t begin = count > ThreadBuffer::capacity - margin ? count - (ThreadBuffer::capacity - margin) : 0;
+        for (uint64_t i = begin; i < count; i++)
+        {
+            const ZoneEvent& event = buffer->events[i & (ThreadBuffer::capacity - 1)];
+            out << ",\n{\"name\":\"";
+            writeEscaped(out, event.name);
+            out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+                << ",\"ts\":" << (double)event.start / 1000.0
+                << ",\"dur\":" << (double)(event.end - event.start) / 1000.0 << "}";
+        }
+        eventCount += (size_t)(count - begin);
+    }
+    out << "\n]}\n";
+
+    std::cout << "Trace with " << eventCount << " zones written to " << path;
+    if (droppedGpuFrames > 0)
+        std::cout << " (" << droppedGpuFrames << " GPU frames were not ready in time and are missing)";
+    std::cout << std::endl;
+    return true;
+}
+
+#endif
@@ -0,0 +1,92 @@
+#pragma once
+
+// Instrumentation for finding out where frame time goes. Builds with CHESSLIGHTS_PROFILE
+// record CPU zones into per-thread buffers and GPU zones with GL_TIMESTAMP queries, and can
+// dump both as Chrome trace JSON (chrome://tracing, ui.perfetto.dev). Without the define every
+// PROFILE_ macro expands to nothing.
+//
+//   PROFILE_SCOPE("RenderQueue::draw");     CPU time of the enclosing scope
+//   PROFILE_GPU_SCOPE("Shading");           GPU time of the GL commands issued in the scope
+//   PROFILE_THREAD("Simulation");           names the calling thread in the trace
+//   PROFILE_FRAME();                        once per frame on the GL thread, collects GPU zones
+//
+// Zone names must be string literals, only the pointer is stored.
+
+#ifdef CHESSLIGHTS_PROFILE
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <string>
+
+class Profiler
+{
+public:
+    // Nanoseconds since the profiler was first used
+    static uint64_t now();
+
+    // Any thread; lock-free once the thread has recorded its first zone
+    static void record(const char* name, uint64_t start, uint64_t end);
+    static void setThreadName(const char* name);
+
+    // GL thread only
+    static void beginFrame();
+    static void beginGpuZone(const char* name);
+    static void endGpuZone();
+
+    // Writes every zone still held in the buffers; safe while other threads keep recording
+    static bool writeTrace(const std::string& path);
+};
+
+class ProfileZone
+{
+public:
+    explicit ProfileZone(const char* name) : name(name), start(Profiler::now())
+    {
+    }
+
+    ~ProfileZone()
+    {
+        Profiler::record(name, start, Profiler::now());
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+class GpuProfileZone
+{
+public:
+    explicit GpuProfileZone(const char* name)
+    {
+        Profiler::beginGpuZone(name);
+    }
+
+    ~GpuProfileZone()
+    {
+        Profiler::endGpuZone();
+    }
+
+    GpuProfileZone(const GpuProfileZone&) = delete;
+    GpuProfileZone& operator=(const GpuProfileZone&) = delete;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) GpuProfileZone PROFILE_CONCAT(gpuProfileZone, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::setThreadName(name)
+#define PROFILE_FRAME() Profiler::beginFrame()
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(name)
+#define PROFILE_THREAD(name)
+#define PROFILE_FRAME()
+
+#endif
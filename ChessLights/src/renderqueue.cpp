@@ -0,0 +1,444 @@
+#include "renderqueue.h"
+#include "impostor.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <iostream>
+
+const int passBits = 2;
+const int shaderBits = 6;
+const int textureBits = 16;
+const int meshBits = 16;
+const int depthBits = 24;
+
+const int depthShift = 0;
+const int meshShift = depthShift + depthBits;
+const int textureShift = meshShift + meshBits;
+const int shaderShift = textureShift + textureBits;
+const int passShift = shaderShift + shaderBits;
+
+uint64_t RenderQueue::makeKey(RenderPass pass, unsigned int shader, unsigned int texture, unsigned int mesh, float depth)
+{
+    // Depth is normalized to the camera range; anything behind the near plane sorts first
+    float normalized = (depth - NEAR_PLANE) / (FAR_PLANE - NEAR_PLANE);
+    normalized = std::min(std::max(normalized, 0.0f), 1.0f);
+    uint64_t quantized = (uint64_t)(normalized * (float)((1 << depthBits) - 1));
+
+    uint64_t key = 0;
+    key |= ((uint64_t)pass & ((1ull << passBits) - 1)) << passShift;
+    key |= ((uint64_t)shader & ((1ull << shaderBits) - 1)) << shaderShift;
+    key |= ((uint64_t)texture & ((1ull << textureBits) - 1)) << textureShift;
+    key |= ((uint64_t)mesh & ((1ull << meshBits) - 1)) << meshShift;
+    key |= quantized << depthShift;
+    return key;
+}
+
+RenderQueue::RenderQueue()
+{
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    uniformAlignment = (size_t)std::max(alignment, 1);
+    glGenVertexArrays(1, &impostorVAO);
+}
+
+RenderQueue::~RenderQueue()
+{
+    glDeleteVertexArrays(1, &impostorVAO);
+}
+
+void RenderQueue::clear()
+{
+    commands.clear();
+    impostors.clear();
+    impostorBatches.clear();
+    entries.clear();
+    objectBlocks.clear();
+    frameBlock = noBlock;
+    programSwitches = 0;
+    textureSwitches = 0;
+}
+
+void RenderQueue::submit(RenderPass pass, const Shader& shader, const Mesh& mesh, const glm::mat4& model, const Material& material,
+    const Vibration& vibration, ShadowCaster caster, const glm::vec4& lightmapRect, const glm::mat4* previousModel)
+{
+    DrawCommand command;
+    command.pass = pass;
+    command.shader = &shader;
+    command.mesh = &mesh;
+    command.model = model;
+    command.previousModel = previousModel ? *previousModel : model;
+    command.material = material;
+    command.vibration = vibration;
+    command.caster = caster;
+    command.lightmapRect = lightmapRect;
+    commands.push_back(command);
+}
+
+void RenderQueue::submit(RenderPass pass, const Shader& shader, const Model& model, const glm::mat4& transform, const Material& material,
+    const Vibration& vibration, ShadowCaster caster, const glm::vec4& lightmapRect, const glm::mat4* previousTransform)
+{
+    for (unsigned int i = 0; i < model.meshes.size(); i++)
+        submit(pass, shader, model.meshes[i], transform, material, vibration, caster, lightmapRect, previousTransform);
+}
+
+void RenderQueue::submitImpostor(const ImpostorAtlas& atlas, const glm::mat4& model, const Material& material)
+{
+    ImpostorCommand command;
+    command.atlas = &atlas;
+    command.model = model;
+    command.material = material;
+    impostors.push_back(command);
+}
+
+void RenderQueue::sort(const Camera& camera, JobSystem& jobs)
+{
+    PROFILE_SCOPE("RenderQueue::sort");
+    entries.resize(commands.size());
+    const glm::mat4& view = camera.getViewMatrix();
+
+    jobs.parallelFor(0, commands.size(), keyGrainSize, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            const DrawCommand& command = commands[i];
+            glm::vec4 viewCenter = view * command.model * glm::vec4(command.mesh->boundsCenter(), 1.0f);
+            entries[i].key = makeKey(command.pass, command.shader->ID, command.mesh->materialTexture(), command.mesh->VAO, -viewCenter.z);
+            entries[i].index = (uint32_t)i;
+        }
+    });
+
+    radixSort();
+}
+
+void RenderQueue::upload(RingBuffer& ring, const Camera& camera, float time, JobSystem& jobs)
+{
+    PROFILE_SCOPE("RenderQueue::upload");
+    uniformBuffer = ring.getBuffer();
+
+    glm::mat4 viewProjection = camera.getUnjitteredProjectionMatrix() * camera.getViewMatrix();
+    if (!hasPreviousFrame)
+    {
+        previousViewProjection = viewProjection;
+        previousTime = time;
+        hasPreviousFrame = true;
+    }
+    RingBuffer::Allocation frame = ring.allocate(sizeof(FrameData), uniformAlignment);
+    if (frame.data)
+    {
+        FrameData* data = static_cast<FrameData*>(frame.data);
+        data->projection = camera.getProjectionMatrix();
+        data->view = camera.getViewMatrix();
+        data->viewPos = camera.Position;
+        data->time = time;
+        data->currentViewProjection = viewProjection;
+        data->previousViewProjection = previousViewProjection;
+        data->previousTime = previousTime;
+        frameBlock = frame.offset;
+    }
+    previousViewProjection = viewProjection;
+    previousTime = time;
+
+    objectBlocks.resize(commands.size());
+    jobs.parallelFor(0, commands.size(), keyGrainSize, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            RingBuffer::Allocation object = ring.allocate(sizeof(ObjectData), uniformAlignment);
+            if (object.data == nullptr)
+            {
+                objectBlocks[i] = noBlock;
+                continue;
+            }
+
+            ObjectData* data = static_cast<ObjectData*>(object.data);
+            data->model = commands[i].model;
+            data->previousModel = commands[i].previousModel;
+            data->material = commands[i].material;
+            const Vibration& vibration = commands[i].vibration;
+            data->vibration = glm::vec4(vibration.pivot, glm::radians(vibration.amplitude));
+            data->lightmapRect = commands[i].lightmapRect;
+            data->vibrationSeed = vibration.seed;
+            objectBlocks[i] = object.offset;
+        }
+    });
+
+    // A few atlases at most, so the batches are built here rather than in jobs
+    bool impostorsFit = true;
+    std::stable_sort(impostors.begin(), impostors.end(),
+        [](const ImpostorCommand& a, const ImpostorCommand& b) { return std::less<const ImpostorAtlas*>()(a.atlas, b.atlas); });
+    for (size_t begin = 0; begin < impostors.size();)
+    {
+        size_t end = begin;
+        while (end < impostors.size() && impostors[end].atlas == impostors[begin].atlas)
+            end++;
+
+        RingBuffer::Allocation object = ring.allocate(sizeof(ObjectData), uniformAlignment);
+        RingBuffer::Allocation instances = ring.allocate((end - begin) * sizeof(glm::mat4), uniformAlignment);
+        if (object.data == nullptr || instances.data == nullptr)
+        {
+            impostorsFit = false;
+            break;
+        }
+
+        // The quads are placed by the instance matrices; impostors do not vibrate
+        ObjectData* data = static_cast<ObjectData*>(object.data);
+        *data = ObjectData();
+        data->model = glm::mat4(1.0f);
+        data->previousModel = glm::mat4(1.0f);
+        data->material = impostors[begin].material;
+        glm::mat4* models = static_cast<glm::mat4*>(instances.data);
+        for (size_t i = begin; i < end; i++)
+            models[i - begin] = impostors[i].model;
+
+        ImpostorBatch batch;
+        batch.atlas = impostors[begin].atlas;
+        batch.objectBlock = object.offset;
+        batch.instances = instances.offset;
+        batch.count = (GLsizei)(end - begin);
+        impostorBatches.push_back(batch);
+        begin = end;
+    }
+
+    if (frameBlock == noBlock || !impostorsFit || std::find(objectBlocks.begin(), objectBlocks.end(), noBlock) != objectBlocks.end())
+        std::cout << "ERROR::RENDER_QUEUE::UNIFORM_RING_FULL" << std::endl;
+}
+
+void RenderQueue::bindFrameBlock() const
+{
+    if (frameBlock != noBlock)
+        glBindBufferRange(GL_UNIFORM_BUFFER, FrameDataBinding, uniformBuffer, frameBlock, sizeof(FrameData));
+}
+
+bool RenderQueue::bindObjectBlock(size_t command) const
+{
+    if (command >= objectBlocks.size() || objectBlocks[command] == noBlock)
+        return false;
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, ObjectDataBinding, uniformBuffer, objectBlocks[command], sizeof(ObjectData));
+    return true;
+}
+
+// LSD radix sort over the 64-bit keys, one byte per pass.
+// Passes where every key shares the same byte are skipped, which is the common case
+// for the pass and shader bits.
+void RenderQueue::radixSort()
+{
+    const size_t count = entries.size();
+    if (count < 2) return;
+
+    scratch.resize(count);
+    SortEntry* src = entries.data();
+    SortEntry* dst = scratch.data();
+
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        size_t histogram[256] = {};
+        for (size_t i = 0; i < count; i++)
+            histogram[(src[i].key >> shift) & 0xFF]++;
+
+        if (histogram[(src[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        size_t offset = 0;
+        for (int b = 0; b < 256; b++)
+        {
+            size_t bucket = histogram[b];
+            histogram[b] = offset;
+            offset += bucket;
+        }
+
+        for (size_t i = 0; i < count; i++)
+            dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+
+        std::swap(src, dst);
+    }
+
+    if (src != entries.data())
+        entries.swap(scratch);
+}
+
+void RenderQueue::draw(const ShaderSetup& setup)
+{
+    PROFILE_SCOPE("RenderQueue::draw");
+    unsigned int currentProgram = 0;
+    const Mesh* currentTextures = nullptr;
+    bindFrameBlock();
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const DrawCommand& command = commands[entries[i].index];
+        if (command.pass == ShadowPass || !bindObjectBlock(entries[i].index))
+            continue;
+
+        const Shader& shader = *command.shader;
+        const Mesh& mesh = *command.mesh;
+
+        if (shader.ID != currentProgram)
+        {
+            shader.use();
+            setup(shader);
+            currentProgram = shader.ID;
+            currentTextures = nullptr;
+            programSwitches++;
+        }
+
+        // Meshes of the same model share textures, so compare the bound set by value
+        if (currentTextures == nullptr || currentTextures->textures.size() != mesh.textures.size() ||
+            !std::equal(mesh.textures.begin(), mesh.textures.end(), currentTextures->textures.begin(),
+                [](const Texture& a, const Texture& b) { return a.id == b.id; }))
+        {
+            mesh.bindTextures(shader);
+            currentTextures = &mesh;
+            textureSwitches++;
+        }
+
+        glBindVertexArray(mesh.VAO);
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(mesh.indices.size()), GL_UNSIGNED_INT, 0);
+    }
+
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void RenderQueue::drawDepth(const Shader& depthShader, const ShaderSetup& setup)
+{
+    PROFILE_SCOPE("RenderQueue::drawDepth");
+    depthShader.use();
+    setup(depthShader);
+    programSwitches++;
+    bindFrameBlock();
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const DrawCommand& command = commands[entries[i].index];
+        if (command.pass != OpaquePass || !bindObjectBlock(entries[i].index))
+            continue;
+
+        glBindVertexArray(command.mesh->depthVAO);
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(command.mesh->indices.size()), GL_UNSIGNED_INT, 0);
+    }
+
+    glBindVertexArray(0);
+}
+
+void RenderQueue::drawImpostors(const Shader& impostorShader, const ShaderSetup& setup)
+{
+    if (impostorBatches.empty())
+        return;
+
+    PROFILE_SCOPE("RenderQueue::drawImpostors");
+    impostorShader.use();
+    setup(impostorShader);
+    programSwitches++;
+    bindFrameBlock();
+
+    // The quad's corners come from gl_VertexID; only the instance matrices are read from a buffer
+    glBindVertexArray(impostorVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, uniformBuffer);
+    for (GLuint column = 0; column < 4; column++)
+    {
+        glEnableVertexAttribArray(column);
+        glVertexAttribDivisor(column, 1);
+    }
+    for (const ImpostorBatch& batch : impostorBatches)
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, ObjectDataBinding, uniformBuffer, batch.objectBlock, sizeof(ObjectData));
+        batch.atlas->bind(impostorShader);
+        textureSwitches++;
+        for (GLuint column = 0; column < 4; column++)
+            glVertexAttribPointer(column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(batch.instances + column * sizeof(glm::vec4)));
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, batch.count);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+bool RenderQueue::uploadView(RingBuffer& ring, const glm::mat4& projection, const glm::mat4& view, const glm::vec3& position,
+    float time, GLintptr& block)
+{
+    RingBuffer::Allocation allocation = ring.allocate(sizeof(FrameData), uniformAlignment);
+    if (allocation.data == nullptr)
+        return false;
+
+    FrameData* data = static_cast<FrameData*>(allocation.data);
+    data->projection = projection;
+    data->view = view;
+    data->viewPos = position;
+    data->time = time;
+    // Views without motion
+    data->currentViewProjection = projection * view;
+    data->previousViewProjection = data->currentViewProjection;
+    data->previousTime = time;
+    block = allocation.offset;
+    return true;
+}
+
+SpotLightData* RenderQueue::uploadSpotLights(RingBuffer& ring)
+{
+    RingBuffer::Allocation allocation = ring.allocate(sizeof(SpotLightData), uniformAlignment);
+    if (allocation.data == nullptr)
+        return nullptr;
+
+    glBindBufferRange(GL_UNIFORM_BUFFER, SpotLightDataBinding, ring.getBuffer(), allocation.offset, sizeof(SpotLightData));
+    return static_cast<SpotLightData*>(allocation.data);
+}
+
+bool RenderQueue::inView(const DrawCommand& command, const glm::mat4& viewProjection)
+{
+    // Bounding sphere of the mesh in world space; vibration only tilts by a few degrees,
+    // which the margin covers
+    const Mesh& mesh = *command.mesh;
+    glm::vec3 center = glm::vec3(command.model * glm::vec4(mesh.boundsCenter(), 1.0f));
+    float scale = std::max(glm::length(glm::vec3(command.model[0])),
+        std::max(glm::length(glm::vec3(command.model[1])), glm::length(glm::vec3(command.model[2]))));
+    float radius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f * scale * 1.1f;
+    return sphereInView(center, radius, viewProjection);
+}
+
+bool RenderQueue::sphereInView(const glm::vec3& center, float radius, const glm::mat4& viewProjection)
+{
+    // Frustum planes from the rows of the matrix
+    glm::mat4 m = glm::transpose(viewProjection);
+    glm::vec4 planes[6] = { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2] };
+    for (const glm::vec4& plane : planes)
+    {
+        float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+        if (distance < -radius * glm::length(glm::vec3(plane)))
+            return false;
+    }
+    return true;
+}
+
+bool RenderQueue::hasCasters(ShadowCaster caster, const glm::mat4& viewProjection) const
+{
+    for (const DrawCommand& command : commands)
+    {
+        if (command.caster == caster && inView(command, viewProjection))
+            return true;
+    }
+    return false;
+}
+
+void RenderQueue::drawCasters(const Shader& depthShader, const ShaderSetup& setup, GLintptr viewBlock,
+    ShadowCaster caster, const glm::mat4& viewProjection)
+{
+    PROFILE_SCOPE("RenderQueue::drawCasters");
+    depthShader.use();
+    setup(depthShader);
+    programSwitches++;
+    glBindBufferRange(GL_UNIFORM_BUFFER, FrameDataBinding, uniformBuffer, viewBlock, sizeof(FrameData));
+
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        const DrawCommand& command = commands[entries[i].index];
+        if (command.caster != caster || !inView(command, viewProjection) || !bindObjectBlock(entries[i].index))
+            continue;
+
+        glBindVertexArray(command.mesh->depthVAO);
+        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(command.mesh->indices.size()), GL_UNSIGNED_INT, 0);
+    }
+
+    glBindVertexArray(0);
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "shader.h"
+#include "model.h"
+#include "camera.h"
+#include "jobsystem.h"
+#include "ringbuffer.h"
+#include "noise.h"
+
+class ImpostorAtlas;
+
+enum RenderPass
+{
+    OpaquePass = 0,
+    // Only drawn into shadow maps, for objects the camera sees as an impostor
+    ShadowPass = 1,
+};
+
+// How a draw takes part in the shadow maps
+enum ShadowCaster
+{
+    NoCaster,
+    // Rendered once into the cached layers, until a light changes
+    StaticCaster,
+    // Rendered every frame over the cached layers
+    DynamicCaster
+};
+
+struct Material
+{
+    glm::vec3 specular = { 0.0f, 0.0f, 0.0f };
+    float shininess = 32.0f;
+};
+
+// std140 mirrors of the uniform blocks in blocks.glsl
+struct FrameData
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPos;
+    float time;
+    // Without the projection's jitter, and the frame before's, for motion vectors
+    glm::mat4 currentViewProjection;
+    glm::mat4 previousViewProjection;
+    float previousTime;
+    float padding[3];
+};
+
+struct ObjectData
+{
+    glm::mat4 model;
+    glm::mat4 previousModel;
+    Material material;
+    glm::vec4 vibration;
+    glm::vec4 lightmapRect;
+    uint32_t vibrationSeed;
+    uint32_t padding[3];
+};
+
+// Spotlights a frame can light with, MAX_SPOT_LIGHTS in blocks.glsl
+const int maxSpotLights = 64;
+
+struct SpotLightBlock
+{
+    glm::vec3 position;
+    float cutOff;
+    glm::vec3 direction;
+    float outerCutOff;
+    glm::vec3 ambient;
+    float constant;
+    glm::vec3 diffuse;
+    float linear;
+    glm::vec3 specular;
+    float quadratic;
+    // Light space straight into the shadow atlas, see ShadowAtlas
+    glm::mat4 shadowMatrix;
+    glm::vec4 shadowRect;
+};
+
+struct SpotLightData
+{
+    SpotLightBlock spotLights[maxSpotLights];
+    int32_t spotLightCount;
+    int32_t padding[3];
+};
+
+struct DrawCommand
+{
+    RenderPass pass;
+    const Shader* shader;
+    const Mesh* mesh;
+    glm::mat4 model;
+    // Model matrix of the frame before, for motion vectors
+    glm::mat4 previousModel;
+    Material material;
+    Vibration vibration;
+    ShadowCaster caster;
+    // Scale in xy and offset in zw from the model's lightmap coordinates into the atlas; 0 when not baked
+    glm::vec4 lightmapRect;
+};
+
+// A far object drawn as a quad of its ImpostorAtlas
+struct ImpostorCommand
+{
+    const ImpostorAtlas* atlas;
+    glm::mat4 model;
+    Material material;
+};
+
+// Collects every draw of a frame and submits them ordered by a packed 64-bit key.
+// Key layout, from the most significant bit:
+//   pass (2) | shader (6) | texture (16) | mesh (16) | depth (24)
+// so draws are grouped by state first and sorted front-to-back inside each group.
+class RenderQueue
+{
+public:
+    // Called once per shader and frame, right after the program is bound
+    typedef std::function<void(const Shader&)> ShaderSetup;
+
+    unsigned int programSwitches = 0;
+    unsigned int textureSwitches = 0;
+
+    RenderQueue();
+    ~RenderQueue();
+
+    RenderQueue(const RenderQueue&) = delete;
+    RenderQueue& operator=(const RenderQueue&) = delete;
+
+    void clear();
+    // previousModel is where the draw was the frame before; null when it did not move
+    void submit(RenderPass pass, const Shader& shader, const Mesh& mesh, const glm::mat4& model, const Material& material,
+        const Vibration& vibration = Vibration(), ShadowCaster caster = StaticCaster, const glm::vec4& lightmapRect = glm::vec4(0.0f),
+        const glm::mat4* previousModel = nullptr);
+    void submit(RenderPass pass, const Shader& shader, const Model& model, const glm::mat4& transform, const Material& material,
+        const Vibration& vibration = Vibration(), ShadowCaster caster = StaticCaster, const glm::vec4& lightmapRect = glm::vec4(0.0f),
+        const glm::mat4* previousTransform = nullptr);
+    // Drawn instanced with the other impostors of the same atlas, which share the first one's material
+    void submitImpostor(const ImpostorAtlas& atlas, const glm::mat4& model, const Material& material);
+    // Builds the sort keys for the camera in parallel jobs, then orders the draws
+    void sort(const Camera& camera, JobSystem& jobs);
+    // Writes the frame and per-draw uniform blocks into the ring buffer, in parallel jobs.
+    // The ring has to be flushed before drawing. Motion vectors are relative to the last upload().
+    void upload(RingBuffer& ring, const Camera& camera, float time, JobSystem& jobs);
+    void draw(const ShaderSetup& setup);
+    // Lays down depth of the opaque draws with a single position-only program
+    void drawDepth(const Shader& depthShader, const ShaderSetup& setup);
+    // One instanced draw per atlas, with depth test and writes on
+    void drawImpostors(const Shader& impostorShader, const ShaderSetup& setup);
+
+    // Writes a FrameData block for another point of view, e.g. a light; false when the ring is full
+    bool uploadView(RingBuffer& ring, const glm::mat4& projection, const glm::mat4& view, const glm::vec3& position,
+        float time, GLintptr& block);
+    // Room for this frame's spotlights, bound for every program; null when the ring is full
+    SpotLightData* uploadSpotLights(RingBuffer& ring);
+    // Whether any caster of the kind may touch the view, by the bounding spheres of the draws
+    bool hasCasters(ShadowCaster caster, const glm::mat4& viewProjection) const;
+    // Depth of the casters of one kind, seen through a block from uploadView
+    void drawCasters(const Shader& depthShader, const ShaderSetup& setup, GLintptr viewBlock,
+        ShadowCaster caster, const glm::mat4& viewProjection);
+
+    size_t size() const
+    {
+        return commands.size();
+    }
+
+    size_t impostorCount() const
+    {
+        return impostors.size();
+    }
+
+    static uint64_t makeKey(RenderPass pass, unsigned int shader, unsigned int texture, unsigned int mesh, float depth);
+    // Whether a world-space sphere touches the frustum of a view
+    static bool sphereInView(const glm::vec3& center, float radius, const glm::mat4& viewProjection);
+
+private:
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    // Impostors of one atlas: an ObjectData block and their model matrices, both in the ring
+    struct ImpostorBatch
+    {
+        const ImpostorAtlas* atlas;
+        GLintptr objectBlock;
+        GLintptr instances;
+        GLsizei count;
+    };
+
+    // Draws per job when generating sort keys or uniform blocks
+    static const size_t keyGrainSize = 256;
+    static const GLintptr noBlock = -1;
+
+    size_t uniformAlignment = 0;
+    GLuint uniformBuffer = 0;
+    GLintptr frameBlock = noBlock;
+    // Camera of the last upload(), without jitter
+    glm::mat4 previousViewProjection;
+    float previousTime = 0.0f;
+    bool hasPreviousFrame = false;
+
+    std::vector<DrawCommand> commands;
+    // Offset of each command's ObjectData in uniformBuffer
+    std::vector<GLintptr> objectBlocks;
+    std::vector<SortEntry> entries;
+    std::vector<SortEntry> scratch;
+    std::vector<ImpostorCommand> impostors;
+    std::vector<ImpostorBatch> impostorBatches;
+    // Four vec4 attributes of a per-instance model matrix, pointed at the ring on every draw
+    GLuint impostorVAO = 0;
+
+    void radixSort();
+    void bindFrameBlock() const;
+    static bool inView(const DrawCommand& command, const glm::mat4& viewProjection);
+    bool bindObjectBlock(size_t command) const;
+};
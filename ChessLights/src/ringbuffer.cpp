@@ -0,0 +1,134 @@
+#include "ringbuffer.h"
+
+#include <algorithm>
+#include <iostream>
+
+// Upper bound for one wait, so a lost context cannot hang the frame forever
+const GLuint64 fenceTimeout = 1000000000ull;
+
+RingBuffer::RingBuffer(GLenum target, size_t regionSize, unsigned int regionCount)
+    : target(target), regionSize(regionSize), regionCount(std::min(std::max(regionCount, 1u), maxRegionCount))
+{
+    persistent = GLEW_ARB_buffer_storage != 0;
+    size_t totalSize = regionSize * this->regionCount;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    if (persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, totalSize, nullptr, flags);
+        mapped = static_cast<char*>(glMapBufferRange(target, 0, totalSize, flags));
+        if (mapped == nullptr)
+        {
+            std::cout << "ERROR::RING_BUFFER::PERSISTENT_MAPPING_FAILED" << std::endl;
+            persistent = false;
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(target, buffer);
+        }
+    }
+    if (!persistent)
+        glBufferData(target, totalSize, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(target, 0);
+
+    // Nothing can be allocated before the first beginFrame()
+    head = regionSize;
+}
+
+RingBuffer::~RingBuffer()
+{
+    for (unsigned int i = 0; i < regionCount; i++)
+    {
+        if (fences[i])
+            glDeleteSync(fences[i]);
+    }
+
+    if (mapped)
+    {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+void RingBuffer::waitForRegion(unsigned int index)
+{
+    GLsync fence = fences[index];
+    if (!fence) return;
+
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED)
+    {
+        stalls++;
+        do
+        {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, fenceTimeout);
+        } while (result == GL_TIMEOUT_EXPIRED);
+    }
+    if (result == GL_WAIT_FAILED)
+        std::cout << "ERROR::RING_BUFFER::FENCE_WAIT_FAILED" << std::endl;
+
+    glDeleteSync(fence);
+    fences[index] = nullptr;
+}
+
+void RingBuffer::beginFrame()
+{
+    region = (region + 1) % regionCount;
+    waitForRegion(region);
+
+    if (!persistent)
+    {
+        // The fence already guarantees the GPU is done with the region, so the driver
+        // must not synchronize on its own
+        glBindBuffer(target, buffer);
+        mapped = static_cast<char*>(glMapBufferRange(target, region * regionSize, regionSize,
+            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT));
+        glBindBuffer(target, 0);
+    }
+
+    head.store(0, std::memory_order_release);
+}
+
+RingBuffer::Allocation RingBuffer::allocate(size_t size, size_t alignment)
+{
+    Allocation allocation;
+    if (mapped == nullptr)
+        return allocation;
+
+    alignment = std::max<size_t>(alignment, 1);
+    size_t start;
+    size_t current = head.load(std::memory_order_relaxed);
+    do
+    {
+        start = (current + alignment - 1) / alignment * alignment;
+        if (start + size > regionSize)
+            return allocation;
+    } while (!head.compare_exchange_weak(current, start + size, std::memory_order_relaxed));
+
+    char* regionBase = persistent ? mapped + region * regionSize : mapped;
+    allocation.data = regionBase + start;
+    allocation.offset = (GLintptr)(region * regionSize + start);
+    allocation.size = (GLsizeiptr)size;
+    return allocation;
+}
+
+void RingBuffer::flush()
+{
+    // Coherent persistent mappings are visible to the GPU as soon as the draw is issued
+    if (persistent || mapped == nullptr)
+        return;
+
+    glBindBuffer(target, buffer);
+    glUnmapBuffer(target);
+    glBindBuffer(target, 0);
+    mapped = nullptr;
+}
+
+void RingBuffer::endFrame()
+{
+    flush();
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <atomic>
+#include <cstddef>
+
+// Streaming buffer for data that lives for a single frame, e.g. uniform blocks.
+// The buffer is split into one region per frame in flight. A region is only reused
+// after the fence placed behind its frame has signaled, so writes never race the GPU
+// and the driver never has to synchronize on its own.
+//
+// With ARB_buffer_storage the buffer stays persistently and coherently mapped.
+// Without it each region is mapped unsynchronized in beginFrame() and unmapped in flush().
+class RingBuffer
+{
+public:
+    struct Allocation
+    {
+        // Null when the frame region is full
+        void* data = nullptr;
+        // Offset from the start of the buffer, for glBindBufferRange
+        GLintptr offset = 0;
+        GLsizeiptr size = 0;
+    };
+
+    RingBuffer(GLenum target, size_t regionSize, unsigned int regionCount = defaultRegionCount);
+    ~RingBuffer();
+
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+
+    // GL thread: waits until the GPU is done with the next region and makes it current
+    void beginFrame();
+    // Any thread, between beginFrame() and flush(). Lock-free.
+    Allocation allocate(size_t size, size_t alignment);
+    // GL thread: makes everything allocated so far visible to the GPU, call before drawing
+    void flush();
+    // GL thread: fences the current region once all draws reading it are submitted
+    void endFrame();
+
+    GLuint getBuffer() const
+    {
+        return buffer;
+    }
+
+    bool isPersistent() const
+    {
+        return persistent;
+    }
+
+    // Frames in which beginFrame() had to block for the GPU
+    unsigned int stalls = 0;
+
+private:
+    static const unsigned int defaultRegionCount = 3;
+    static const unsigned int maxRegionCount = 4;
+
+    GLenum target;
+    GLuint buffer = 0;
+    size_t regionSize;
+    unsigned int regionCount;
+    bool persistent;
+
+    // Base of the persistent mapping, or of the current region while it is mapped
+    char* mapped = nullptr;
+    GLsync fences[maxRegionCount] = {};
+    unsigned int region = 0;
+    std::atomic<size_t> head{ 0 };
+
+    void waitForRegion(unsigned int index);
+};
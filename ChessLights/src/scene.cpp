@@ -1,6 +1,11 @@
 #include "scene.h"
+#include "layout.h"
 
 #include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <cmath>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -9,6 +14,7 @@
 
 Scene* Scene::mScene = nullptr;
 std::vector<std::string> Shader::commonCode = std::vector<std::string>();
+std::vector<std::string> Shader::commonHeaders = std::vector<std::string>();
 
 
 
@@ -32,6 +38,21 @@ void scrollCallbackHandle(GLFWwindow* window, double xoffset, double yoffset)
 
 
 Scene::Scene()
+{
+}
+
+bool Scene::init(const Options& options)
+{
+    bool created = options.headless ? createHeadless(options) : createWindow(options);
+    if (!created)
+        return false;
+
+    camera.setAspectRatio((float)options.width / (float)options.height);
+    glEnable(GL_DEPTH_TEST);
+    return true;
+}
+
+bool Scene::createWindow(const Options& options)
 {
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -41,13 +62,19 @@ Scene::Scene()
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
-
-    window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "ChessLights", NULL, NULL);
+    // Batch runs only need the context; images are rendered offscreen
+    if (!options.batchPath.empty())
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    // Video and shared frames keep the size they were opened with
+    if (options.capturesFrames())
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+
+    window = glfwCreateWindow(options.width, options.height, "ChessLights", NULL, NULL);
     if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
-        return;
+        return false;
     }
 
     glfwMakeContextCurrent(window);
@@ -56,9 +83,28 @@ Scene::Scene()
     glfwSetScrollCallback(window, scrollCallbackHandle);
 
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    // Benchmarks measure the renderer, not the display's refresh rate
+    if (!options.benchmark.empty())
+        glfwSwapInterval(0);
     glewInit();
+    return true;
+}
 
-    glEnable(GL_DEPTH_TEST);
+bool Scene::createHeadless(const Options& options)
+{
+    if (!headless.create())
+        return false;
+
+    offscreenTarget.reset(new Framebuffer(options.width, options.height));
+    startTime = std::chrono::steady_clock::now();
+    return true;
+}
+
+double Scene::getTime() const
+{
+    if (window)
+        return glfwGetTime();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
 }
 
 Scene* Scene::getInstance()
@@ -77,58 +123,77 @@ void calculatePitchYaw(const glm::vec3& cameraPos, const glm::vec3& objectPos, c
     pitch = glm::degrees(atan2(-direction.y, glm::length(right)));
 }
 
-void Scene::configureLightProperty(LightProperty& prop)
+// "white pawn on e2 of board 3", or "square e4" for a board
+static std::string describePick(const PickResult& pick, bool numberBoards)
 {
-    prop.dirLight.direction = { -0.2f, -1.0f, -0.3f };
-    prop.dirLight.ambient = { 0.5f, 0.5f, 0.5f };
-    prop.dirLight.diffuse = { 0.4f, 0.4f, 0.4f };
-    prop.dirLight.specular = { 0.5f, 0.5f, 0.5f };
-
-    PointLight p1;
-    p1.position = spherePosition1;
-    p1.ambient = { 0.1f, 0.1f, 0.1f };
-    p1.diffuse = { 1.0f, 1.0f, 0.9f };
-    p1.specular = { 0.1f, 0.1f, 0.1f };
-    p1.constant = 1.0f;
-    p1.linear = 0.09f;
-    p1.quadratic = 0.032f;
-    prop.pointLights.push_back(p1);
-
-    PointLight p2;
-    p2.position = spherePosition2;
-    p2.ambient = { 0.1f, 0.1f, 0.1f };
-    p2.diffuse = { 1.0f, 1.0f, 0.9f };
-    p2.specular = { 0.1f, 0.1f, 0.1f };
-    p2.constant = 1.0f;
-    p2.linear = 0.09f;
-    p2.quadratic = 0.032f;
-    prop.pointLights.push_back(p2);
-
-    SpotLight s1;
-    s1.position = spotLightPosition1;
-    s1.initialPosition = spotLightPosition1;
-    s1.pitch = -45.0f;
-    s1.yaw = -45.0f;
-    s1.ambient = { 0.1f, 0.1f, 0.1f };
-    s1.diffuse = { 1.0f, 1.0f, 1.0f };
-    s1.specular = { 1.0f, 1.0f, 1.0f };
-    s1.constant = 0.1f;
-    s1.linear = 0.01f;
-    s1.quadratic = 0.001f;
-    s1.cutOff = glm::cos(glm::radians(10.0f));
-    s1.outerCutOff = glm::cos(glm::radians(20.0f));
-    prop.spotLights.push_back(s1);
-    // Instead of setting direction, calculate it with pitch and yaw.
-    prop.processMovement(U, 0);
+    static const char* pieceNames[PieceTypeCount] = { "pawn", "knight", "bishop", "rook", "queen", "king" };
+    std::string square = pick.square >= 0 ? std::string(1, (char)('a' + pick.square % 8)) + (char)('1' + pick.square / 8) : "no square";
+    std::string description;
+    PieceColor color;
+    PieceType type;
+    if (pick.isBoard)
+        description = pick.square >= 0 ? "square " + square : "the board's edge";
+    else if (BoardState::pieceFromLetter(pick.piece, color, type))
+        description = std::string(color == WhitePieces ? "white " : "black ") + pieceNames[type] + " on " + square;
+    else
+        description = "piece on " + square;
+    if (numberBoards)
+        description += " of board " + std::to_string(pick.board + 1);
+    return description;
 }
 
+// Angles wrap at 360 degrees, so interpolate along the shorter arc
+static float mixAngle(float from, float to, float alpha)
+{
+    float delta = to - from;
+    if (delta > 180.0f) delta -= 360.0f;
+    if (delta < -180.0f) delta += 360.0f;
+    return from + delta * alpha;
+}
+
+// Moving lamps between two ticks; a lamp added or removed in between shows as it is in the later one
+static void mixLights(const LightProperty& from, const LightProperty& to, float alpha, LightProperty& lights)
+{
+    lights = to;
+    if (from.spotLights.size() != to.spotLights.size())
+        return;
+    for (size_t i = 0; i < lights.spotLights.size(); i++)
+    {
+        SpotLight& spot = lights.spotLights[i];
+        spot.position = glm::mix(from.spotLights[i].position, spot.position, alpha);
+        spot.direction = glm::normalize(glm::mix(from.spotLights[i].direction, spot.direction, alpha));
+    }
+}
 
-void Scene::run()
+void Scene::run(const Options& options)
 {
-    Shader::addCommonFile("res\\shaders\\light.glsl");
+    Shader::addCommonHeader("res/shaders/blocks.glsl");
+    Shader::addCommonHeader("res/shaders/vibration.glsl");
+    Shader::addCommonFile("res/shaders/light.glsl");
+
+    if (!options.batchPath.empty())
+    {
+        runBatch(options);
+        return;
+    }
+
+    const BenchmarkScenario* scenario = nullptr;
+    if (!options.benchmark.empty())
+    {
+        scenario = findBenchmarkScenario(options.benchmark);
+        if (!scenario)
+        {
+            std::cout << "Unknown benchmark scenario: " << options.benchmark
+                << " (available: " << listBenchmarkScenarios() << ")" << std::endl;
+            return;
+        }
+    }
+
     // build and compile shaders
-    Shader objectShader("res\\shaders\\object.vs", "res\\shaders\\object.fs");
-    Shader sphereShader("res\\shaders\\sphere.vs", "res\\shaders\\sphere.fs");
+    Shader objectShader("res/shaders/object.vs", "res/shaders/object.fs");
+    Shader sphereShader("res/shaders/sphere.vs", "res/shaders/sphere.fs");
+    Shader depthShader("res/shaders/depth.vs", "res/shaders/depth.fs");
+    Shader impostorShader("res/shaders/impostor.vs", "res/shaders/impostor.fs");
 
     // load models
     Model boardModel("res/board/board.obj");
@@ -138,6 +203,15 @@ void Scene::run()
     Model rookModel("res/rook/rook.obj");
     Model sphereModel("res/sphere/sphere.obj");
 
+    // Far pieces are drawn from views baked now; the models stand on their z axis
+    const glm::vec3 pieceUp(0.0f, 0.0f, 1.0f);
+    ImpostorAtlas whiteKingImpostor(whiteKingModel, pieceUp);
+    ImpostorAtlas knightImpostor(knightModel, pieceUp);
+    ImpostorAtlas pawnImpostor(pawnModel, pieceUp);
+    ImpostorAtlas rookImpostor(rookModel, pieceUp);
+
+    // Root of the board and its pieces; moving it moves the whole set
+    Transform boardRoot;
 
     // TODO: IluminatedObjects should be in vector
     // TODO: Objects should have some reset function to move them to 0.0 point
@@ -147,71 +221,583 @@ void Scene::run()
     Pawn pawn(objectShader, pawnModel);
     Rook rook(objectShader, rookModel);
 
+    board.attachTo(boardRoot);
+    whiteKing.attachTo(boardRoot);
+    knight.attachTo(boardRoot);
+    pawn.attachTo(boardRoot);
+    rook.attachTo(boardRoot);
+
+    whiteKing.impostor = &whiteKingImpostor;
+    knight.impostor = &knightImpostor;
+    pawn.impostor = &pawnImpostor;
+    rook.impostor = &rookImpostor;
+
     Sphere sphere1(sphereShader, sphereModel, spherePosition1);
     Sphere sphere2(sphereShader, sphereModel, spherePosition2);
 
-    LightProperty lightProperty;
-    configureLightProperty(lightProperty);
+    // A tournament wall takes the place of the single board, with its own static view
+    int wallBoards = scenario ? scenario->wallBoards : options.wallBoards;
+    std::unique_ptr<ImpostorAtlas> boardImpostor;
+    std::unique_ptr<TournamentWall> wall;
+    WallFeed wallFeed;
+    if (wallBoards > 0)
+    {
+        boardImpostor.reset(new ImpostorAtlas(boardModel, pieceUp));
+        wall.reset(new TournamentWall(objectShader, boardModel, *boardImpostor, wallBoards));
+        wall->setPieceModel(KingPiece, &whiteKingModel, &whiteKingImpostor);
+        wall->setPieceModel(KnightPiece, &knightModel, &knightImpostor);
+        wall->setPieceModel(PawnPiece, &pawnModel, &pawnImpostor);
+        wall->setPieceModel(RookPiece, &rookModel, &rookImpostor);
+        if (!options.wallFeed.empty() && !wallFeed.open(options.wallFeed))
+            return;
+        simulation.setStaticView(wallCameraPos, wallCameraPitch, wallCameraYaw);
+        std::cout << "Showing " << wallBoards << " boards; queens and bishops have no models and are left out" << std::endl;
+    }
+
+    // Benchmarks with more pieces than the animated four fill the board from the back ranks in
+    std::vector<std::unique_ptr<Piece>> extraPieces;
+    if (scenario)
+    {
+        static const int rankOrder[8] = { 0, 7, 1, 6, 2, 5, 3, 4 };
+        Model* extraModels[4] = { &pawnModel, &rookModel, &knightModel, &whiteKingModel };
+        const ImpostorAtlas* extraImpostors[4] = { &pawnImpostor, &rookImpostor, &knightImpostor, &whiteKingImpostor };
+        int extraCount = wall ? 0 : glm::clamp(scenario->pieceCount - 4, 0, 64);
+        for (int i = 0; i < extraCount; i++)
+        {
+            int rank = rankOrder[i / 8];
+            extraPieces.push_back(std::unique_ptr<Piece>(new Piece(objectShader, *extraModels[i % 4],
+                squarePosition(i % 8, rank), rank >= 4)));
+            extraPieces.back()->attachTo(boardRoot);
+            extraPieces.back()->impostor = extraImpostors[i % 4];
+        }
+        simulation.applyPreset(scenario->preset);
+    }
+    else if (options.lamps > 0)
+        simulation.addLamps(options.lamps);
+
+    // A game from a PGN database takes the place of the animated pieces
+    std::unique_ptr<PgnPlayer> game;
+    PieceSet gamePieces(objectShader, boardRoot);
+    if (!options.pgnPath.empty())
+    {
+        game.reset(new PgnPlayer());
+        if (!game->open(options.pgnPath) || !game->loadGame(options.pgnGame))
+            game.reset();
+        gamePieces.setModel(KingPiece, &whiteKingModel, &whiteKingImpostor);
+        gamePieces.setModel(KnightPiece, &knightModel, &knightImpostor);
+        gamePieces.setModel(PawnPiece, &pawnModel, &pawnImpostor);
+        gamePieces.setModel(RookPiece, &rookModel, &rookImpostor);
+    }
+    if (game)
+    {
+        gamePieces.setPosition(game->getPosition().board);
+        std::cout << "Playing " << game->getTag("White") << " - " << game->getTag("Black") << ", " << game->getPlyCount()
+            << " plies; queens and bishops have no models and are left out" << std::endl;
+    }
+
+    // The two most recent simulation ticks; frames are interpolated between them
+    RenderState previous;
+    RenderState current;
+    simulation.update();
+    current = simulation.latest();
+    previous = current;
+
+    // Everything that never moves takes the sun and the point lights from the lightmap
+    std::vector<IluminatedObject*> bakedObjects = { &board, &knight, &pawn, &rook };
+    for (auto& piece : extraPieces)
+        bakedObjects.push_back(piece.get());
+    // A played game has no still pieces whose shadows could be baked into the board, and a wall
+    // has no single board
+    Lightmap lightmap;
+    if (!game && !wall)
+    {
+        if (options.bake)
+            Lightmap::bake(jobs, bakedObjects, current.lights, options.lightmapPath);
+        lightmap.load(options.lightmapPath, bakedObjects);
+    }
+
+    RenderQueue renderQueue;
+    // Per-frame uniform blocks; each region holds a frame's worth of draws
+    RingBuffer uniformRing(GL_UNIFORM_BUFFER, wall ? wallRingRegionSize : uniformRingRegionSize);
+    ShadowMaps shadows;
+    ShadowAtlas spotShadows;
+    VolumetricFog fog;
+    // Fog is lit through the froxel grid whenever there is any
+    bool fogLit = false;
+    // Whether the cached shadow layers were drawn while objects shook
+    bool castersShaking = false;
+    // Lights of the frame, blended between the ticks like the camera and the king
+    LightProperty lights;
+    // The froxels take the lights and their shadows like the objects do
+    RenderQueue::ShaderSetup configureFog = [&](const Shader& shader)
+    {
+        IluminatedObject::configureFrame(shader, lights, current.conditions);
+        if (current.shadows)
+        {
+            shadows.configure(shader);
+            spotShadows.configure();
+        }
+    };
+    RenderQueue::ShaderSetup configureShader = [&](const Shader& shader)
+    {
+        configureFog(shader);
+        if (current.bakedLighting && lightmap.isLoaded())
+            lightmap.configure(shader);
+        if (fogLit)
+            fog.configure(shader);
+    };
+    // Casters only need the uniform blocks
+    RenderQueue::ShaderSetup configureCaster = [](const Shader&) {};
+
+    // The scene is drawn at the scale that holds the frame budget, or at half the pixels for
+    // temporal upscaling, and scaled up to the output
+    std::unique_ptr<DynamicResolution> dynamicResolution;
+    if (options.frameBudget > 0.0f || options.temporalUpscale)
+        dynamicResolution.reset(new DynamicResolution(options.frameBudget, options.temporalUpscale));
+
+    GpuTimer depthTimer;
+    GpuTimer shadingTimer;
+    BenchmarkRecorder benchmark;
+    int frameLimit = options.frames;
+    if (scenario)
+    {
+        depthTimer.recordTo(&benchmark.gpuDepthMilliseconds);
+        shadingTimer.recordTo(&benchmark.gpuShadingMilliseconds);
+        if (frameLimit == 0)
+            frameLimit = scenario->frames;
+    }
+    float lastTitleUpdate = 0.0f;
+    // Kept between clicks, so each model's BVH is only built once
+    Picker picker;
+    std::vector<std::string> feedLines;
+
+    InputRecorder recorder;
+    InputPlayer player;
+    if (!options.recordPath.empty() && !recorder.open(options.recordPath))
+        return;
+    if (!options.replayPath.empty() && !player.open(options.replayPath))
+        return;
+
+    // Frames are read back a few frames late, then converted and written on the video thread
+    // or copied into the shared ring for consumers on this host
+    FrameCapture frameCapture;
+    VideoWriter video;
+    SharedFrameServer sharedFrames;
+    int captureWidth = options.width;
+    int captureHeight = options.height;
+    if (options.capturesFrames())
+    {
+        int framesPerSecond = (int)std::lround(1.0f / headlessFrameTime);
+        if (window)
+        {
+            glfwGetFramebufferSize(window, &captureWidth, &captureHeight);
+            const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+            if (mode)
+                framesPerSecond = mode->refreshRate;
+        }
+        if (!options.videoPath.empty() && !video.open(options.videoPath, captureWidth, captureHeight, framesPerSecond))
+            return;
+        if (!options.sharePath.empty() && !sharedFrames.open(options.sharePath, captureWidth, captureHeight))
+            return;
+    }
+    FrameCapture::FrameHandler writeFrame;
+    if (video.isOpen())
+        writeFrame = [&video](std::shared_ptr<CapturedFrame> captured) { video.write(std::move(captured)); };
+    FrameCapture::MappedFrameHandler shareFrame;
+    if (sharedFrames.isOpen())
+        shareFrame = [&sharedFrames](const uint8_t* pixels, int width, int height, uint64_t index)
+        {
+            sharedFrames.publish(pixels, width, height, index);
+        };
+
+    // Recorded and replayed runs step the simulation from the frame loop, so the
+    // frames only depend on the logged time steps and input
+    bool lockstep = options.isDeterministic();
+    if (!lockstep)
+        simulation.start();
 
-    ConditionsController conditionsController;
+    if (offscreenTarget)
+        offscreenTarget->bind();
 
-    camera.setNewPosition(staticCameraPos, staticCameraPitch, staticCameraYaw);
+    int frameCount = 0;
+    double runStart = getTime();
 
-    while (!glfwWindowShouldClose(window))
+    while (!window || !glfwWindowShouldClose(window))
     {
-        float currentFrame = static_cast<float>(glfwGetTime());
+        if (frameLimit > 0 && frameCount == frameLimit)
+            break;
+        auto frameStart = std::chrono::steady_clock::now();
+        PROFILE_FRAME();
+        PROFILE_SCOPE("Frame");
+
+        float currentFrame = static_cast<float>(getTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        processInput(window, conditionsController, lightProperty);
-        conditionsController.updateTime();
-        lightProperty.updateLight(conditionsController, whiteKing.getOffset());
+        FrameRecord frame;
+        if (window)
+        {
+            PROFILE_SCOPE("Scene::processInput");
+            glfwPollEvents();
+            frame = processInput(window);
+            frame.deltaTime = deltaTime;
+        }
+        if (scenario)
+        {
+            // The script drives the camera and the conditions, and time advances by a fixed step
+            frame = FrameRecord();
+            frame.deltaTime = headlessFrameTime;
+        }
+        else if (!window)
+        {
+            // Headless frames advance by a fixed step, so the output does not depend on render speed
+            frame.deltaTime = headlessFrameTime;
+        }
+        if (player.isOpen() && !player.next(frame))
+        {
+            std::cout << "Replay finished after " << player.getFrame() << " frames" << std::endl;
+            break;
+        }
+        recorder.write(frame);
 
-        auto background = conditionsController.getBackgroundColor();
+        simulation.addInput(frame.keys, frame.mouseX, frame.mouseY, frame.scroll);
+        if (lockstep)
+        {
+            PROFILE_SCOPE("Simulation::advance");
+            simulation.advance(frame.deltaTime);
+        }
+
+        if (simulation.update())
+        {
+            std::swap(previous, current);
+            current = simulation.latest();
+        }
+
+        // Render one tick behind the simulation, so there are always two ticks to blend
+        double renderTime = simulation.now() - Simulation::tickDuration;
+        float alpha = 1.0f;
+        if (current.time > previous.time)
+            alpha = (float)glm::clamp((renderTime - previous.time) / (current.time - previous.time), 0.0, 1.0);
+
+        camera.setNewPosition(glm::mix(previous.cameraPosition, current.cameraPosition, alpha),
+            glm::mix(previous.cameraPitch, current.cameraPitch, alpha),
+            glm::mix(previous.cameraYaw, current.cameraYaw, alpha));
+        camera.setZoom(glm::mix(previous.cameraZoom, current.cameraZoom, alpha));
+        if (scenario)
+        {
+            glm::vec3 position;
+            float pitch, yaw;
+            float progress = frameLimit > 1 ? (float)frameCount / (float)(frameLimit - 1) : 0.0f;
+            if (wall)
+                wall->benchmarkCamera(progress, position, pitch, yaw);
+            else
+                benchmarkCamera(*scenario, progress, position, pitch, yaw);
+            camera.setNewPosition(position, pitch, yaw);
+            camera.setZoom(ZOOM);
+        }
+        whiteKing.setMotion(glm::mix(previous.king.offset, current.king.offset, alpha),
+            mixAngle(previous.king.angle, current.king.angle, alpha));
+        mixLights(previous.lights, current.lights, alpha, lights);
+
+        if (game)
+        {
+            // Plies advance with the simulation clock, so recorded runs replay the same moves
+            double plies = std::max(renderTime, 0.0) / pgnPlyDuration;
+            int ply = glm::clamp(options.pgnPly + current.plySkip + (int)plies, 0, game->getPlyCount());
+            if (ply != game->getPly())
+            {
+                // A piece still sliding would be left between squares, as only changed squares are placed
+                const ChessMove& sliding = game->getLastMove();
+                if (sliding.isValid())
+                    gamePieces.slide(sliding.to, sliding.from, 1.0f);
+                game->seek(ply);
+                gamePieces.setPosition(game->getPosition().board);
+            }
+            // The last move slides over at the start of its ply
+            const ChessMove& move = game->getLastMove();
+            if (move.isValid())
+                gamePieces.slide(move.to, move.from, (float)glm::clamp((plies - std::floor(plies)) / pgnSlideShare, 0.0, 1.0));
+        }
+
+        if (window)
+        {
+            bool showCursor = current.cameraMode == Static || current.cameraMode == Tracking;
+            if (showCursor != cursorShown)
+            {
+                glfwSetInputMode(window, GLFW_CURSOR, showCursor ? GLFW_CURSOR_NORMAL : GLFW_CURSOR_DISABLED);
+                cursorShown = showCursor;
+                // The cursor jumps when it is captured again
+                firstMouse = true;
+            }
+        }
+
+        // Clicks come with the frame's input, so a replay picks the same objects
+        if (frame.pick)
+        {
+            picker.clear();
+            if (wall)
+                wall->addTo(picker);
+            else
+            {
+                picker.addBoard(board, boardRoot);
+                if (game)
+                    gamePieces.addTo(picker);
+                else
+                {
+                    picker.addPiece(whiteKing);
+                    picker.addPiece(knight);
+                    picker.addPiece(pawn);
+                    picker.addPiece(rook);
+                }
+                for (auto& piece : extraPieces)
+                    picker.addPiece(*piece);
+            }
+
+            auto pickStart = std::chrono::steady_clock::now();
+            PickResult pick = picker.pick(Picker::cursorRay(camera, frame.pickX, frame.pickY, 1.0f, 1.0f));
+            float pickMicroseconds = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - pickStart).count();
+            if (pick.isHit())
+                std::cout << "Picked " << describePick(pick, wall != nullptr) << " (" << pickMicroseconds << " us)" << std::endl;
+        }
+
+        if (wall)
+        {
+            wallFeed.take(feedLines);
+            if (!feedLines.empty())
+                wall->apply(feedLines);
+        }
+
+        // Blocks until the GPU has finished the frame that last used this region
+        {
+            PROFILE_SCOPE("RingBuffer::beginFrame");
+            uniformRing.beginFrame();
+        }
+
+        if (dynamicResolution)
+            dynamicResolution->begin(camera);
+
+        auto background = current.conditions.backgroundColor;
         glClearColor(background.r, background.g, background.b, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        if (cameraMode == Tracking)
+        renderQueue.clear();
+        if (wall)
+        {
+            GLint viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            wall->submit(renderQueue, camera, current.conditions, viewport[3]);
+        }
+        else
+            board.submit(renderQueue, camera, current.conditions);
+        if (game)
+            gamePieces.submit(renderQueue, camera, current.conditions);
+        else if (!wall)
+        {
+            whiteKing.submit(renderQueue, camera, current.conditions);
+            knight.submit(renderQueue, camera, current.conditions);
+            pawn.submit(renderQueue, camera, current.conditions);
+            rook.submit(renderQueue, camera, current.conditions);
+        }
+        for (auto& piece : extraPieces)
+            piece->submit(renderQueue, camera, current.conditions);
+
+        sphere1.submit(renderQueue, camera, current.conditions);
+        sphere2.submit(renderQueue, camera, current.conditions);
+
+        // Draws are ordered by state and depth, not by submission order
+        renderQueue.sort(camera, jobs);
+        renderQueue.upload(uniformRing, camera, (float)renderTime, jobs);
+        // Shaking objects cast as dynamic ones, so the cached layers hold them only while still
+        if (current.conditions.objectShaking != castersShaking)
+        {
+            shadows.invalidate();
+            spotShadows.invalidate();
+            castersShaking = current.conditions.objectShaking;
+        }
+        if (current.shadows)
+        {
+            GLint viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            shadows.upload(uniformRing, renderQueue, lights, (float)renderTime);
+            spotShadows.upload(uniformRing, renderQueue, lights, camera, viewport[3], (float)renderTime);
+        }
+        uploadSpotLights(uniformRing, renderQueue, lights, current.shadows ? &spotShadows : nullptr);
+        uniformRing.flush();
+
+        if (current.shadows)
         {
-            camera.setNewPosition(trackingCameraPos,
-                trackingCameraBasePitch + whiteKing.getPosition() * trackingCameraExtraPitch,
-                trackingCameraBaseYaw + whiteKing.getPosition() * trackingCameraExtraYaw);
+            PROFILE_GPU_SCOPE("Shadow maps");
+            shadows.render(renderQueue, depthShader, configureCaster);
+            spotShadows.render(renderQueue, depthShader, configureCaster);
         }
 
-        if (cameraMode == POV)
+        fogLit = current.conditions.fogDensity > 0.0f;
+        if (fogLit)
         {
-            camera.setNewPosition(POVCameraPos - glm::vec3(0.0f, 0.0f, whiteKing.getOffset()), camera.Pitch, camera.Yaw);
+            PROFILE_GPU_SCOPE("Volumetric fog");
+            fog.render(camera, configureFog);
         }
+        else
+            fog.reset();
 
-        board.draw(lightProperty, camera, conditionsController);
-        whiteKing.draw(lightProperty, camera, conditionsController);
-        whiteKing.move(deltaTime);
-        knight.draw(lightProperty, camera, conditionsController);
-        pawn.draw(lightProperty, camera, conditionsController);
-        rook.draw(lightProperty, camera, conditionsController);
+        // Only Phong shading is expensive enough per fragment for the pre-pass to pay off
+        bool prePass = current.depthPrePass && current.conditions.shadeMode == 0;
+        depthTimer.begin();
+        if (prePass)
+        {
+            PROFILE_GPU_SCOPE("Depth pre-pass");
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            renderQueue.drawDepth(depthShader, configureShader);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthFunc(GL_LEQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        depthTimer.end();
+
+        shadingTimer.begin();
+        {
+            PROFILE_GPU_SCOPE("Shading");
+            renderQueue.draw(configureShader);
+        }
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+        {
+            PROFILE_GPU_SCOPE("Impostors");
+            renderQueue.drawImpostors(impostorShader, configureShader);
+        }
+        // Impostors are shaded per pixel as well
+        shadingTimer.end();
+
+        // Shadow maps and fog have sizes of their own; only these passes follow the render scale
+        if (dynamicResolution)
+            dynamicResolution->end(depthTimer.getLastMilliseconds() + shadingTimer.getLastMilliseconds());
+        uniformRing.endFrame();
+
+        if (options.capturesFrames())
+        {
+            if (offscreenTarget)
+                frameCapture.capture(*offscreenTarget, writeFrame, shareFrame);
+            else
+                frameCapture.captureWindow(captureWidth, captureHeight, writeFrame, shareFrame);
+            frameCapture.poll();
+        }
 
-        sphere1.draw(lightProperty, camera, conditionsController);
-        sphere2.draw(lightProperty, camera, conditionsController);
+        frameCount++;
+        auto cpuEnd = std::chrono::steady_clock::now();
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (window)
+        {
+            if (currentFrame - lastTitleUpdate > 0.5f)
+            {
+                std::stringstream title;
+                title << std::fixed << std::setprecision(2) << "ChessLights | depth pre-pass " << (prePass ? "on" : "off")
+                    << " | depth " << depthTimer.getMilliseconds() << " ms | shading " << shadingTimer.getMilliseconds() << " ms";
+                if (dynamicResolution)
+                    title << " | scale " << dynamicResolution->getScale() << " at " << dynamicResolution->getMilliseconds() << " ms";
+                if (game)
+                    title << " | ply " << game->getPly() << "/" << game->getPlyCount();
+                if (wall)
+                    title << " | boards " << wall->detailedBoards << " full, " << wall->impostorBoards << " impostor, "
+                        << wall->culledBoards << " culled";
+                glfwSetWindowTitle(window, title.str().c_str());
+                lastTitleUpdate = currentFrame;
+            }
+
+            PROFILE_SCOPE("glfwSwapBuffers");
+            glfwSwapBuffers(window);
+        }
+
+#ifdef CHESSLIGHTS_PROFILE
+        if (traceRequested)
+        {
+            Profiler::writeTrace(options.tracePath.empty() ? "chesslights-trace.json" : options.tracePath);
+            traceRequested = false;
+        }
+#endif
+
+        if (scenario)
+        {
+            auto frameEnd = std::chrono::steady_clock::now();
+            benchmark.addFrame(std::chrono::duration<float, std::milli>(cpuEnd - frameStart).count(),
+                std::chrono::duration<float, std::milli>(frameEnd - frameStart).count());
+            if (dynamicResolution)
+                benchmark.renderScales.push_back(dynamicResolution->getScale());
+        }
+    }
+
+    simulation.stop();
+    recorder.close();
+
+    frameCapture.finish();
+    if (video.isOpen())
+    {
+        video.close();
+        std::cout << "Video: " << video.framesWritten.load() << " frames written to " << options.videoPath << " ("
+            << frameCapture.stalls << " readback stalls, " << video.waits << " writer waits)" << std::endl;
+    }
+    sharedFrames.close();
+
+#ifdef CHESSLIGHTS_PROFILE
+    if (!options.tracePath.empty())
+        Profiler::writeTrace(options.tracePath);
+#else
+    if (!options.tracePath.empty())
+        std::cout << "--trace needs a build with CHESSLIGHTS_PROFILE defined" << std::endl;
+#endif
+
+    if (scenario)
+    {
+        depthTimer.finish();
+        shadingTimer.finish();
+        if (benchmark.writeJson(options.benchmarkOutput, *scenario, options.width, options.height))
+            std::cout << "Benchmark " << scenario->name << ": " << frameCount << " frames, results in "
+                << options.benchmarkOutput << std::endl;
+    }
+
+    if (!window)
+    {
+        glFinish();
+        double seconds = getTime() - runStart;
+        std::cout << "Rendered " << frameCount << " frames at " << options.width << "x" << options.height
+            << " in " << seconds << " s (" << (seconds > 0.0 ? frameCount / seconds : 0.0) << " fps)" << std::endl;
     }
 }
 
+void Scene::runBatch(const Options& options)
+{
+    std::ifstream file;
+    if (options.batchPath != "-")
+    {
+        file.open(options.batchPath);
+        if (!file.is_open())
+        {
+            std::cout << "ERROR::BATCH::CANNOT_OPEN: " << options.batchPath << std::endl;
+            return;
+        }
+    }
+
+    BatchRenderer batch(jobs, options);
+    batch.run(options.batchPath == "-" ? std::cin : file);
+}
+
 Scene::~Scene()
 {
-    glfwTerminate();
+    if (window)
+        glfwTerminate();
 }
 
 
 void Scene::scrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
-    camera.processMouseScroll(static_cast<float>(yoffset));
+    scrollOffset += static_cast<float>(yoffset);
 }
 
 void Scene::framebufferSizeCallback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    // Minimized windows report a zero size
+    if (width > 0 && height > 0)
+        camera.setAspectRatio((float)width / (float)height);
 }
 
 void Scene::mouseCallback(GLFWwindow* window, double xposIn, double yposIn)
@@ -232,36 +818,37 @@ void Scene::mouseCallback(GLFWwindow* window, double xposIn, double yposIn)
     lastX = xpos;
     lastY = ypos;
 
-    camera.processMouseMovement(xoffset, yoffset);
+    mouseXOffset += xoffset;
+    mouseYOffset += yoffset;
 }
 
-void Scene::changeCamera()
+FrameRecord Scene::processInput(GLFWwindow* window)
 {
-    if (cameraMode == Static) cameraMode = POV;
-    else if (cameraMode == POV) cameraMode = Tracking;
-    else if (cameraMode == Tracking) cameraMode = Free;
-    else cameraMode = Static;
-
-    if (cameraMode == Free)
-        camera.positionFixed = false;
-    else
-        camera.positionFixed = true;
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, true);
 
-    if (cameraMode == Free || cameraMode == POV)
-        camera.mouseFixed = false;
-    else
-        camera.mouseFixed = true;
+    bool traceKey = glfwGetKey(window, GLFW_KEY_F9) == GLFW_PRESS;
+    if (traceKey && !traceKeyDown)
+        traceRequested = true;
+    traceKeyDown = traceKey;
 
-    if (cameraMode == Static)
+    FrameRecord frame;
+    bool pickButton = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    if (pickButton && !pickButtonDown)
     {
-        camera.setNewPosition(staticCameraPos, staticCameraPitch, staticCameraYaw);
+        // A captured cursor stays in the middle of the window
+        frame.pick = true;
+        int width, height;
+        glfwGetWindowSize(window, &width, &height);
+        if (cursorShown && width > 0 && height > 0)
+        {
+            double cursorX, cursorY;
+            glfwGetCursorPos(window, &cursorX, &cursorY);
+            frame.pickX = (float)(cursorX / width);
+            frame.pickY = (float)(cursorY / height);
+        }
     }
-}
-
-void Scene::processInput(GLFWwindow* window, ConditionsController &controller, LightProperty &lightProperty)
-{
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, true);
+    pickButtonDown = pickButton;
 
     // 1 - fog
     // 2 - camera
@@ -269,66 +856,43 @@ void Scene::processInput(GLFWwindow* window, ConditionsController &controller, L
     // 4 - lights
     // 5 - time
     // 6 - shading mode
-
-    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS && !wasPressed)
-    {
-        controller.changeFog();
-        wasPressed = true;
-    }
-
-    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS && !wasPressed)
-    {
-        changeCamera();
-        wasPressed = true;
-    }
-
-    if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS && !wasPressed)
-    {
-        controller.objectShaking = !controller.objectShaking;
-        wasPressed = true;
-    }
-
-    if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS && !wasPressed)
-    {
-        controller.lightsOn = !controller.lightsOn;
-        wasPressed = true;
-    }
-
-    if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS && !wasPressed)
-    {
-        controller.timeStop = !controller.timeStop;
-        wasPressed = true;
-    }
-
-    if (glfwGetKey(window, GLFW_KEY_6) == GLFW_PRESS && !wasPressed)
+    // 7 - depth pre-pass
+    // 8 - shadows
+    // 9 - baked lighting
+    // Page Down / Page Up - game playback back / forward
+    static const int keyBindings[InputKeyCount] = {
+        GLFW_KEY_1,
+        GLFW_KEY_2,
+        GLFW_KEY_3,
+        GLFW_KEY_4,
+        GLFW_KEY_5,
+        GLFW_KEY_6,
+        GLFW_KEY_7,
+        GLFW_KEY_W,
+        GLFW_KEY_S,
+        GLFW_KEY_A,
+        GLFW_KEY_D,
+        GLFW_KEY_UP,
+        GLFW_KEY_DOWN,
+        GLFW_KEY_LEFT,
+        GLFW_KEY_RIGHT,
+        GLFW_KEY_8,
+        GLFW_KEY_9,
+        GLFW_KEY_PAGE_DOWN,
+        GLFW_KEY_PAGE_UP,
+    };
+
+    for (int i = 0; i < InputKeyCount; i++)
     {
-        controller.shadeMode = (controller.shadeMode == 2 ? 0 : controller.shadeMode + 1);
-        wasPressed = true;
+        if (glfwGetKey(window, keyBindings[i]) == GLFW_PRESS)
+            frame.keys |= 1u << i;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_RELEASE &&
-        glfwGetKey(window, GLFW_KEY_2) == GLFW_RELEASE &&
-        glfwGetKey(window, GLFW_KEY_3) == GLFW_RELEASE &&
-        glfwGetKey(window, GLFW_KEY_4) == GLFW_RELEASE &&
-        glfwGetKey(window, GLFW_KEY_5) == GLFW_RELEASE &&
-        glfwGetKey(window, GLFW_KEY_6) == GLFW_RELEASE)
-            wasPressed = false;
-
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        camera.processKeyboard(FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        camera.processKeyboard(BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        camera.processKeyboard(LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        camera.processKeyboard(RIGHT, deltaTime);
-
-    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
-        lightProperty.processMovement(U, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
-        lightProperty.processMovement(L, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
-        lightProperty.processMovement(R, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
-        lightProperty.processMovement(D, deltaTime);
+    frame.mouseX = mouseXOffset;
+    frame.mouseY = mouseYOffset;
+    frame.scroll = scrollOffset;
+    mouseXOffset = 0.0f;
+    mouseYOffset = 0.0f;
+    scrollOffset = 0.0f;
+    return frame;
 }
@@ -10,6 +10,32 @@
 #include "shader.h"
 #include "model.h"
 #include "object.h"
+#include "gputimer.h"
+#include "simulation.h"
+#include "jobsystem.h"
+#include "ringbuffer.h"
+#include "inputlog.h"
+#include "options.h"
+#include "headless.h"
+#include "framebuffer.h"
+#include "batch.h"
+#include "capture.h"
+#include "video.h"
+#include "sharedframes.h"
+#include "benchmark.h"
+#include "profiler.h"
+#include "shadow.h"
+#include "shadowatlas.h"
+#include "lightmap.h"
+#include "volumetricfog.h"
+#include "dynamicresolution.h"
+#include "impostor.h"
+#include "pieceset.h"
+#include "pgn.h"
+#include "wall.h"
+#include "picking.h"
+
+#include <memory>
 
 const glm::vec3 staticCameraPos = glm::vec3(11.0f, 5.0f, 11.0f);
 const float staticCameraPitch = -17.0f;
@@ -22,12 +48,27 @@ const float trackingCameraExtraPitch = 5.0f;
 const float trackingCameraExtraYaw = 30.0f;
 
 const glm::vec3 POVCameraPos = glm::vec3(0.75f, 6.01f, 7.87f);
+// Direction of the POV camera when no previous mode has turned it, as in batch renders
+const float POVCameraPitch = -25.0f;
+const float POVCameraYaw = -90.0f;
 
 const glm::vec3 spherePosition1 = glm::vec3(7.0f, 3.0f, 7.0f);
 const glm::vec3 spherePosition2 = glm::vec3(-6.0f, 2.0f, 0.0f);
 
 const glm::vec3 spotLightPosition1 = glm::vec3(0.75f, 6.01f, 7.87f);
 
+// Bytes of transient per-frame data a single frame may stream through the ring buffer
+const size_t uniformRingRegionSize = 1 << 20;
+// A tournament wall streams a model matrix for every piece it draws as an impostor
+const size_t wallRingRegionSize = 1 << 23;
+
+// Seconds each ply of a played game stays on the board, and the share of it the move takes
+const double pgnPlyDuration = 1.5;
+const double pgnSlideShare = 0.4;
+
+// Simulation time a headless frame advances by
+const float headlessFrameTime = 1.0f / 60.0f;
+
 
 class Scene
 {
@@ -36,27 +77,39 @@ private:
 	~Scene();
 	static Scene* mScene;
 
+	// Render-side camera, interpolated between simulation ticks
 	Camera camera;
-	GLFWwindow* window;
+	// Null when rendering headless
+	GLFWwindow* window = nullptr;
+	HeadlessContext headless;
+	// Headless runs draw here instead of a window
+	std::unique_ptr<Framebuffer> offscreenTarget;
+	Simulation simulation;
+	JobSystem jobs;
 
 	void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 	void framebufferSizeCallback(GLFWwindow* window, int width, int height);
-	void processInput(GLFWwindow* window, ConditionsController& controller, LightProperty& lightProperty);
+	// Samples this frame's keys and the mouse movement gathered since the last frame
+	FrameRecord processInput(GLFWwindow* window);
 	void mouseCallback(GLFWwindow* window, double xposIn, double yposIn);
-	void changeCamera();
-	void configureLightProperty(LightProperty& lightProperty);
-
-	bool wasPressed = false;
-
-	enum CameraMode
-	{
-		Static,
-		POV,
-		Tracking,
-		Free
-	};
-
-	CameraMode cameraMode = Static;
+	bool createWindow(const Options& options);
+	bool createHeadless(const Options& options);
+	void runBatch(const Options& options);
+	// Seconds since the context was created
+	double getTime() const;
+	std::chrono::steady_clock::time_point startTime;
+
+	// Mouse movement gathered by the callbacks until it is handed to the simulation
+	float mouseXOffset = 0.0f;
+	float mouseYOffset = 0.0f;
+	float scrollOffset = 0.0f;
+	// Set on a press of F9, when the trace should be written
+	bool traceRequested = false;
+	bool traceKeyDown = false;
+	// Whether the left button was down at the last frame's input, so a click picks once
+	bool pickButtonDown = false;
+	// The cursor is shown while the camera does not turn with the mouse
+	bool cursorShown = false;
 	
 public:
 	
@@ -69,7 +122,9 @@ public:
 	float lastY = SCR_HEIGHT / 2.0f;
 
 
-	void run();
+	// Creates the window or the headless context; must succeed before run()
+	bool init(const Options& options);
+	void run(const Options& options);
 
 	friend void framebufferSizeCallbackHandle(GLFWwindow* window, int width, int height);
 	friend void mouseCallbackHandle(GLFWwindow* window, double xposIn, double yposIn);
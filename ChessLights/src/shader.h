@@ -9,10 +9,19 @@
 #include <iostream>
 #include <vector>
 
+// Binding points of the uniform blocks declared in blocks.glsl
+enum UniformBlockBinding
+{
+    FrameDataBinding = 0,
+    ObjectDataBinding = 1,
+    SpotLightDataBinding = 2,
+};
+
 class Shader
 {
 public:
     static std::vector<std::string> commonCode;
+    static std::vector<std::string> commonHeaders;
     unsigned int ID;
 
     Shader(const char* vertexPath, const char* fragmentPath)
@@ -42,8 +51,8 @@ public:
             vShaderFile.close();
             fShaderFile.close();
 
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            vertexCode = insertCommonHeaders(vShaderStream.str());
+            fragmentCode = insertCommonHeaders(fShaderStream.str());
         }
         catch (std::ifstream::failure& e)
         {
@@ -68,6 +77,9 @@ public:
         glAttachShader(ID, fragment);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        bindUniformBlock("FrameData", FrameDataBinding);
+        bindUniformBlock("ObjectData", ObjectDataBinding);
+        bindUniformBlock("SpotLightData", SpotLightDataBinding);
         // delete shaders
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -127,7 +139,20 @@ public:
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
     }
 
+    // Appended after the shader code; for functions used through forward declarations
     static void addCommonFile(const char* path)
+    {
+        loadCommonCode(path, commonCode);
+    }
+
+    // Inserted right after the #version line; for declarations the shader code itself uses
+    static void addCommonHeader(const char* path)
+    {
+        loadCommonCode(path, commonHeaders);
+    }
+
+private:
+    static void loadCommonCode(const char* path, std::vector<std::string>& target)
     {
         std::string code;
         std::ifstream file;
@@ -139,7 +164,7 @@ public:
             stream << file.rdbuf();
             file.close();
             code = stream.str();
-            commonCode.push_back(code);
+            target.push_back(code);
         }
         catch (std::ifstream::failure& e)
         {
@@ -147,7 +172,28 @@ public:
         }
     }
 
-private:
+    static std::string insertCommonHeaders(const std::string& code)
+    {
+        if (commonHeaders.empty())
+            return code;
+
+        size_t lineEnd = code.find('\n', code.find("#version"));
+        size_t position = lineEnd == std::string::npos ? code.size() : lineEnd + 1;
+
+        std::string result = code.substr(0, position);
+        for (auto header : commonHeaders)
+            result += header + "\n";
+        return result + code.substr(position);
+    }
+
+    // GLSL 330 has no binding layout qualifier, so blocks are bound after linking
+    void bindUniformBlock(const char* name, UniformBlockBinding binding)
+    {
+        unsigned int index = glGetUniformBlockIndex(ID, name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, binding);
+    }
+
     void checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
@@ -0,0 +1,190 @@
+#include "shadow.h"
+#include "profiler.h"
+
+#include <cmath>
+#include <string>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+// Directional light: an orthographic box around the board, seen from this far up the light
+const float dirShadowDistance = 25.0f;
+const float dirShadowExtent = 12.0f;
+const float pointShadowFar = 30.0f;
+const float shadowNear = 0.1f;
+
+// Cube faces in GL order: +X, -X, +Y, -Y, +Z, -Z; cubeFace() in light.glsl picks them the same way
+static const glm::vec3 cubeFaceDirections[6] = {
+    { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+    { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f }
+};
+static const glm::vec3 cubeFaceUps[6] = {
+    { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f },
+    { 0.0f, 0.0f, -1.0f }, { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }
+};
+
+static glm::vec3 upFor(const glm::vec3& direction)
+{
+    return std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+static GLuint createDepthArray(int layers, bool compare)
+{
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, shadowMapResolution, shadowMapResolution, layers, 0,
+        GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    // Linear filtering of a compared lookup gives 2x2 PCF for free
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (compare)
+    {
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    return texture;
+}
+
+ShadowMaps::ShadowMaps()
+{
+    glGenFramebuffers(1, &shadowFramebuffer);
+    glGenFramebuffers(1, &staticFramebuffer);
+    // Depth only
+    for (GLuint framebuffer : { shadowFramebuffer, staticFramebuffer })
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowMaps::~ShadowMaps()
+{
+    glDeleteTextures(1, &shadowTexture);
+    glDeleteTextures(1, &staticTexture);
+    glDeleteFramebuffers(1, &shadowFramebuffer);
+    glDeleteFramebuffers(1, &staticFramebuffer);
+}
+
+void ShadowMaps::allocate(int count)
+{
+    glDeleteTextures(1, &shadowTexture);
+    glDeleteTextures(1, &staticTexture);
+    shadowTexture = createDepthArray(count, true);
+    staticTexture = createDepthArray(count, false);
+    layerCount = count;
+    layers.assign(count, Layer());
+}
+
+void ShadowMaps::invalidate()
+{
+    for (Layer& layer : layers)
+        layer.cacheValid = false;
+}
+
+void ShadowMaps::upload(RingBuffer& ring, RenderQueue& queue, const LightProperty& lights, float time)
+{
+    int count = 1 + 6 * (int)lights.pointLights.size();
+    if (count != layerCount)
+        allocate(count);
+
+    glm::vec3 direction = glm::normalize(lights.dirLight.direction);
+    Layer& sun = layers[0];
+    sun.position = -direction * dirShadowDistance;
+    sun.view = glm::lookAt(sun.position, glm::vec3(0.0f), upFor(direction));
+    sun.projection = glm::ortho(-dirShadowExtent, dirShadowExtent, -dirShadowExtent, dirShadowExtent,
+        shadowNear, dirShadowDistance * 2.0f);
+
+    int next = 1;
+    for (const PointLight& point : lights.pointLights)
+    {
+        for (int face = 0; face < 6; face++)
+        {
+            Layer& layer = layers[next++];
+            layer.position = point.position;
+            layer.view = glm::lookAt(point.position, point.position + cubeFaceDirections[face], cubeFaceUps[face]);
+            layer.projection = glm::perspective(glm::radians(90.0f), 1.0f, shadowNear, pointShadowFar);
+        }
+    }
+
+    for (Layer& layer : layers)
+        layer.uploaded = queue.uploadView(ring, layer.projection, layer.view, layer.position, time, layer.viewBlock);
+}
+
+void ShadowMaps::drawLayer(GLuint framebuffer, GLuint texture, int layer)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+}
+
+void ShadowMaps::render(RenderQueue& queue, const Shader& depthShader, const RenderQueue::ShaderSetup& setup)
+{
+    PROFILE_SCOPE("ShadowMaps::render");
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+    glViewport(0, 0, shadowMapResolution, shadowMapResolution);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+    staticRedraws = 0;
+
+    for (int i = 0; i < layerCount; i++)
+    {
+        Layer& layer = layers[i];
+        if (!layer.uploaded)
+            continue;
+
+        glm::mat4 matrix = layer.matrix();
+        if (!layer.cacheValid || matrix != layer.cachedMatrix)
+        {
+            drawLayer(staticFramebuffer, staticTexture, i);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            queue.drawCasters(depthShader, setup, layer.viewBlock, StaticCaster, matrix);
+            layer.cachedMatrix = matrix;
+            layer.cacheValid = true;
+            layer.stale = true;
+            staticRedraws++;
+        }
+
+        // Nothing moved through this layer, last frame or now: it is still exact
+        bool dynamic = queue.hasCasters(DynamicCaster, matrix);
+        if (!layer.stale && !dynamic && !layer.hasDynamic)
+            continue;
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffer);
+        glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, i);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowFramebuffer);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowTexture, 0, i);
+        glBlitFramebuffer(0, 0, shadowMapResolution, shadowMapResolution, 0, 0, shadowMapResolution, shadowMapResolution,
+            GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        if (dynamic)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebuffer);
+            queue.drawCasters(depthShader, setup, layer.viewBlock, DynamicCaster, matrix);
+        }
+        layer.hasDynamic = dynamic;
+        layer.stale = false;
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+}
+
+void ShadowMaps::configure(const Shader& shader) const
+{
+    glActiveTexture(GL_TEXTURE0 + shadowTextureUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, shadowTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.setBool("shadowsOn", layerCount > 0);
+    for (int i = 0; i < layerCount; i++)
+        shader.setMat4("shadowMatrices[" + std::to_string(i) + "]", layers[i].matrix());
+}
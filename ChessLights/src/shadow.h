@@ -0,0 +1,77 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "shader.h"
+#include "object.h"
+#include "renderqueue.h"
+#include "ringbuffer.h"
+
+// Texture unit the shadow maps are bound to, above the units materials use
+const int shadowTextureUnit = 15;
+const int shadowMapResolution = 1024;
+
+// Depth maps of the directional and point lights in one texture array: layer 0 for the
+// directional light, then six per point light, one for each cube face. Spotlights, which may
+// be many, have their shadows in the ShadowAtlas instead.
+//
+// Static casters are rendered into a second, cached array only when a layer's light matrix
+// changes. Every frame the cached layer is copied into the sampled array and the dynamic
+// casters are drawn over it; layers no dynamic caster touches are left alone entirely.
+class ShadowMaps
+{
+public:
+    ShadowMaps();
+    ~ShadowMaps();
+
+    ShadowMaps(const ShadowMaps&) = delete;
+    ShadowMaps& operator=(const ShadowMaps&) = delete;
+
+    // Works out the light matrices and writes their view blocks; before the ring is flushed
+    void upload(RingBuffer& ring, RenderQueue& queue, const LightProperty& lights, float time);
+    // Brings the layers up to date; restores the framebuffer and viewport it found
+    void render(RenderQueue& queue, const Shader& depthShader, const RenderQueue::ShaderSetup& setup);
+    // Sets the sampler and the light matrices of a program that receives shadows
+    void configure(const Shader& shader) const;
+
+    // Static casters changed, e.g. pieces were added; all cached layers are redrawn
+    void invalidate();
+
+    // Cached layers redrawn in the last render()
+    unsigned int staticRedraws = 0;
+
+private:
+    struct Layer
+    {
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::vec3 position;
+        GLintptr viewBlock = 0;
+        bool uploaded = false;
+        // Light matrix the cached layer was drawn with
+        glm::mat4 cachedMatrix;
+        bool cacheValid = false;
+        // The sampled layer holds dynamic casters that have to be cleared next frame
+        bool hasDynamic = false;
+        // The sampled layer does not match the cached one plus this frame's dynamic casters
+        bool stale = true;
+
+        glm::mat4 matrix() const
+        {
+            return projection * view;
+        }
+    };
+
+    GLuint shadowTexture = 0;
+    GLuint staticTexture = 0;
+    GLuint shadowFramebuffer = 0;
+    GLuint staticFramebuffer = 0;
+    int layerCount = 0;
+    std::vector<Layer> layers;
+
+    void allocate(int count);
+    void drawLayer(GLuint framebuffer, GLuint texture, int layer);
+};
@@ -0,0 +1,436 @@
+#include "shadowatlas.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+const float spotShadowNear = 0.1f;
+const float spotShadowFar = 50.0f;
+// A light's reach ends where it falls below this fraction of its colour
+const float spotFalloff = 1.0f / 16.0f;
+// Lights spanning this much of the screen height are due every frame, smaller ones less often
+const float everyFrameCoverage = 0.5f;
+const int maxRedrawInterval = 8;
+
+static int levelOf(int size)
+{
+    int level = 0;
+    for (int side = ShadowAtlas::atlasSize; side > size; side /= 2)
+        level++;
+    return level;
+}
+
+// Distance at which the light's attenuation drops below spotFalloff
+static float spotRange(const SpotLight& spot)
+{
+    float brightest = std::max(spot.diffuse.r, std::max(spot.diffuse.g, spot.diffuse.b));
+    float target = brightest / spotFalloff - spot.constant;
+    if (target <= 0.0f)
+        return spotShadowNear * 2.0f;
+    float range = spot.quadratic > 0.0f
+        ? (-spot.linear + std::sqrt(spot.linear * spot.linear + 4.0f * spot.quadratic * target)) / (2.0f * spot.quadratic)
+        : (spot.linear > 0.0f ? target / spot.linear : spotShadowFar);
+    return glm::clamp(range, spotShadowNear * 2.0f, spotShadowFar);
+}
+
+static glm::vec3 upFor(const glm::vec3& direction)
+{
+    return std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+static GLuint createDepthTexture(bool compare)
+{
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, ShadowAtlas::atlasSize, ShadowAtlas::atlasSize, 0,
+        GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, compare ? GL_LINEAR : GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    if (compare)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+ShadowAtlas::ShadowAtlas()
+{
+    shadowTexture = createDepthTexture(true);
+    staticTexture = createDepthTexture(false);
+    glGenFramebuffers(1, &shadowFramebuffer);
+    glGenFramebuffers(1, &staticFramebuffer);
+    // Depth only, each framebuffer keeps its texture for good
+    glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, staticFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, staticTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    freeTiles.resize(levelOf(minTileSize) + 1);
+    freeTiles[0].push_back(glm::ivec2(0));
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+    glDeleteTextures(1, &shadowTexture);
+    glDeleteTextures(1, &staticTexture);
+    glDeleteFramebuffers(1, &shadowFramebuffer);
+    glDeleteFramebuffers(1, &staticFramebuffer);
+}
+
+void ShadowAtlas::invalidate()
+{
+    for (Tile& tile : tiles)
+        tile.cacheValid = false;
+}
+
+// Takes the square from the smallest free one that holds it, splitting that into quarters
+bool ShadowAtlas::allocateTile(int size, glm::ivec2& corner)
+{
+    int level = levelOf(size);
+    int source = level;
+    while (source >= 0 && freeTiles[source].empty())
+        source--;
+    if (source < 0)
+        return false;
+
+    corner = freeTiles[source].back();
+    freeTiles[source].pop_back();
+    for (int l = source + 1; l <= level; l++)
+    {
+        int half = atlasSize >> l;
+        freeTiles[l].push_back(corner + glm::ivec2(half, 0));
+        freeTiles[l].push_back(corner + glm::ivec2(0, half));
+        freeTiles[l].push_back(corner + glm::ivec2(half, half));
+    }
+    return true;
+}
+
+// Returns the square, merging it with its three buddies whenever they are all free
+void ShadowAtlas::freeTile(int size, const glm::ivec2& corner)
+{
+    glm::ivec2 square = corner;
+    for (int level = levelOf(size); level > 0; level--)
+    {
+        int parentSize = atlasSize >> (level - 1);
+        glm::ivec2 parent(square.x & ~(parentSize - 1), square.y & ~(parentSize - 1));
+        int half = parentSize / 2;
+        std::vector<glm::ivec2>& free = freeTiles[level];
+        std::vector<size_t> buddies;
+        for (int quarter = 0; quarter < 4; quarter++)
+        {
+            glm::ivec2 buddy = parent + glm::ivec2((quarter & 1) * half, (quarter >> 1) * half);
+            if (buddy == square)
+                continue;
+            auto found = std::find(free.begin(), free.end(), buddy);
+            if (found == free.end())
+                break;
+            buddies.push_back(found - free.begin());
+        }
+        if (buddies.size() != 3)
+        {
+            free.push_back(square);
+            return;
+        }
+
+        std::sort(buddies.rbegin(), buddies.rend());
+        for (size_t index : buddies)
+            free.erase(free.begin() + index);
+        square = parent;
+    }
+    freeTiles[0].push_back(square);
+}
+
+// Moves the tiles whose size changed, largest first; a tile that finds no room gets a smaller one
+void ShadowAtlas::place(const std::vector<int>& sizes)
+{
+    std::vector<size_t> moving;
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        Tile& tile = tiles[i];
+        if (tile.size == sizes[i])
+            continue;
+        if (tile.size > 0)
+            freeTile(tile.size, glm::ivec2(tile.x, tile.y));
+        tile.size = 0;
+        tile.ready = false;
+        tile.cacheValid = false;
+        moving.push_back(i);
+    }
+    std::stable_sort(moving.begin(), moving.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    for (size_t index : moving)
+    {
+        glm::ivec2 corner;
+        for (int size = sizes[index]; size >= minTileSize; size /= 2)
+        {
+            if (allocateTile(size, corner))
+            {
+                tiles[index].x = corner.x;
+                tiles[index].y = corner.y;
+                tiles[index].size = size;
+                break;
+            }
+        }
+    }
+}
+
+void ShadowAtlas::upload(RingBuffer& ring, RenderQueue& queue, const LightProperty& lights, const Camera& camera,
+    int screenHeight, float time)
+{
+    PROFILE_SCOPE("ShadowAtlas::upload");
+    size_t count = std::min(lights.spotLights.size(), (size_t)maxSpotLights);
+    for (size_t i = count; i < tiles.size(); i++)
+    {
+        if (tiles[i].size > 0)
+            freeTile(tiles[i].size, glm::ivec2(tiles[i].x, tiles[i].y));
+    }
+    tiles.resize(count);
+
+    glm::mat4 cameraMatrix = camera.getProjectionMatrix() * camera.getViewMatrix();
+    float tanHalfFov = std::tan(glm::radians(camera.Zoom) * 0.5f);
+    std::vector<int> sizes(count);
+    long long area = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const SpotLight& spot = lights.spotLights[i];
+        Tile& tile = tiles[i];
+        glm::vec3 direction = glm::normalize(spot.direction);
+        float halfAngle = std::acos(glm::clamp(spot.outerCutOff, -1.0f, 1.0f));
+        float range = spotRange(spot);
+        // The cone plus a margin, so PCF at the rim stays inside the tile
+        float fov = std::min(2.0f * halfAngle + glm::radians(10.0f), glm::radians(170.0f));
+        tile.position = spot.position;
+        tile.view = glm::lookAt(spot.position, spot.position + direction, upFor(direction));
+        tile.projection = glm::perspective(fov, 1.0f, spotShadowNear, range);
+
+        // Screen coverage of a sphere around the cone
+        glm::vec3 center = spot.position + direction * (range * 0.5f);
+        float radius = glm::length(glm::vec2(range * 0.5f, range * std::tan(std::min(halfAngle, glm::radians(80.0f)))));
+        float distance = glm::length(center - camera.Position);
+        if (!RenderQueue::sphereInView(center, radius, cameraMatrix))
+            tile.coverage = 0.0f;
+        else
+            tile.coverage = distance <= radius ? 1.0f : std::min(1.0f, radius / (distance * tanHalfFov));
+
+        // About a texel per pixel; the size only changes once the ideal is well past it, so tiles
+        // do not hop around the atlas while a light drifts across a boundary
+        float ideal = tile.coverage * (float)screenHeight;
+        int size = tile.size;
+        if (size == 0 || ideal > size * 1.5f || ideal < size * 0.375f)
+        {
+            size = minTileSize;
+            while (size < maxTileSize && (float)size < ideal)
+                size *= 2;
+        }
+        sizes[i] = size;
+        area += (long long)size * size;
+    }
+
+    // Everything has to fit: halve the largest tiles, the least covering of them first
+    while (area > (long long)atlasSize * atlasSize)
+    {
+        size_t largest = 0;
+        for (size_t i = 1; i < count; i++)
+        {
+            if (sizes[i] > sizes[largest] || (sizes[i] == sizes[largest] && tiles[i].coverage < tiles[largest].coverage))
+                largest = i;
+        }
+        if (sizes[largest] <= minTileSize)
+            break;
+        area -= (long long)sizes[largest] * sizes[largest] * 3 / 4;
+        sizes[largest] /= 2;
+    }
+
+    place(sizes);
+    schedule(queue);
+
+    for (Tile& tile : tiles)
+    {
+        if (tile.scheduled)
+            tile.scheduled = queue.uploadView(ring, tile.projection, tile.view, tile.position, time, tile.viewBlock);
+    }
+}
+
+// Picks the tiles to redraw this frame: tiles that have never been drawn first, then the ones
+// most overdue for their light's refresh interval, until the texel budget is spent
+void ShadowAtlas::schedule(RenderQueue& queue)
+{
+    struct Candidate
+    {
+        size_t tile;
+        float score;
+        long long cost;
+    };
+    std::vector<Candidate> candidates;
+
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        Tile& tile = tiles[i];
+        tile.scheduled = false;
+        tile.framesWaiting++;
+        // Lights out of view can wait until they come back
+        if (tile.size == 0 || tile.coverage == 0.0f)
+            continue;
+
+        glm::mat4 matrix = tile.matrix();
+        bool moved = !tile.cacheValid || matrix != tile.cachedMatrix;
+        tile.dynamic = queue.hasCasters(DynamicCaster, matrix);
+        // Nothing changed for this light: the tile is still exact
+        if (tile.ready && !moved && !tile.dynamic && !tile.hasDynamic)
+            continue;
+
+        int interval = glm::clamp((int)(everyFrameCoverage / tile.coverage), 1, maxRedrawInterval);
+        if (moved)
+            interval = (interval + 1) / 2;
+        float score = tile.ready ? (float)tile.framesWaiting / (float)interval : 1e9f + tile.coverage;
+        if (score < 1.0f)
+            continue;
+        candidates.push_back({ i, score, (long long)tile.size * tile.size * (moved ? 2 : 1) });
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [&](const Candidate& a, const Candidate& b)
+    {
+        if (a.score != b.score)
+            return a.score > b.score;
+        if (tiles[a.tile].coverage != tiles[b.tile].coverage)
+            return tiles[a.tile].coverage > tiles[b.tile].coverage;
+        return a.tile < b.tile;
+    });
+
+    long long spent = 0;
+    for (const Candidate& candidate : candidates)
+    {
+        if (spent + candidate.cost > texelBudget && spent > 0)
+            continue;
+        tiles[candidate.tile].scheduled = true;
+        spent += candidate.cost;
+    }
+}
+
+void ShadowAtlas::render(RenderQueue& queue, const Shader& depthShader, const RenderQueue::ShaderSetup& setup)
+{
+    PROFILE_SCOPE("ShadowAtlas::render");
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+    // Clears and blits stay inside the tile
+    glEnable(GL_SCISSOR_TEST);
+    tilesDrawn = 0;
+    staticRedraws = 0;
+    texelsDrawn = 0;
+
+    for (Tile& tile : tiles)
+    {
+        if (!tile.scheduled)
+            continue;
+
+        glViewport(tile.x, tile.y, tile.size, tile.size);
+        glScissor(tile.x, tile.y, tile.size, tile.size);
+        long long area = (long long)tile.size * tile.size;
+        glm::mat4 matrix = tile.matrix();
+        if (!tile.cacheValid || matrix != tile.cachedMatrix)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, staticFramebuffer);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            queue.drawCasters(depthShader, setup, tile.viewBlock, StaticCaster, matrix);
+            tile.cachedMatrix = matrix;
+            tile.cacheValid = true;
+            staticRedraws++;
+            texelsDrawn += area;
+        }
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowFramebuffer);
+        glBlitFramebuffer(tile.x, tile.y, tile.x + tile.size, tile.y + tile.size,
+            tile.x, tile.y, tile.x + tile.size, tile.y + tile.size, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        if (tile.dynamic)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, shadowFramebuffer);
+            queue.drawCasters(depthShader, setup, tile.viewBlock, DynamicCaster, matrix);
+        }
+        tile.hasDynamic = tile.dynamic;
+        tile.drawnMatrix = matrix;
+        tile.ready = true;
+        tile.framesWaiting = 0;
+        tile.scheduled = false;
+        tilesDrawn++;
+        texelsDrawn += area;
+    }
+
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+}
+
+void ShadowAtlas::configure() const
+{
+    glActiveTexture(GL_TEXTURE0 + spotShadowTextureUnit);
+    glBindTexture(GL_TEXTURE_2D, shadowTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+bool ShadowAtlas::getTile(size_t light, glm::mat4& matrix, glm::vec4& rect) const
+{
+    if (light >= tiles.size() || !tiles[light].ready)
+        return false;
+
+    // Clip space of the light onto the tile's square, depth onto [0, 1]
+    const Tile& tile = tiles[light];
+    float scale = (float)tile.size / atlasSize;
+    glm::vec2 corner = glm::vec2((float)tile.x, (float)tile.y) / (float)atlasSize;
+    glm::mat4 toTile = glm::translate(glm::mat4(1.0f), glm::vec3(corner + glm::vec2(scale * 0.5f), 0.5f))
+        * glm::scale(glm::mat4(1.0f), glm::vec3(scale * 0.5f, scale * 0.5f, 0.5f));
+    matrix = toTile * tile.drawnMatrix;
+    rect = glm::vec4(corner, corner + glm::vec2(scale));
+    return true;
+}
+
+bool uploadSpotLights(RingBuffer& ring, RenderQueue& queue, const LightProperty& lights, const ShadowAtlas* atlas)
+{
+    SpotLightData* data = queue.uploadSpotLights(ring);
+    if (data == nullptr)
+        return false;
+
+    int count = (int)std::min(lights.spotLights.size(), (size_t)maxSpotLights);
+    for (int i = 0; i < count; i++)
+    {
+        const SpotLight& spot = lights.spotLights[i];
+        SpotLightBlock& block = data->spotLights[i];
+        block.position = spot.position;
+        block.cutOff = spot.cutOff;
+        block.direction = spot.direction;
+        block.outerCutOff = spot.outerCutOff;
+        block.ambient = spot.ambient;
+        block.constant = spot.constant;
+        block.diffuse = spot.diffuse;
+        block.linear = spot.linear;
+        block.specular = spot.specular;
+        block.quadratic = spot.quadratic;
+        // An empty rect leaves the light unshadowed
+        if (!atlas || !atlas->getTile(i, block.shadowMatrix, block.shadowRect))
+        {
+            block.shadowMatrix = glm::mat4(1.0f);
+            block.shadowRect = glm::vec4(0.0f);
+        }
+    }
+    data->spotLightCount = count;
+    return true;
+}
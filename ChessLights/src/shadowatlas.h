@@ -0,0 +1,109 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "shader.h"
+#include "camera.h"
+#include "object.h"
+#include "renderqueue.h"
+#include "ringbuffer.h"
+
+// Texture unit the spotlight shadow atlas is bound to, below the shadow maps
+const int spotShadowTextureUnit = 13;
+
+// Shadows of every spotlight in one depth texture. Each light owns a square tile whose side
+// follows how much of the screen its cone covers, from minTileSize for lamps at the far end of
+// the hall to maxTileSize for the spotlight in front of the camera. Tiles come from a buddy
+// allocator and keep their place while their size holds, so their content can be reused.
+//
+// Tiles are not redrawn every frame. A scheduler picks the tiles that are due, by how long ago
+// they were drawn against how often their light needs it, and stops at texelBudget texels a
+// frame: moving and nearby lights get redrawn about every frame, far ones every few frames and
+// lights where nothing changed never. A tile that waits keeps the matrix it was drawn with, so
+// its shadow lags behind but stays where it was cast. Static casters are cached per tile as in
+// ShadowMaps.
+class ShadowAtlas
+{
+public:
+    static const int atlasSize = 4096;
+    static const int minTileSize = 128;
+    static const int maxTileSize = 1024;
+    // Texels drawn per frame; redrawing a tile's static casters counts its area twice
+    static const long long texelBudget = 4ll * 1024 * 1024;
+
+    ShadowAtlas();
+    ~ShadowAtlas();
+
+    ShadowAtlas(const ShadowAtlas&) = delete;
+    ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+
+    // Sizes and places the tiles, schedules this frame's redraws and writes their view blocks;
+    // before the ring is flushed
+    void upload(RingBuffer& ring, RenderQueue& queue, const LightProperty& lights, const Camera& camera,
+        int screenHeight, float time);
+    // Redraws the scheduled tiles; restores the framebuffer and viewport it found
+    void render(RenderQueue& queue, const Shader& depthShader, const RenderQueue::ShaderSetup& setup);
+    // Binds the atlas to its texture unit for the programs that receive shadows; their sampler is
+    // pointed at the unit by IluminatedObject::configureFrame
+    void configure() const;
+
+    // Static casters changed; every tile redraws them when it is next scheduled
+    void invalidate();
+
+    // Light space to atlas matrix and atlas rect of a spotlight's tile; false while it has none drawn
+    bool getTile(size_t light, glm::mat4& matrix, glm::vec4& rect) const;
+
+    // Tiles redrawn in the last render(), how many of them with their static casters, and their texels
+    unsigned int tilesDrawn = 0;
+    unsigned int staticRedraws = 0;
+    long long texelsDrawn = 0;
+
+private:
+    struct Tile
+    {
+        // Placement in the atlas, size 0 without one
+        int x = 0;
+        int y = 0;
+        int size = 0;
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::vec3 position;
+        // Fraction of the screen height the light's cone spans, 0 out of view
+        float coverage = 0.0f;
+        GLintptr viewBlock = 0;
+        bool scheduled = false;
+        // Light matrix the cached static casters were drawn with
+        glm::mat4 cachedMatrix;
+        bool cacheValid = false;
+        // The sampled tile has been drawn since it was placed, with drawnMatrix
+        bool ready = false;
+        glm::mat4 drawnMatrix;
+        bool hasDynamic = false;
+        bool dynamic = false;
+        int framesWaiting = 0;
+
+        glm::mat4 matrix() const
+        {
+            return projection * view;
+        }
+    };
+
+    GLuint shadowTexture = 0;
+    GLuint staticTexture = 0;
+    GLuint shadowFramebuffer = 0;
+    GLuint staticFramebuffer = 0;
+    std::vector<Tile> tiles;
+    // Free squares of the buddy allocator, per size from atlasSize down to minTileSize
+    std::vector<std::vector<glm::ivec2>> freeTiles;
+
+    bool allocateTile(int size, glm::ivec2& corner);
+    void freeTile(int size, const glm::ivec2& corner);
+    void place(const std::vector<int>& sizes);
+    void schedule(RenderQueue& queue);
+};
+
+// Fills this frame's SpotLightData; spotlights get their shadows from the atlas when one is given
+bool uploadSpotLights(RingBuffer& ring, RenderQueue& queue, const LightProperty& lights, const ShadowAtlas* atlas);
@@ -0,0 +1,242 @@
+#include "sharedframes.h"
+
+#include <cerrno>
+#include <iostream>
+
+#ifdef __linux__
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const size_t pageSize = 4096;
+
+static size_t alignToPage(size_t size)
+{
+    return (size + pageSize - 1) & ~(pageSize - 1);
+}
+
+SharedFrameServer::~SharedFrameServer()
+{
+    close();
+}
+
+bool SharedFrameServer::open(const std::string& socketPath, int width, int height, unsigned int slotCount)
+{
+    sockaddr_un address = {};
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cout << "ERROR::SHARED_FRAMES::SOCKET_PATH_TOO_LONG: " << socketPath << std::endl;
+        return false;
+    }
+
+    size_t stride = (size_t)width * 4;
+    size_t slotOffset = alignToPage(sizeof(SharedFrameHeader));
+    size_t pixelOffset = alignToPage(sizeof(SharedFrameSlot));
+    size_t slotSize = alignToPage(pixelOffset + stride * height);
+    memorySize = slotOffset + slotSize * slotCount;
+
+    memoryFd = (int)syscall(SYS_memfd_create, "chesslights-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memoryFd < 0 || ftruncate(memoryFd, (off_t)memorySize) != 0)
+    {
+        std::cout << "ERROR::SHARED_FRAMES::MEMFD_FAILED: " << std::strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+    // Consumers can rely on the size staying as it is
+    fcntl(memoryFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    void* mapped = mmap(nullptr, memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        std::cout << "ERROR::SHARED_FRAMES::MMAP_FAILED: " << std::strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+    memory = (uint8_t*)mapped;
+
+    SharedFrameHeader* ring = header();
+    ring->magic = sharedFrameMagic;
+    ring->version = sharedFrameVersion;
+    ring->slotCount = slotCount;
+    ring->format = SharedFrameRGBA8BottomUp;
+    ring->width = (uint32_t)width;
+    ring->height = (uint32_t)height;
+    ring->stride = (uint32_t)stride;
+    ring->slotOffset = slotOffset;
+    ring->slotSize = slotSize;
+    ring->published.store(0, std::memory_order_relaxed);
+    for (unsigned int i = 0; i < slotCount; i++)
+    {
+        slot(i)->sequence.store(0, std::memory_order_relaxed);
+        slot(i)->pixelOffset = pixelOffset;
+    }
+
+    this->socketPath = socketPath;
+    listenSocket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, socketPath.c_str());
+    unlink(socketPath.c_str());
+    if (listenSocket < 0 || bind(listenSocket, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenSocket, 8) != 0)
+    {
+        std::cout << "ERROR::SHARED_FRAMES::SOCKET_FAILED: " << socketPath << ": " << std::strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SharedFrameServer::publish(const uint8_t* pixels, int width, int height, uint64_t frame)
+{
+    if (!memory)
+        return;
+
+    SharedFrameHeader* ring = header();
+    if ((uint32_t)width != ring->width || (uint32_t)height != ring->height)
+    {
+        std::cout << "ERROR::SHARED_FRAMES::FRAME_SIZE_CHANGED" << std::endl;
+        return;
+    }
+
+    updateConsumers();
+
+    uint32_t published = ring->published.load(std::memory_order_relaxed);
+    SharedFrameSlot* target = slot(published % ring->slotCount);
+
+    // Odd while the pixels are being replaced
+    uint32_t sequence = target->sequence.load(std::memory_order_relaxed);
+    target->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    target->frame = frame;
+    target->timestamp = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+    std::memcpy((uint8_t*)target + target->pixelOffset, pixels, (size_t)ring->stride * ring->height);
+
+    target->sequence.store(sequence + 2, std::memory_order_release);
+    ring->published.store(published + 1, std::memory_order_release);
+
+    syscall(SYS_futex, &ring->published, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+    uint64_t one = 1;
+    for (const Consumer& consumer : consumers)
+    {
+        // A full counter only means the consumer has not caught up yet
+        ssize_t written = write(consumer.event, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+void SharedFrameServer::updateConsumers()
+{
+    while (true)
+    {
+        int client = accept4(listenSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client < 0)
+            break;
+
+        Consumer consumer = { client, eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) };
+
+        // The memfd and the consumer's eventfd travel as ancillary data next to the header size
+        uint64_t headerSize = sizeof(SharedFrameHeader);
+        iovec payload = { &headerSize, sizeof(headerSize) };
+        int fds[2] = { memoryFd, consumer.event };
+        char control[CMSG_SPACE(sizeof(fds))] = {};
+        msghdr message = {};
+        message.msg_iov = &payload;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        cmsghdr* rights = CMSG_FIRSTHDR(&message);
+        rights->cmsg_level = SOL_SOCKET;
+        rights->cmsg_type = SCM_RIGHTS;
+        rights->cmsg_len = CMSG_LEN(sizeof(fds));
+        std::memcpy(CMSG_DATA(rights), fds, sizeof(fds));
+
+        if (consumer.event < 0 || sendmsg(client, &message, MSG_NOSIGNAL) < 0)
+        {
+            std::cout << "ERROR::SHARED_FRAMES::HANDSHAKE_FAILED: " << std::strerror(errno) << std::endl;
+            if (consumer.event >= 0)
+                ::close(consumer.event);
+            ::close(client);
+            continue;
+        }
+        consumers.push_back(consumer);
+    }
+
+    for (size_t i = 0; i < consumers.size();)
+    {
+        pollfd state = { consumers[i].socket, 0, 0 };
+        if (poll(&state, 1, 0) > 0 && (state.revents & (POLLHUP | POLLERR)))
+        {
+            ::close(consumers[i].socket);
+            ::close(consumers[i].event);
+            consumers[i] = consumers.back();
+            consumers.pop_back();
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
+
+void SharedFrameServer::close()
+{
+    for (const Consumer& consumer : consumers)
+    {
+        ::close(consumer.socket);
+        ::close(consumer.event);
+    }
+    consumers.clear();
+
+    if (listenSocket >= 0)
+    {
+        ::close(listenSocket);
+        unlink(socketPath.c_str());
+        listenSocket = -1;
+    }
+    if (memory)
+    {
+        munmap(memory, memorySize);
+        memory = nullptr;
+    }
+    if (memoryFd >= 0)
+    {
+        ::close(memoryFd);
+        memoryFd = -1;
+    }
+}
+
+#else
+
+SharedFrameServer::~SharedFrameServer()
+{
+}
+
+bool SharedFrameServer::open(const std::string& socketPath, int width, int height, unsigned int slotCount)
+{
+    std::cout << "ERROR::SHARED_FRAMES::UNSUPPORTED: shared memory frames need Linux" << std::endl;
+    return false;
+}
+
+void SharedFrameServer::publish(const uint8_t* pixels, int width, int height, uint64_t frame)
+{
+}
+
+void SharedFrameServer::close()
+{
+}
+
+void SharedFrameServer::updateConsumers()
+{
+}
+
+#endif
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Layout of the shared frame ring, shared with the consumer processes.
+// One memfd holds a SharedFrameHeader followed by slotCount slots, each a SharedFrameSlot
+// and then the pixels, starting at slotOffset + i * slotSize. Offsets are page aligned.
+//
+// A slot's sequence is odd while the renderer writes into it and even once it is complete,
+// like a seqlock: a consumer reads the sequence, uses the pixels in place, and only trusts
+// what it read if the sequence is still the same afterwards. With several slots the renderer
+// only comes back to a slot after slotCount - 1 more frames.
+//
+// Consumers wait for published to change with a futex (shared, not private) on its address,
+// or for their eventfd to become readable.
+
+const uint32_t sharedFrameMagic = 0x52464C43; // "CLFR"
+const uint32_t sharedFrameVersion = 1;
+
+enum SharedFrameFormat : uint32_t
+{
+    // 8 bits per channel, rows bottom-up as OpenGL returns them
+    SharedFrameRGBA8BottomUp = 0
+};
+
+struct SharedFrameHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t padding;
+    uint64_t slotOffset;
+    uint64_t slotSize;
+    // Number of frames published so far, also the futex word
+    std::atomic<uint32_t> published;
+};
+
+struct SharedFrameSlot
+{
+    std::atomic<uint32_t> sequence;
+    uint32_t padding;
+    // Running number of the frame, starting at 0
+    uint64_t frame;
+    // CLOCK_MONOTONIC in nanoseconds when the frame was published
+    uint64_t timestamp;
+    // Pixels follow at pixelOffset from the start of the slot
+    uint64_t pixelOffset;
+};
+
+// Publishes frames to local consumer processes through shared memory (Linux only).
+// Consumers connect to a Unix socket and receive the memfd and an eventfd of their own;
+// they map the ring read-only, so the only copy is the one out of the readback buffer.
+class SharedFrameServer
+{
+public:
+    ~SharedFrameServer();
+
+    // Creates the ring for frames of the given size and listens on socketPath
+    bool open(const std::string& socketPath, int width, int height, unsigned int slotCount = defaultSlotCount);
+    // Copies a frame into the next slot and wakes the consumers; pixels are RGBA, bottom-up
+    void publish(const uint8_t* pixels, int width, int height, uint64_t frame);
+    void close();
+
+    bool isOpen() const
+    {
+        return memory != nullptr;
+    }
+
+    unsigned int getConsumerCount() const
+    {
+        return (unsigned int)consumers.size();
+    }
+
+private:
+    static const unsigned int defaultSlotCount = 4;
+
+    struct Consumer
+    {
+        int socket;
+        int event;
+    };
+
+    std::string socketPath;
+    int memoryFd = -1;
+    int listenSocket = -1;
+    uint8_t* memory = nullptr;
+    size_t memorySize = 0;
+    std::vector<Consumer> consumers;
+
+    SharedFrameHeader* header() const
+    {
+        return reinterpret_cast<SharedFrameHeader*>(memory);
+    }
+
+    SharedFrameSlot* slot(unsigned int index) const
+    {
+        return reinterpret_cast<SharedFrameSlot*>(memory + header()->slotOffset + header()->slotSize * index);
+    }
+
+    // Hands the memfd to newly connected consumers and forgets the ones that hung up
+    void updateConsumers();
+};
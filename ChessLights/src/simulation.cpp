@@ -0,0 +1,351 @@
+#include "simulation.h"
+#include "scene.h"
+#include "profiler.h"
+
+#include <cmath>
+
+constexpr double Simulation::tickDuration;
+
+// Ticks allowed to catch up in one go before the simulation drops time instead
+const int maxCatchUpTicks = 8;
+
+void configureLightProperty(LightProperty& prop)
+{
+    prop.dirLight.direction = { -0.2f, -1.0f, -0.3f };
+    prop.dirLight.ambient = { 0.5f, 0.5f, 0.5f };
+    prop.dirLight.diffuse = { 0.4f, 0.4f, 0.4f };
+    prop.dirLight.specular = { 0.5f, 0.5f, 0.5f };
+
+    PointLight p1;
+    p1.position = spherePosition1;
+    p1.ambient = { 0.1f, 0.1f, 0.1f };
+    p1.diffuse = { 1.0f, 1.0f, 0.9f };
+    p1.specular = { 0.1f, 0.1f, 0.1f };
+    p1.constant = 1.0f;
+    p1.linear = 0.09f;
+    p1.quadratic = 0.032f;
+    prop.pointLights.push_back(p1);
+
+    PointLight p2;
+    p2.position = spherePosition2;
+    p2.ambient = { 0.1f, 0.1f, 0.1f };
+    p2.diffuse = { 1.0f, 1.0f, 0.9f };
+    p2.specular = { 0.1f, 0.1f, 0.1f };
+    p2.constant = 1.0f;
+    p2.linear = 0.09f;
+    p2.quadratic = 0.032f;
+    prop.pointLights.push_back(p2);
+
+    SpotLight s1;
+    s1.position = spotLightPosition1;
+    s1.initialPosition = spotLightPosition1;
+    s1.pitch = -45.0f;
+    s1.yaw = -45.0f;
+    s1.ambient = { 0.1f, 0.1f, 0.1f };
+    s1.diffuse = { 1.0f, 1.0f, 1.0f };
+    s1.specular = { 1.0f, 1.0f, 1.0f };
+    s1.constant = 0.1f;
+    s1.linear = 0.01f;
+    s1.quadratic = 0.001f;
+    s1.cutOff = glm::cos(glm::radians(10.0f));
+    s1.outerCutOff = glm::cos(glm::radians(20.0f));
+    prop.spotLights.push_back(s1);
+    // Instead of setting direction, calculate it with pitch and yaw.
+    prop.processMovement(U, 0);
+}
+
+void addLamps(LightProperty& prop, int count)
+{
+    // A spiral of warm lamps over the hall, leaning in towards the board; every fourth one sways
+    const float goldenAngle = 137.508f;
+    for (int i = 0; i < count; i++)
+    {
+        float angle = goldenAngle * i;
+        float radius = 4.0f + 2.4f * std::sqrt((float)i);
+        SpotLight lamp;
+        lamp.position = glm::vec3(radius * cos(glm::radians(angle)), 4.5f, radius * sin(glm::radians(angle)));
+        lamp.initialPosition = lamp.position;
+        lamp.yaw = angle + 180.0f;
+        lamp.pitch = -70.0f;
+        lamp.ambient = { 0.02f, 0.02f, 0.015f };
+        lamp.diffuse = { 0.9f, 0.75f, 0.5f };
+        lamp.specular = { 0.3f, 0.3f, 0.25f };
+        lamp.constant = 1.0f;
+        lamp.linear = 0.22f;
+        lamp.quadratic = 0.2f;
+        lamp.cutOff = glm::cos(glm::radians(25.0f));
+        lamp.outerCutOff = glm::cos(glm::radians(35.0f));
+        lamp.fixed = true;
+        lamp.sway = i % 4 == 3 ? 12.0f : 0.0f;
+        lamp.aim(lamp.yaw, lamp.pitch);
+        prop.spotLights.push_back(lamp);
+    }
+}
+
+Simulation::Simulation() : staticPosition(staticCameraPos), staticPitch(staticCameraPitch), staticYaw(staticCameraYaw)
+{
+    configureLightProperty(lightProperty);
+    camera.setNewPosition(staticPosition, staticPitch, staticYaw);
+    startTime = std::chrono::steady_clock::now();
+
+    // The renderer always has a state to draw, even before the first tick
+    lightProperty.updateLight(conditionsController, king.offset);
+    publish();
+}
+
+Simulation::~Simulation()
+{
+    stop();
+}
+
+void Simulation::start()
+{
+    if (running) return;
+
+    startTime = std::chrono::steady_clock::now() - std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(tickCount * tickDuration));
+    running = true;
+    thread = std::thread(&Simulation::run, this);
+}
+
+void Simulation::stop()
+{
+    running = false;
+    if (thread.joinable())
+        thread.join();
+}
+
+double Simulation::now() const
+{
+    if (lockstep)
+        return lockstepTime;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void Simulation::run()
+{
+    PROFILE_THREAD("Simulation");
+    while (running)
+    {
+        runDueTicks(now());
+
+        double nextTick = (double)(tickCount + 1) * tickDuration;
+        double wait = nextTick - now();
+        if (wait > 0.0)
+            std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+    }
+}
+
+void Simulation::advance(double deltaTime)
+{
+    lockstep = true;
+    lockstepTime += deltaTime;
+    runDueTicks(lockstepTime);
+}
+
+void Simulation::runDueTicks(double time)
+{
+    int ticks = 0;
+    while ((double)(tickCount + 1) * tickDuration <= time)
+    {
+        if (ticks == maxCatchUpTicks)
+        {
+            // Too far behind, e.g. after a debugger break: skip ahead instead of spiralling
+            tickCount = (uint64_t)(time / tickDuration);
+            break;
+        }
+        tick(takeInput());
+        ticks++;
+    }
+}
+
+void Simulation::applyPreset(const SimulationPreset& preset)
+{
+    conditionsController.shadeMode = preset.shadeMode;
+    conditionsController.setFog(preset.fog);
+    conditionsController.lightsOn = preset.lightsOn;
+    conditionsController.timeStop = preset.timeStop;
+    conditionsController.setTimeOfDay(preset.timeOfDay);
+    depthPrePass = preset.depthPrePass;
+    shadows = preset.shadows;
+    bakedLighting = preset.bakedLighting;
+    ::addLamps(lightProperty, preset.lamps);
+
+    lightProperty.updateLight(conditionsController, king.offset);
+    publish();
+}
+
+void Simulation::addLamps(int count)
+{
+    ::addLamps(lightProperty, count);
+    publish();
+}
+
+void Simulation::setStaticView(const glm::vec3& position, float pitch, float yaw)
+{
+    staticPosition = position;
+    staticPitch = pitch;
+    staticYaw = yaw;
+    if (cameraMode == Static)
+        camera.setNewPosition(staticPosition, staticPitch, staticYaw);
+    publish();
+}
+
+void Simulation::addInput(uint32_t keys, float mouseX, float mouseY, float scroll)
+{
+    std::lock_guard<std::mutex> lock(inputMutex);
+    pendingInput.keys = keys;
+    pendingInput.mouseX += mouseX;
+    pendingInput.mouseY += mouseY;
+    pendingInput.scroll += scroll;
+}
+
+InputState Simulation::takeInput()
+{
+    std::lock_guard<std::mutex> lock(inputMutex);
+    InputState input = pendingInput;
+    pendingInput.mouseX = 0.0f;
+    pendingInput.mouseY = 0.0f;
+    pendingInput.scroll = 0.0f;
+    return input;
+}
+
+bool Simulation::update()
+{
+    return mailbox.update();
+}
+
+const RenderState& Simulation::latest() const
+{
+    return mailbox.front();
+}
+
+void Simulation::tick(const InputState& input)
+{
+    PROFILE_SCOPE("Simulation::tick");
+    float deltaTime = (float)tickDuration;
+
+    processInput(input, deltaTime);
+    conditionsController.updateTime(deltaTime);
+    king.move(deltaTime);
+    {
+        PROFILE_SCOPE("LightProperty::updateLight");
+        lightProperty.updateLight(conditionsController, king.offset, (float)((tickCount + 1) * tickDuration));
+    }
+    updateCamera();
+
+    tickCount++;
+    publish();
+}
+
+void Simulation::publish()
+{
+    RenderState& state = mailbox.back();
+    state.tick = tickCount;
+    state.time = (double)tickCount * tickDuration;
+    state.cameraPosition = camera.Position;
+    state.cameraPitch = camera.Pitch;
+    state.cameraYaw = camera.Yaw;
+    state.cameraZoom = camera.Zoom;
+    state.cameraMode = cameraMode;
+    state.king = king;
+    state.lights = lightProperty;
+    state.conditions = conditionsController.getConditions();
+    state.depthPrePass = depthPrePass;
+    state.shadows = shadows;
+    state.bakedLighting = bakedLighting;
+    state.plySkip = plySkip;
+    mailbox.publish();
+}
+
+void Simulation::updateCamera()
+{
+    if (cameraMode == Tracking)
+    {
+        camera.setNewPosition(trackingCameraPos,
+            trackingCameraBasePitch + king.getPosition() * trackingCameraExtraPitch,
+            trackingCameraBaseYaw + king.getPosition() * trackingCameraExtraYaw);
+    }
+
+    if (cameraMode == POV)
+    {
+        camera.setNewPosition(POVCameraPos - glm::vec3(0.0f, 0.0f, king.offset), camera.Pitch, camera.Yaw);
+    }
+}
+
+void Simulation::changeCamera()
+{
+    if (cameraMode == Static) cameraMode = POV;
+    else if (cameraMode == POV) cameraMode = Tracking;
+    else if (cameraMode == Tracking) cameraMode = Free;
+    else cameraMode = Static;
+
+    if (cameraMode == Free)
+        camera.positionFixed = false;
+    else
+        camera.positionFixed = true;
+
+    if (cameraMode == Free || cameraMode == POV)
+        camera.mouseFixed = false;
+    else
+        camera.mouseFixed = true;
+
+    if (cameraMode == Static)
+    {
+        camera.setNewPosition(staticPosition, staticPitch, staticYaw);
+    }
+}
+
+void Simulation::processInput(const InputState& input, float deltaTime)
+{
+    PROFILE_SCOPE("Simulation::processInput");
+    // Toggles fire once per key press
+    uint32_t pressed = input.keys & ~previousKeys;
+    previousKeys = input.keys;
+
+    if (pressed & (1u << KeyFog))
+        conditionsController.changeFog();
+    if (pressed & (1u << KeyCamera))
+        changeCamera();
+    if (pressed & (1u << KeyShaking))
+        conditionsController.objectShaking = !conditionsController.objectShaking;
+    if (pressed & (1u << KeyLights))
+        conditionsController.lightsOn = !conditionsController.lightsOn;
+    if (pressed & (1u << KeyTime))
+        conditionsController.timeStop = !conditionsController.timeStop;
+    if (pressed & (1u << KeyShadeMode))
+        conditionsController.shadeMode = (conditionsController.shadeMode == 2 ? 0 : conditionsController.shadeMode + 1);
+    if (pressed & (1u << KeyDepthPrePass))
+        depthPrePass = !depthPrePass;
+    if (pressed & (1u << KeyShadows))
+        shadows = !shadows;
+    if (pressed & (1u << KeyBakedLighting))
+        bakedLighting = !bakedLighting;
+    if (pressed & (1u << KeyPlyBack))
+        plySkip -= plySkipStep;
+    if (pressed & (1u << KeyPlyForward))
+        plySkip += plySkipStep;
+
+    if (input.isDown(KeyForward))
+        camera.processKeyboard(FORWARD, deltaTime);
+    if (input.isDown(KeyBackward))
+        camera.processKeyboard(BACKWARD, deltaTime);
+    if (input.isDown(KeyLeft))
+        camera.processKeyboard(LEFT, deltaTime);
+    if (input.isDown(KeyRight))
+        camera.processKeyboard(RIGHT, deltaTime);
+
+    if (input.mouseX != 0.0f || input.mouseY != 0.0f)
+        camera.processMouseMovement(input.mouseX, input.mouseY);
+    if (input.scroll != 0.0f)
+        camera.processMouseScroll(input.scroll);
+
+    if (input.isDown(KeyLightUp))
+        lightProperty.processMovement(U, deltaTime);
+    if (input.isDown(KeyLightLeft))
+        lightProperty.processMovement(L, deltaTime);
+    if (input.isDown(KeyLightRight))
+        lightProperty.processMovement(R, deltaTime);
+    if (input.isDown(KeyLightDown))
+        lightProperty.processMovement(D, deltaTime);
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "camera.h"
+#include "weather.h"
+#include "object.h"
+#include "mailbox.h"
+
+// Keys the simulation reacts to, sampled by the render thread every frame
+enum InputKey
+{
+    KeyFog,
+    KeyCamera,
+    KeyShaking,
+    KeyLights,
+    KeyTime,
+    KeyShadeMode,
+    KeyDepthPrePass,
+    KeyForward,
+    KeyBackward,
+    KeyLeft,
+    KeyRight,
+    KeyLightUp,
+    KeyLightDown,
+    KeyLightLeft,
+    KeyLightRight,
+    // Later additions go last, so recorded input logs keep their meaning
+    KeyShadows,
+    KeyBakedLighting,
+    KeyPlyBack,
+    KeyPlyForward,
+    InputKeyCount
+};
+
+struct InputState
+{
+    uint32_t keys = 0;
+    // Mouse and scroll offsets accumulated since the previous tick
+    float mouseX = 0.0f;
+    float mouseY = 0.0f;
+    float scroll = 0.0f;
+
+    bool isDown(InputKey key) const
+    {
+        return (keys & (1u << key)) != 0;
+    }
+};
+
+enum CameraMode
+{
+    Static,
+    POV,
+    Tracking,
+    Free
+};
+
+// Immutable result of one simulation tick, everything the renderer needs to draw a frame
+struct RenderState
+{
+    uint64_t tick = 0;
+    // Simulation time of the tick, in seconds since the simulation started
+    double time = 0.0;
+
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    float cameraPitch = 0.0f;
+    float cameraYaw = 0.0f;
+    float cameraZoom = ZOOM;
+    CameraMode cameraMode = Static;
+
+    KingMotion king;
+    LightProperty lights;
+    Conditions conditions;
+    bool depthPrePass = false;
+    bool shadows = true;
+    // Static objects take the sun and the point lights from the lightmap, when one is loaded
+    bool bakedLighting = true;
+    // Plies skipped back and forth through a game's playback, see PgnPlayer
+    int plySkip = 0;
+};
+
+// Starting conditions of a scripted run, replacing what the keys would toggle
+struct SimulationPreset
+{
+    int shadeMode = 0;
+    bool fog = false;
+    bool lightsOn = false;
+    bool depthPrePass = false;
+    // Fraction of the day cycle, see ConditionsController::setTimeOfDay
+    float timeOfDay = 0.25f;
+    // Holds the day cycle at timeOfDay
+    bool timeStop = true;
+    bool shadows = true;
+    bool bakedLighting = true;
+    // Spotlights hung over the hall besides the one following the king, see addLamps
+    int lamps = 0;
+};
+
+// Lights of the scene in their initial state
+void configureLightProperty(LightProperty& prop);
+// Adds count fixed spotlights around the board, some of them swaying
+void addLamps(LightProperty& prop, int count);
+
+// Runs input handling, animation and the day cycle on its own thread with a fixed time step.
+// Each tick is published to the render thread through a lock-free triple buffer.
+class Simulation
+{
+public:
+    static constexpr double tickDuration = 1.0 / 120.0;
+    // Plies one press of Page Up or Page Down skips
+    static const int plySkipStep = 10;
+
+    Simulation();
+    ~Simulation();
+
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    void start();
+    void stop();
+    // Alternative to start(): the caller's clock drives the simulation on the caller's thread.
+    // Runs every tick due within the next deltaTime seconds, so equal inputs give equal runs.
+    void advance(double deltaTime);
+
+    // Render thread: hand over the input sampled this frame
+    void addInput(uint32_t keys, float mouseX, float mouseY, float scroll);
+    // Render thread: picks up the newest tick, returns false when there is none
+    bool update();
+    const RenderState& latest() const;
+
+    // Seconds since the simulation started, on the clock the ticks are scheduled with
+    double now() const;
+
+    // Applies the preset and publishes it; only before start() or with advance()
+    void applyPreset(const SimulationPreset& preset);
+    // Hangs more lamps over the hall and publishes them; likewise
+    void addLamps(int count);
+    // Moves the Static camera mode's view, and the camera when it is in that mode; likewise
+    void setStaticView(const glm::vec3& position, float pitch, float yaw);
+
+    // Advances the simulation by exactly one tick
+    void tick(const InputState& input);
+
+private:
+    std::thread thread;
+    std::atomic<bool> running{ false };
+    std::chrono::steady_clock::time_point startTime;
+    // Set once advance() drives the simulation instead of the thread
+    bool lockstep = false;
+    double lockstepTime = 0.0;
+
+    std::mutex inputMutex;
+    InputState pendingInput;
+
+    TripleBuffer<RenderState> mailbox;
+
+    // Owned by the simulation thread once started
+    Camera camera;
+    CameraMode cameraMode = Static;
+    glm::vec3 staticPosition;
+    float staticPitch;
+    float staticYaw;
+    ConditionsController conditionsController;
+    LightProperty lightProperty;
+    KingMotion king;
+    bool depthPrePass = false;
+    bool shadows = true;
+    bool bakedLighting = true;
+    int plySkip = 0;
+    uint32_t previousKeys = 0;
+    uint64_t tickCount = 0;
+
+    void run();
+    void runDueTicks(double time);
+    InputState takeInput();
+    void processInput(const InputState& input, float deltaTime);
+    void changeCamera();
+    void updateCamera();
+    void publish();
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// Node of the transform hierarchy. Keeps a local matrix and a cached world matrix;
+// the world matrix is only rebuilt when the node or one of its parents changed.
+class Transform
+{
+public:
+    Transform() = default;
+
+    ~Transform()
+    {
+        setParent(nullptr);
+        for (Transform* child : children)
+        {
+            child->parent = nullptr;
+            child->markDirty();
+        }
+    }
+
+    Transform(const Transform&) = delete;
+    Transform& operator=(const Transform&) = delete;
+
+    void setLocal(const glm::mat4& matrix)
+    {
+        local = matrix;
+        markDirty();
+    }
+
+    const glm::mat4& getLocal() const
+    {
+        return local;
+    }
+
+    const glm::mat4& getWorld() const
+    {
+        if (dirty)
+        {
+            world = parent ? parent->getWorld() * local : local;
+            dirty = false;
+            version++;
+        }
+        return world;
+    }
+
+    // Increases every time the world matrix is rebuilt, so dependent caches can tell it changed
+    unsigned int getVersion() const
+    {
+        getWorld();
+        return version;
+    }
+
+    void setParent(Transform* newParent)
+    {
+        if (parent == newParent) return;
+
+        if (parent)
+            parent->children.erase(std::remove(parent->children.begin(), parent->children.end(), this), parent->children.end());
+        parent = newParent;
+        if (parent)
+            parent->children.push_back(this);
+        markDirty();
+    }
+
+    Transform* getParent() const
+    {
+        return parent;
+    }
+
+private:
+    glm::mat4 local = glm::mat4(1.0f);
+    mutable glm::mat4 world = glm::mat4(1.0f);
+    mutable bool dirty = true;
+    mutable unsigned int version = 0;
+
+    Transform* parent = nullptr;
+    std::vector<Transform*> children;
+
+    void markDirty()
+    {
+        // A dirty node always has dirty descendants, so there is nothing left to propagate
+        if (dirty) return;
+        dirty = true;
+        for (Transform* child : children)
+            child->markDirty();
+    }
+};
@@ -0,0 +1,199 @@
+#include "video.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#endif
+
+VideoWriter::~VideoWriter()
+{
+    close();
+}
+
+VideoFormat VideoWriter::formatFor(const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot);
+    if (extension == ".raw" || extension == ".rgba")
+        return RawVideo;
+    return Y4MVideo;
+}
+
+bool VideoWriter::open(const std::string& path, int width, int height, int framesPerSecond)
+{
+    if (path == "-")
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        file = stdout;
+        ownsFile = false;
+    }
+    else
+    {
+        // Blocks until a reader opens the other end when the path is a named pipe
+        file = std::fopen(path.c_str(), "wb");
+        ownsFile = true;
+    }
+    if (!file)
+    {
+        std::cout << "ERROR::VIDEO::CANNOT_OPEN: " << path << std::endl;
+        return false;
+    }
+
+#ifndef _WIN32
+    // An encoder that exits early must not kill the renderer; fwrite reports it instead
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    format = formatFor(path);
+    this->width = width;
+    this->height = height;
+    if (format == Y4MVideo)
+    {
+        std::fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n",
+            width, height, framesPerSecond);
+    }
+
+    closing = false;
+    failed = false;
+    thread = std::thread(&VideoWriter::writeLoop, this);
+    return true;
+}
+
+void VideoWriter::write(std::shared_ptr<CapturedFrame> frame)
+{
+    if (!file || failed.load())
+        return;
+    if (frame->width != width || frame->height != height)
+    {
+        std::cout << "ERROR::VIDEO::FRAME_SIZE_CHANGED" << std::endl;
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (queue.size() >= maxQueuedFrames)
+    {
+        waits++;
+        queueChanged.wait(lock, [this] { return queue.size() < maxQueuedFrames || failed.load(); });
+    }
+    queue.push_back(std::move(frame));
+    queueChanged.notify_all();
+}
+
+void VideoWriter::close()
+{
+    if (!file)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    queueChanged.notify_all();
+    thread.join();
+
+    std::fflush(file);
+    if (ownsFile)
+        std::fclose(file);
+    file = nullptr;
+}
+
+void VideoWriter::writeLoop()
+{
+    while (true)
+    {
+        std::shared_ptr<CapturedFrame> frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queueChanged.wait(lock, [this] { return !queue.empty() || closing; });
+            if (queue.empty())
+                return;
+            frame = std::move(queue.front());
+            queue.pop_front();
+        }
+        queueChanged.notify_all();
+
+        if (failed.load())
+            continue;
+        if (!writeFrame(*frame))
+        {
+            std::cout << "ERROR::VIDEO::WRITE_FAILED after " << framesWritten.load() << " frames" << std::endl;
+            failed = true;
+            queueChanged.notify_all();
+            continue;
+        }
+        framesWritten++;
+    }
+}
+
+static uint8_t clampByte(int value)
+{
+    return (uint8_t)std::min(std::max(value, 0), 255);
+}
+
+bool VideoWriter::writeFrame(const CapturedFrame& frame)
+{
+    const uint8_t* pixels = frame.pixels.data();
+    size_t stride = (size_t)width * 4;
+
+    if (format == RawVideo)
+    {
+        // glReadPixels rows are bottom-up
+        buffer.resize(stride * height);
+        for (int y = 0; y < height; y++)
+            std::memcpy(&buffer[y * stride], pixels + (height - 1 - y) * stride, stride);
+        return std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    }
+
+    // BT.601 in limited range, 8-bit fixed point. Chroma is the average of each 2x2 block.
+    int chromaWidth = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    size_t lumaSize = (size_t)width * height;
+    size_t chromaSize = (size_t)chromaWidth * chromaHeight;
+    buffer.resize(lumaSize + 2 * chromaSize);
+    uint8_t* lumaPlane = buffer.data();
+    uint8_t* uPlane = lumaPlane + lumaSize;
+    uint8_t* vPlane = uPlane + chromaSize;
+
+    for (int y = 0; y < height; y++)
+    {
+        const uint8_t* row = pixels + (height - 1 - y) * stride;
+        uint8_t* luma = lumaPlane + (size_t)y * width;
+        for (int x = 0; x < width; x++)
+        {
+            int r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+            luma[x] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        }
+    }
+
+    for (int cy = 0; cy < chromaHeight; cy++)
+    {
+        int y0 = cy * 2;
+        int y1 = std::min(y0 + 1, height - 1);
+        const uint8_t* row0 = pixels + (height - 1 - y0) * stride;
+        const uint8_t* row1 = pixels + (height - 1 - y1) * stride;
+        for (int cx = 0; cx < chromaWidth; cx++)
+        {
+            int x0 = cx * 2 * 4;
+            int x1 = std::min(cx * 2 + 1, width - 1) * 4;
+            int r = row0[x0] + row0[x1] + row1[x0] + row1[x1];
+            int g = row0[x0 + 1] + row0[x1 + 1] + row1[x0 + 1] + row1[x1 + 1];
+            int b = row0[x0 + 2] + row0[x1 + 2] + row1[x0 + 2] + row1[x1 + 2];
+            // Sums of four samples, hence the extra shift by 2
+            uPlane[(size_t)cy * chromaWidth + cx] = clampByte(((-38 * r - 74 * g + 112 * b + 512) >> 10) + 128);
+            vPlane[(size_t)cy * chromaWidth + cx] = clampByte(((112 * r - 94 * g - 18 * b + 512) >> 10) + 128);
+        }
+    }
+
+    static const char frameHeader[] = "FRAME\n";
+    if (std::fwrite(frameHeader, 1, sizeof(frameHeader) - 1, file) != sizeof(frameHeader) - 1)
+        return false;
+    return std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture.h"
+
+enum VideoFormat
+{
+    // Bare top-down RGBA frames; the reader has to be told size and rate
+    RawVideo,
+    // YUV4MPEG2 with 4:2:0 chroma, which ffmpeg and most encoders take on stdin
+    Y4MVideo
+};
+
+// Streams captured frames to a file, a named pipe or stdout ("-") on a thread of its own,
+// so a slow reader never blocks the GL thread until its queue is full.
+class VideoWriter
+{
+public:
+    ~VideoWriter();
+
+    // .raw and .rgba paths get raw frames, anything else Y4M
+    static VideoFormat formatFor(const std::string& path);
+
+    bool open(const std::string& path, int width, int height, int framesPerSecond);
+    // Queues a frame; waits while maxQueuedFrames are still unwritten
+    void write(std::shared_ptr<CapturedFrame> frame);
+    // Writes what is queued and closes the output
+    void close();
+
+    bool isOpen() const
+    {
+        return file != nullptr;
+    }
+
+    // Frames written so far and the times write() had to wait for the writer
+    std::atomic<uint64_t> framesWritten{ 0 };
+    unsigned int waits = 0;
+
+private:
+    static const size_t maxQueuedFrames = 8;
+
+    FILE* file = nullptr;
+    bool ownsFile = false;
+    VideoFormat format = Y4MVideo;
+    int width = 0;
+    int height = 0;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::deque<std::shared_ptr<CapturedFrame>> queue;
+    bool closing = false;
+    // Set by the writer once the reader went away; later frames are dropped
+    std::atomic<bool> failed{ false };
+
+    // Top-down output, reused between frames
+    std::vector<uint8_t> buffer;
+
+    void writeLoop();
+    bool writeFrame(const CapturedFrame& frame);
+};
@@ -0,0 +1,146 @@
+#include "volumetricfog.h"
+#include "profiler.h"
+
+#include <cmath>
+
+// Offsets of the sample within its slice, cycled through frame by frame (base 2 van der Corput)
+static const float sliceJitter[8] = { 0.5f, 0.25f, 0.75f, 0.125f, 0.625f, 0.375f, 0.875f, 0.0625f };
+
+static GLuint createVolume()
+{
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_3D, texture);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, VolumetricFog::gridWidth, VolumetricFog::gridHeight,
+        VolumetricFog::gridDepth, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    return texture;
+}
+
+static GLuint createSlice()
+{
+    GLuint texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, VolumetricFog::gridWidth, VolumetricFog::gridHeight, 0,
+        GL_RGBA, GL_HALF_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+VolumetricFog::VolumetricFog() :
+    scatterShader("res/shaders/froxel.vs", "res/shaders/fogscatter.fs"),
+    integrateShader("res/shaders/froxel.vs", "res/shaders/fogintegrate.fs")
+{
+    scatter[0] = createVolume();
+    scatter[1] = createVolume();
+    integrated = createVolume();
+    accumulation[0] = createSlice();
+    accumulation[1] = createSlice();
+    glGenFramebuffers(1, &framebuffer);
+    // The full-screen triangle comes from gl_VertexID, but core profiles still need a VAO bound
+    glGenVertexArrays(1, &emptyVAO);
+}
+
+VolumetricFog::~VolumetricFog()
+{
+    glDeleteTextures(2, scatter);
+    glDeleteTextures(1, &integrated);
+    glDeleteTextures(2, accumulation);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteVertexArrays(1, &emptyVAO);
+}
+
+void VolumetricFog::render(const Camera& camera, const RenderQueue::ShaderSetup& setup)
+{
+    PROFILE_SCOPE("VolumetricFog::render");
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    // The grid spans the viewport it was rendered for
+    screenSize = glm::vec2(previousViewport[2], previousViewport[3]);
+
+    // Froxels stay put under the jitter of temporal upscaling
+    const glm::mat4& projection = camera.getUnjitteredProjectionMatrix();
+    const glm::mat4& view = camera.getViewMatrix();
+    // Half extents of the view at unit depth
+    glm::vec2 tanHalfFov(1.0f / projection[0][0], 1.0f / projection[1][1]);
+    int previous = current;
+    current ^= 1;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, gridWidth, gridHeight);
+    glDisable(GL_DEPTH_TEST);
+    glBindVertexArray(emptyVAO);
+
+    // Light scattered in every froxel, blended with its reprojected history
+    scatterShader.use();
+    setup(scatterShader);
+    scatterShader.setMat4("froxelInverseView", glm::inverse(view));
+    scatterShader.setMat4("historyViewProjection", previousViewProjection);
+    scatterShader.setVec2("froxelTanHalfFov", tanHalfFov);
+    scatterShader.setFloat("sliceJitter", sliceJitter[frameIndex % 8]);
+    scatterShader.setFloat("historyWeight", historyValid ? historyWeight : 0.0f);
+    scatterShader.setInt("fogHistory", 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D, scatter[previous]);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    for (int slice = 0; slice < gridDepth; slice++)
+    {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, scatter[current], 0, slice);
+        scatterShader.setInt("slice", slice);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    // Front to back along every column: the slice's result and the running sum for the next slice
+    integrateShader.use();
+    integrateShader.setVec2("froxelTanHalfFov", tanHalfFov);
+    integrateShader.setInt("fogScatter", 0);
+    integrateShader.setInt("fogAccumulation", 1);
+    glBindTexture(GL_TEXTURE_3D, scatter[current]);
+    const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, drawBuffers);
+    for (int slice = 0; slice < gridDepth; slice++)
+    {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, accumulation[slice & 1]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, integrated, 0, slice);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, accumulation[(slice + 1) & 1], 0);
+        integrateShader.setInt("slice", slice);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, 0, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+
+    previousViewProjection = projection * view;
+    historyValid = true;
+    frameIndex++;
+}
+
+void VolumetricFog::configure(const Shader& shader) const
+{
+    glActiveTexture(GL_TEXTURE0 + fogTextureUnit);
+    glBindTexture(GL_TEXTURE_3D, integrated);
+    glActiveTexture(GL_TEXTURE0);
+
+    shader.setBool("volumetricFog", true);
+    shader.setVec2("fogScreenSize", screenSize);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "camera.h"
+#include "object.h"
+#include "renderqueue.h"
+
+// Texture unit the integrated fog volume is bound to, below the spotlight shadow atlas
+const int fogTextureUnit = 12;
+
+// Fog lit by the scene's lights, in a grid of froxels: gridWidth x gridHeight tiles of the screen,
+// each cut into gridDepth slices spaced exponentially between fogNear and fogFar.
+//
+// Every frame each froxel gathers the light scattered towards the camera, with the shadows of
+// every light, at a depth jittered within its slice. The result is blended with what the froxel
+// held last frame, found by reprojecting it with last frame's camera, so the jitter averages out
+// over frames and the grid can stay coarse. A second pass then walks each column front to back
+// and stores the light gathered and the transmittance up to every slice. Shading looks the fog up
+// once per fragment, so lit fog costs the same at any resolution and with any number of lights.
+//
+// GL 3.3 has no compute shaders: both passes draw a full-screen triangle into one slice at a time.
+class VolumetricFog
+{
+public:
+    static const int gridWidth = 160;
+    static const int gridHeight = 90;
+    static const int gridDepth = 64;
+    static constexpr float fogNear = 0.5f;
+    static constexpr float fogFar = 64.0f;
+    // Share of last frame's froxel kept when its reprojection lands inside the grid
+    static constexpr float historyWeight = 0.9f;
+
+    VolumetricFog();
+    ~VolumetricFog();
+
+    VolumetricFog(const VolumetricFog&) = delete;
+    VolumetricFog& operator=(const VolumetricFog&) = delete;
+
+    // Lights and integrates the froxels for the camera; setup provides the lights and the shadow maps.
+    // Restores the framebuffer and viewport it found.
+    void render(const Camera& camera, const RenderQueue::ShaderSetup& setup);
+    // Binds the integrated volume and turns volumetric fog on for a program
+    void configure(const Shader& shader) const;
+
+    // The next frame starts over without history, e.g. after the fog was off for a while
+    void reset()
+    {
+        historyValid = false;
+    }
+
+private:
+    Shader scatterShader;
+    Shader integrateShader;
+    // Lit froxels of this frame and the last one, swapped every frame
+    GLuint scatter[2] = {};
+    // Light gathered and transmittance from the camera to the far end of every slice
+    GLuint integrated = 0;
+    // Running sums of the integration, swapped every slice
+    GLuint accumulation[2] = {};
+    GLuint framebuffer = 0;
+    GLuint emptyVAO = 0;
+    glm::vec2 screenSize = glm::vec2(1.0f);
+    int current = 0;
+    bool historyValid = false;
+    glm::mat4 previousViewProjection = glm::mat4(1.0f);
+    unsigned int frameIndex = 0;
+};
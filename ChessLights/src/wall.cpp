@@ -0,0 +1,186 @@
+#include "wall.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+// Closest the benchmark flight comes, over the boards at the centre
+static const glm::vec3 wallCloseCameraPos = glm::vec3(0.0f, 4.0f, 6.0f);
+static const float wallCloseCameraPitch = -35.0f;
+
+bool WallFeed::open(const std::string& path)
+{
+    std::shared_ptr<std::ifstream> file;
+    if (path != "-")
+    {
+        file = std::make_shared<std::ifstream>(path);
+        if (!file->is_open())
+        {
+            std::cout << "ERROR::WALL::FEED_NOT_OPENED " << path << std::endl;
+            return false;
+        }
+    }
+
+    queue = std::make_shared<Queue>();
+    std::shared_ptr<Queue> shared = queue;
+    std::thread([shared, file]()
+    {
+        std::istream& input = file ? static_cast<std::istream&>(*file) : std::cin;
+        std::string line;
+        while (std::getline(input, line))
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->lines.push_back(line);
+        }
+    }).detach();
+    return true;
+}
+
+void WallFeed::take(std::vector<std::string>& lines)
+{
+    lines.clear();
+    if (!queue)
+        return;
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    lines.swap(queue->lines);
+}
+
+TournamentWall::TournamentWall(Shader& shader, Model& boardModel, const ImpostorAtlas& boardImpostor, int boardCount)
+{
+    int columns = std::max(1, (int)std::ceil(std::sqrt((float)boardCount)));
+    int rows = (boardCount + columns - 1) / columns;
+    scale = std::min(1.0f, maxWidth / (std::max(columns, rows) * boardPitch));
+
+    // Centred on the origin, where the single board stands, with the first board at the back left
+    glm::mat4 local = glm::scale(glm::mat4(1.0f), glm::vec3(scale));
+    local = glm::translate(local, glm::vec3(-(columns - 1), 0.0f, -(rows - 1)) * (boardPitch * 0.5f));
+    wallRoot.setLocal(local);
+
+    ChessPosition initial = ChessPosition::initial();
+    for (int i = 0; i < boardCount; i++)
+    {
+        std::unique_ptr<WallBoard> wallBoard(new WallBoard());
+        wallBoard->root.setParent(&wallRoot);
+        wallBoard->root.setLocal(glm::translate(glm::mat4(1.0f), glm::vec3(i % columns, 0.0f, i / columns) * boardPitch));
+        wallBoard->board.reset(new Board(shader, boardModel));
+        wallBoard->board->attachTo(wallBoard->root);
+        wallBoard->board->impostor = &boardImpostor;
+        wallBoard->pieces.reset(new PieceSet(shader, wallBoard->root));
+        wallBoard->position = initial;
+        boards.push_back(std::move(wallBoard));
+    }
+}
+
+void TournamentWall::setPieceModel(PieceType type, Model* model, const ImpostorAtlas* impostor)
+{
+    for (auto& wallBoard : boards)
+    {
+        wallBoard->pieces->setModel(type, model, impostor);
+        // Pieces are only made for the squares that change
+        wallBoard->pieces->setPosition(BoardState());
+        wallBoard->pieces->setPosition(wallBoard->position.board);
+    }
+}
+
+int TournamentWall::apply(const std::vector<std::string>& lines)
+{
+    PROFILE_SCOPE("TournamentWall::apply");
+    int applied = 0;
+    for (const std::string& line : lines)
+    {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        if (applyLine(line))
+            applied++;
+        else
+            std::cout << "ERROR::WALL::INVALID_LINE " << line << std::endl;
+    }
+    return applied;
+}
+
+bool TournamentWall::applyLine(const std::string& line)
+{
+    std::istringstream fields(line);
+    int number = 0;
+    std::string text;
+    if (!(fields >> number) || number < 1 || number > (int)boards.size())
+        return false;
+    std::getline(fields >> std::ws, text);
+    while (!text.empty() && (text.back() == '\r' || text.back() == ' '))
+        text.pop_back();
+
+    WallBoard& wallBoard = *boards[number - 1];
+    // Only a placement has slashes
+    if (text.find('/') != std::string::npos)
+    {
+        if (!wallBoard.position.parseFen(text))
+            return false;
+    }
+    else
+    {
+        ChessMove move;
+        if (!wallBoard.position.parseSan(text, move))
+            return false;
+        wallBoard.position.apply(move);
+    }
+    wallBoard.pieces->setPosition(wallBoard.position.board);
+    return true;
+}
+
+void TournamentWall::submit(RenderQueue& queue, const Camera& camera, const Conditions& conditions, int viewportHeight)
+{
+    PROFILE_SCOPE("TournamentWall::submit");
+    glm::mat4 viewProjection = camera.getProjectionMatrix() * camera.getViewMatrix();
+    float radius = boardRadius * scale;
+    // Radius on screen of a unit sphere at a distance of one
+    float pixelsPerUnit = viewportHeight * 0.5f / std::tan(glm::radians(camera.Zoom) * 0.5f);
+
+    detailedBoards = 0;
+    impostorBoards = 0;
+    culledBoards = 0;
+    for (auto& wallBoard : boards)
+    {
+        glm::vec3 center = glm::vec3(wallBoard->root.getWorld()[3]);
+        if (!RenderQueue::sphereInView(center, radius, viewProjection))
+        {
+            culledBoards++;
+            continue;
+        }
+
+        float pixels = radius / std::max(glm::distance(camera.Position, center), NEAR_PLANE) * pixelsPerUnit;
+        if (pixels >= detailPixels)
+        {
+            wallBoard->board->submit(queue, camera, conditions);
+            wallBoard->pieces->submit(queue, camera, conditions);
+            detailedBoards++;
+            continue;
+        }
+
+        wallBoard->board->submitImpostor(queue);
+        if (pixels >= piecePixels)
+            wallBoard->pieces->submitImpostors(queue);
+        impostorBoards++;
+    }
+}
+
+void TournamentWall::addTo(Picker& picker) const
+{
+    for (const auto& wallBoard : boards)
+    {
+        picker.addBoard(*wallBoard->board, wallBoard->root);
+        wallBoard->pieces->addTo(picker);
+    }
+}
+
+void TournamentWall::benchmarkCamera(float progress, glm::vec3& position, float& pitch, float& yaw) const
+{
+    float down = std::sin(glm::pi<float>() * glm::clamp(progress, 0.0f, 1.0f));
+    down = down * down * (3.0f - 2.0f * down);
+    position = glm::mix(wallCameraPos, wallCloseCameraPos, down);
+    pitch = glm::mix(wallCameraPitch, wallCloseCameraPitch, down);
+    yaw = wallCameraYaw;
+}
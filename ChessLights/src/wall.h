@@ -0,0 +1,112 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "chessposition.h"
+#include "object.h"
+#include "pieceset.h"
+#include "picking.h"
+
+// Most boards a wall shows
+const int wallMaxBoards = 1024;
+
+// The whole wall, seen from the front and above; the static camera of wall mode
+const glm::vec3 wallCameraPos = glm::vec3(0.0f, 36.0f, 44.0f);
+const float wallCameraPitch = -45.0f;
+const float wallCameraYaw = -90.0f;
+
+// Position updates for the boards of a wall, one per line:
+//   <board> <FEN>   sets up a position, e.g. "12 rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b"
+//   <board> <move>  plays a move in standard algebraic notation, e.g. "12 e5"
+// Boards are counted from 1. Lines are read on a thread of their own, so a slow pipe never holds
+// up a frame, and handed over whenever the renderer asks. The thread is left to itself at exit:
+// one waiting on a pipe or stdin could not be woken.
+class WallFeed
+{
+public:
+    WallFeed() = default;
+
+    WallFeed(const WallFeed&) = delete;
+    WallFeed& operator=(const WallFeed&) = delete;
+
+    // A file, a named pipe or stdin ("-")
+    bool open(const std::string& path);
+    // Moves the lines read since the last call into lines
+    void take(std::vector<std::string>& lines);
+
+private:
+    // Shared with the reading thread, which may still be blocked on its input when the feed goes
+    struct Queue
+    {
+        std::mutex mutex;
+        std::vector<std::string> lines;
+    };
+
+    std::shared_ptr<Queue> queue;
+};
+
+// Every game of a tournament at once: boards tiled in a grid on the floor, each with its own
+// position. The boards share the models and impostors of the scene, and every frame each board
+// is culled against the view and drawn at the detail its size on screen calls for:
+//   - in full, as the single board does, once it is at least detailPixels across;
+//   - as an impostor of the board with impostors of its pieces, the pieces drawn instanced with
+//     those of every other board, down to piecePixels;
+//   - as the board's impostor alone below that, where the pieces would be a pixel or two.
+// However many boards there are, the draws beyond the nearest few are one per atlas.
+class TournamentWall
+{
+public:
+    // Distance between the centres of neighbouring boards, in board units
+    static constexpr float boardPitch = 16.0f;
+    // Width the grid is scaled down to fit, in world units
+    static constexpr float maxWidth = 48.0f;
+    // Radius of a board with its pieces, in board units
+    static constexpr float boardRadius = 9.5f;
+    // Radius on screen, in pixels, each level of detail starts at
+    static constexpr float detailPixels = 96.0f;
+    static constexpr float piecePixels = 10.0f;
+
+    TournamentWall(Shader& shader, Model& boardModel, const ImpostorAtlas& boardImpostor, int boardCount);
+
+    void setPieceModel(PieceType type, Model* model, const ImpostorAtlas* impostor);
+
+    // Applies feed lines; returns the number of lines applied, invalid ones are reported and skipped
+    int apply(const std::vector<std::string>& lines);
+
+    void submit(RenderQueue& queue, const Camera& camera, const Conditions& conditions, int viewportHeight);
+    // Adds every board with its pieces, in the order they are counted in
+    void addTo(Picker& picker) const;
+
+    // A flight from the overview down to a few boards at the centre and back; progress from 0 to 1
+    void benchmarkCamera(float progress, glm::vec3& position, float& pitch, float& yaw) const;
+
+    size_t getBoardCount() const
+    {
+        return boards.size();
+    }
+
+    // Boards of the last submit at each level of detail, and outside the view
+    int detailedBoards = 0;
+    int impostorBoards = 0;
+    int culledBoards = 0;
+
+private:
+    struct WallBoard
+    {
+        Transform root;
+        std::unique_ptr<Board> board;
+        std::unique_ptr<PieceSet> pieces;
+        ChessPosition position;
+    };
+
+    Transform wallRoot;
+    float scale = 1.0f;
+    std::vector<std::unique_ptr<WallBoard>> boards;
+
+    // Applies one line; false when it cannot be read or played
+    bool applyLine(const std::string& line);
+};
@@ -1,10 +1,22 @@
 #pragma once
 #include <glm/glm.hpp>
-#include <chrono>
+#include <algorithm>
+#include <cmath>
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+// Snapshot of the conditions the renderer needs, published with every simulation tick
+struct Conditions
+{
+	glm::vec3 backgroundColor = { 0.0f, 0.0f, 0.0f };
+	float fogDensity = 0.0f;
+	bool objectShaking = false;
+	bool lightsOn = false;
+	int shadeMode = 0;
+};
+
+// Advances the time of day and fog transitions by the simulation time step
 class ConditionsController
 {
 private:
@@ -18,13 +30,7 @@ private:
 
 	float mixFactor = 0.0f;
 	TimeOfDay timeOfDay = Morning;
-	std::chrono::steady_clock::time_point start_time;
-
-	int elapsedMiliSeconds(std::chrono::steady_clock::time_point& start) {
-		std::chrono::steady_clock::time_point current_time = std::chrono::steady_clock::now();
-		std::chrono::milliseconds elapsed_milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(current_time - start);
-		return elapsed_milliseconds.count();
-	}
+	float cycleMiliSeconds = 0.0f;
 
 	const glm::vec3 backgroundColors[4] = {
 	{0.6f, 0.8f, 1.0f},
@@ -61,9 +67,7 @@ private:
 
 	const int fullFogChange = 4000;
 	const float fogMax = 0.1f;
-	std::chrono::steady_clock::time_point fogChangeStart;
-
-	std::chrono::steady_clock::time_point last_time = std::chrono::steady_clock::now();
+	float fogChangeMiliSeconds = 0.0f;
 
 	float currentFogValue = 0.0f;
 	float startChanging = 0.0f;
@@ -74,32 +78,35 @@ private:
 		if (fogEnabled && currentFogValue < fogMax)
 		{
 			currentFogValue = startChanging + 
-				fogMax*((float)elapsedMiliSeconds(fogChangeStart) / (float)fullFogChange);
+				fogMax*(fogChangeMiliSeconds / (float)fullFogChange);
 			currentFogValue = std::min(currentFogValue, fogMax);
 		}
 		else if (!fogEnabled && currentFogValue > 0.0f)
 		{
 			currentFogValue = startChanging -
-				fogMax * ((float)elapsedMiliSeconds(fogChangeStart) / (float)fullFogChange);
+				fogMax * (fogChangeMiliSeconds / (float)fullFogChange);
 			currentFogValue = std::max(currentFogValue, 0.0f);
 		}
 	}
 
 public:
 
-	ConditionsController()
-	{
-		start_time = std::chrono::steady_clock::now();
-	}
-
-	void updateTime()
+	void updateTime(float deltaTime)
 	{
-		if (timeStop) start_time += std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - last_time);
-		int secondsInCycle = (elapsedMiliSeconds(start_time) % fullCycleSeconds);
+		if (!timeStop)
+			cycleMiliSeconds = std::fmod(cycleMiliSeconds + deltaTime * 1000.0f, (float)fullCycleSeconds);
+		int secondsInCycle = (int)cycleMiliSeconds;
 		timeOfDay = (TimeOfDay)(secondsInCycle / partialCycleSeconds);
 		mixFactor = (float)(secondsInCycle - timeOfDay * partialCycleSeconds)/(float)partialCycleSeconds;
+		fogChangeMiliSeconds += deltaTime * 1000.0f;
 		updateFog();
-		last_time = std::chrono::steady_clock::now();
+	}
+
+	// Jumps to a point of the day cycle: 0 is morning, 0.25 afternoon, 0.5 evening, 0.75 night
+	void setTimeOfDay(float fraction)
+	{
+		cycleMiliSeconds = (fraction - std::floor(fraction)) * (float)fullCycleSeconds;
+		updateTime(0.0f);
 	}
 
 	glm::vec3 getAmbient() const
@@ -135,11 +142,31 @@ public:
 		return currentFogValue;
 	}
 
+	// Switches the fog on or off at once, without the transition
+	void setFog(bool enabled)
+	{
+		fogEnabled = enabled;
+		currentFogValue = enabled ? fogMax : 0.0f;
+		startChanging = currentFogValue;
+		fogChangeMiliSeconds = 0.0f;
+	}
+
 	void changeFog()
 	{
 		fogEnabled = !fogEnabled;
 		startChanging = currentFogValue;
-		fogChangeStart = std::chrono::steady_clock::now();
+		fogChangeMiliSeconds = 0.0f;
+	}
+
+	Conditions getConditions() const
+	{
+		Conditions conditions;
+		conditions.backgroundColor = getBackgroundColor();
+		conditions.fogDensity = getFogDensity();
+		conditions.objectShaking = objectShaking;
+		conditions.lightsOn = lightsOn;
+		conditions.shadeMode = shadeMode;
+		return conditions;
 	}
 
 	bool objectShaking = false;